@@ -0,0 +1,19 @@
+/* Auth: Megan Bird & Gary Miller
+ * File: mock/avr/pgmspace.h
+ * Course: CEEN-3450 - Mobile Robotics I - University of Nebraska-Lincoln
+ * Lab: Host tools (Linux)
+ * Date: 4/27/2017
+ * Desc: Stand-in for avr-libc's <avr/pgmspace.h> so the firmware's tune.c
+ *       builds on a PC.  There's one address space here, so flash data is
+ *       ordinary const data.
+ */
+
+#ifndef MOCK_PGMSPACE_H
+#define MOCK_PGMSPACE_H
+
+#include <string.h>
+
+#define PROGMEM
+#define memcpy_P( dst, src, n )		memcpy( ( dst ), ( src ), ( n ) )
+
+#endif /* MOCK_PGMSPACE_H */
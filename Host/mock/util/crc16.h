@@ -0,0 +1,26 @@
+/* Auth: Megan Bird & Gary Miller
+ * File: mock/util/crc16.h
+ * Course: CEEN-3450 - Mobile Robotics I - University of Nebraska-Lincoln
+ * Lab: Host tools (Linux)
+ * Date: 4/27/2017
+ * Desc: Stand-in for avr-libc's <util/crc16.h>: _crc_ccitt_update() as
+ *       the avr-libc manual gives it in C.
+ */
+
+#ifndef MOCK_CRC16_H
+#define MOCK_CRC16_H
+
+#include <stdint.h>
+
+static inline uint16_t _crc_ccitt_update( uint16_t crc, uint8_t data )
+{
+
+	data ^= ( uint8_t )( crc & 0xFF );
+	data ^= ( uint8_t )( data << 4 );
+
+	return ( ( ( uint16_t ) data << 8 ) | ( crc >> 8 ) ) ^
+		   ( uint8_t )( data >> 4 ) ^ ( ( uint16_t ) data << 3 );
+
+} // end _crc_ccitt_update()
+
+#endif /* MOCK_CRC16_H */
@@ -0,0 +1,373 @@
+/* Auth: Megan Bird & Gary Miller
+ * File: tlm.c
+ * Course: CEEN-3450 - Mobile Robotics I - University of Nebraska-Lincoln
+ * Lab: Host tools (Linux)
+ * Date: 4/27/2017
+ * Desc: COBS/CRC framing and TLM_FRAME / TUNE_REPLY unpacking for the
+ *       robot's telemetry link.  See tlm.h for the wire format.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "tlm.h"
+
+// ---------------------- Globals:
+
+// PARAM_ID order.  Lab 8 Part 2 stops at sonar_ms; the rest are unified-image only.
+static const char * const param_names[] = {
+
+	"deg_90",
+	"line_speed",
+	"wall_speed",
+	"sonar_trigger",
+	"wall_goal",
+	"line_thresh",
+	"exit_thresh",
+	"line_kp",
+	"line_kd",
+	"wall_kp",
+	"wall_kd",
+	"line_ms",
+	"sonar_ms",
+	"mode",
+	"pixy_zone",
+	"standoff",
+	"menu_ms"
+
+};
+
+#define PARAM_NAMES		( ( int )( sizeof( param_names ) / sizeof( param_names[ 0 ] ) ) )
+
+static const char * const status_names[] = {
+
+	"ok",
+	"bad frame",
+	"bad op",
+	"bad id",
+	"out of range"
+
+};
+
+// ---------------------- Helpers:
+static uint16_t get_u16( const uint8_t *p )
+{
+
+	return ( uint16_t )( p[ 0 ] | ( p[ 1 ] << 8 ) );
+
+} // end get_u16()
+
+// -------------------------------------------------------------------------- //
+static uint32_t get_u32( const uint8_t *p )
+{
+
+	return ( uint32_t ) p[ 0 ] | ( ( uint32_t ) p[ 1 ] << 8 ) |
+		   ( ( uint32_t ) p[ 2 ] << 16 ) | ( ( uint32_t ) p[ 3 ] << 24 );
+
+} // end get_u32()
+
+// -------------------------------------------------------------------------- //
+static float get_float( const uint8_t *p )
+{
+
+	// AVR floats are IEEE-754 single, little-endian.
+	uint32_t bits = get_u32( p );
+	float value;
+
+	memcpy( &value, &bits, sizeof( value ) );
+	return value;
+
+} // end get_float()
+
+// ---------------------- Framing:
+uint16_t tlm_crc( const uint8_t *pData, size_t len )
+{
+
+	// Same as avr-libc's _crc_ccitt_update() from 0xFFFF (reflected 0x1021,
+	// no final XOR -- CRC-16/MCRF4XX, check value 0x6F91).
+	uint16_t crc = 0xFFFF;
+	uint8_t data;
+	size_t i;
+
+	for ( i = 0; i < len; i++ ) {
+		data = pData[ i ] ^ ( uint8_t )( crc & 0xFF );
+		data ^= ( uint8_t )( data << 4 );
+		crc = ( ( ( uint16_t ) data << 8 ) | ( crc >> 8 ) ) ^
+			  ( uint8_t )( data >> 4 ) ^ ( ( uint16_t ) data << 3 );
+	}
+
+	return crc;
+
+} // end tlm_crc()
+
+// -------------------------------------------------------------------------- //
+size_t tlm_cobs_encode( const uint8_t *pSrc, size_t len, uint8_t *pDst )
+{
+
+	// Standard COBS, no delimiter.  'pDst' needs len + len / 254 + 1 bytes.
+	size_t code_pos = 0;
+	size_t pos = 1;
+	uint8_t code = 1;
+	size_t i;
+
+	for ( i = 0; i < len; i++ ) {
+		if ( pSrc[ i ] == 0 ) {
+			pDst[ code_pos ] = code;
+			code_pos = pos++;
+			code = 1;
+		}
+		else {
+			pDst[ pos++ ] = pSrc[ i ];
+			if ( ++code == 0xFF ) {
+				pDst[ code_pos ] = code;
+				code_pos = pos++;
+				code = 1;
+			}
+		}
+	}
+	pDst[ code_pos ] = code;
+
+	return pos;
+
+} // end tlm_cobs_encode()
+
+// -------------------------------------------------------------------------- //
+long tlm_cobs_decode( const uint8_t *pSrc, size_t len, uint8_t *pDst )
+{
+
+	// Undoes tlm_cobs_encode() ('pSrc' without its 0x00).  Returns the
+	// decoded length, or -1 if 'pSrc' isn't valid COBS.
+	size_t in = 0;
+	size_t out = 0;
+	uint8_t code;
+	uint8_t i;
+
+	while ( in < len ) {
+
+		code = pSrc[ in++ ];
+		if ( code == 0 ) {
+			return -1;
+		}
+
+		for ( i = 1; i < code; i++ ) {
+			if ( in >= len || pSrc[ in ] == 0 ) {
+				return -1;
+			}
+			pDst[ out++ ] = pSrc[ in++ ];
+		}
+
+		// A code under 0xFF stands for a zero, except after the last group.
+		if ( code < 0xFF && in < len ) {
+			pDst[ out++ ] = 0;
+		}
+
+	}
+
+	return ( long ) out;
+
+} // end tlm_cobs_decode()
+
+// -------------------------------------------------------------------------- //
+size_t tlm_frame_encode( const uint8_t *pData, size_t len, uint8_t *pDst )
+{
+
+	// Payload + CRC, COBS, 0x00 -- what tlm_queue_frame() puts on the wire.
+	// 'len' is at most TLM_MAX_FRAME - 2.
+	uint8_t plain[ TLM_MAX_FRAME ];
+	uint16_t crc = tlm_crc( pData, len );
+	size_t n;
+
+	memcpy( plain, pData, len );
+	plain[ len ] = ( uint8_t )( crc & 0xFF );
+	plain[ len + 1 ] = ( uint8_t )( crc >> 8 );
+
+	n = tlm_cobs_encode( plain, len + 2, pDst );
+	pDst[ n++ ] = 0x00;
+
+	return n;
+
+} // end tlm_frame_encode()
+
+// ---------------------- Payloads:
+int tlm_unpack( const uint8_t *pData, size_t len, TLM_MSG *pMsg )
+{
+
+	// Fills 'pMsg' from a payload with its CRC already stripped.  Returns 0,
+	// or -1 if the layout isn't one we know (kind is TLM_KIND_UNKNOWN).
+	TLM_FRAME *f = &pMsg->frame;
+	const uint8_t *p = pData;
+
+	memset( f, 0, sizeof( *f ) );
+	memset( &pMsg->reply, 0, sizeof( pMsg->reply ) );
+	memcpy( pMsg->raw, pData, len );
+	pMsg->raw_len = len;
+	pMsg->kind = TLM_KIND_UNKNOWN;
+
+	if ( len == TLM_REPLY_LEN && p[ 0 ] == TLM_REPLY_TAG ) {
+		pMsg->kind = TLM_KIND_REPLY;
+		pMsg->reply.op = p[ 1 ];
+		pMsg->reply.id = p[ 2 ];
+		pMsg->reply.status = p[ 3 ];
+		pMsg->reply.value = get_float( &p[ 4 ] );
+		return 0;
+	}
+
+	if ( !( len == TLM_V1_LEN && p[ 0 ] == 1 ) && !( len == TLM_V5_LEN && p[ 0 ] == 5 ) &&
+		 !( len == TLM_V6_LEN && p[ 0 ] == 6 ) ) {
+		return -1;
+	}
+
+	f->version = *p++;
+	f->seq = *p++;
+	f->time_ms = get_u32( p );				p += 4;
+	if ( f->version >= 5 ) {
+		f->mode = *p++;
+	}
+	f->state = *p++;
+	f->speed_L = ( int16_t ) get_u16( p );	p += 2;
+	f->speed_R = ( int16_t ) get_u16( p );	p += 2;
+	f->ir = *p++;
+	f->left_photo_mv = get_u16( p );		p += 2;
+	f->right_photo_mv = get_u16( p );		p += 2;
+	f->sonar_mm = get_u16( p );				p += 2;
+	f->left_line_mv = get_u16( p );			p += 2;
+	f->right_line_mv = get_u16( p );		p += 2;
+	f->loops = get_u16( p );				p += 2;
+	f->dropped = *p++;
+	if ( f->version >= 5 ) {
+		f->boot_ms = get_u16( p );			p += 2;
+		f->stack_max = get_u16( p );		p += 2;
+		f->ram_free_min = get_u16( p );		p += 2;
+		f->ram_gap = get_u16( p );			p += 2;
+	}
+	if ( f->version >= 6 ) {
+		f->mem_failed = *p++;
+	}
+
+	pMsg->kind = TLM_KIND_FRAME;
+	return 0;
+
+} // end tlm_unpack()
+
+// -------------------------------------------------------------------------- //
+size_t tlm_cmd_pack( uint8_t op, uint8_t id, float value, uint8_t *pDst )
+{
+
+	// Packs a TUNE_CMD the way the robot's memcpy() expects it.
+	uint32_t bits;
+
+	memcpy( &bits, &value, sizeof( bits ) );
+
+	pDst[ 0 ] = op;
+	pDst[ 1 ] = id;
+	pDst[ 2 ] = ( uint8_t )( bits );
+	pDst[ 3 ] = ( uint8_t )( bits >> 8 );
+	pDst[ 4 ] = ( uint8_t )( bits >> 16 );
+	pDst[ 5 ] = ( uint8_t )( bits >> 24 );
+
+	return TLM_CMD_LEN;
+
+} // end tlm_cmd_pack()
+
+// -------------------------------------------------------------------------- //
+int tlm_param_id( const char *name )
+{
+
+	// A parameter's PARAM_ID from its name or number, -1 if neither.
+	char *end;
+	long id;
+	int i;
+
+	for ( i = 0; i < PARAM_NAMES; i++ ) {
+		if ( strcmp( name, param_names[ i ] ) == 0 ) {
+			return i;
+		}
+	}
+
+	id = strtol( name, &end, 10 );
+	if ( *name == '\0' || *end != '\0' || id < 0 || id > 255 ) {
+		return -1;
+	}
+
+	return ( int ) id;
+
+} // end tlm_param_id()
+
+// -------------------------------------------------------------------------- //
+const char *tlm_param_name( int id )
+{
+
+	return ( id >= 0 && id < PARAM_NAMES ) ? param_names[ id ] : NULL;
+
+} // end tlm_param_name()
+
+// -------------------------------------------------------------------------- //
+const char *tlm_status_name( int status )
+{
+
+	return ( status >= 0 && status <= TLM_ST_RANGE ) ? status_names[ status ] : "unknown status";
+
+} // end tlm_status_name()
+
+// ---------------------- Receiver:
+void tlm_rx_init( TLM_RX *pRx )
+{
+
+	memset( pRx, 0, sizeof( *pRx ) );
+
+} // end tlm_rx_init()
+
+// -------------------------------------------------------------------------- //
+int tlm_rx_byte( TLM_RX *pRx, uint8_t byte, TLM_MSG *pMsg )
+{
+
+	// Feed one byte off the wire.  Returns 1 when it completed a payload
+	// with a good CRC ('pMsg' filled in), -1 when it completed a bad one,
+	// and 0 otherwise.  Bad frames only cost themselves -- the next 0x00
+	// always starts over.
+	uint8_t plain[ sizeof( pRx->buf ) ];
+	long n;
+
+	if ( byte != 0x00 ) {
+		if ( pRx->len < sizeof( pRx->buf ) ) {
+			pRx->buf[ pRx->len++ ] = byte;
+		}
+		else {
+			pRx->overrun = 1;
+		}
+		return 0;
+	}
+
+	// Back-to-back delimiters are just idle line.
+	if ( pRx->len == 0 && !pRx->overrun ) {
+		return 0;
+	}
+
+	n = pRx->overrun ? -1 : tlm_cobs_decode( pRx->buf, pRx->len, plain );
+	pRx->len = 0;
+	pRx->overrun = 0;
+
+	if ( n < 2 || n > TLM_MAX_FRAME ) {
+		pRx->bad_cobs++;
+		return -1;
+	}
+
+	// Running the CRC over the payload and its own CRC leaves 0.
+	if ( tlm_crc( plain, ( size_t ) n ) != 0 ) {
+		pRx->bad_crc++;
+		return -1;
+	}
+
+	pRx->good++;
+	tlm_unpack( plain, ( size_t ) n - 2, pMsg );
+
+	if ( pMsg->kind == TLM_KIND_FRAME ) {
+		if ( pRx->have_seq ) {
+			pRx->lost += ( uint8_t )( pMsg->frame.seq - pRx->last_seq - 1 );
+		}
+		pRx->have_seq = 1;
+		pRx->last_seq = pMsg->frame.seq;
+	}
+
+	return 1;
+
+} // end tlm_rx_byte()
@@ -0,0 +1,139 @@
+/* Auth: Megan Bird & Gary Miller
+ * File: tlm.h
+ * Course: CEEN-3450 - Mobile Robotics I - University of Nebraska-Lincoln
+ * Lab: Host tools (Linux)
+ * Date: 4/27/2017
+ * Desc: Host side of the robot's USART0 link.  Every frame on the wire is
+ *       the payload, a CRC-16 over it (avr-libc _crc_ccitt_update(), init
+ *       0xFFFF, low byte first), COBS encoded and ended with a 0x00 byte.
+ *       The robot sends TLM_FRAME telemetry and TUNE_REPLY replies; the
+ *       host sends TUNE_CMD commands (TLM_OP, a PARAM_ID and a value).  Layouts match main.c in Lab 8 Part 2
+ *       (TLM_VERSION 1) and the unified image (TLM_VERSION 5 and 6).
+ */
+
+#ifndef TLM_H
+#define TLM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// ---------------------- Defines:
+#define TLM_MAX_FRAME		64		/* Longest payload + CRC accepted, bytes. */
+#define TLM_REPLY_TAG		0xA5	/* First byte of a TUNE_REPLY. */
+
+#define TLM_V1_LEN			25		/* Packed TLM_FRAME, Lab 8 Part 2. */
+#define TLM_V5_LEN			34		/* Packed TLM_FRAME, unified image. */
+#define TLM_V6_LEN			35		/* ... plus 'mem_failed'. */
+#define TLM_REPLY_LEN		8		/* Packed TUNE_REPLY. */
+#define TLM_CMD_LEN			6		/* Packed TUNE_CMD. */
+
+// ---------------------- Type Declarations:
+
+// Desc: Command opcodes -- TUNE_OP in tune.h.
+typedef enum TLM_OP_TYPE {
+
+	TLM_OP_GET = 1,
+	TLM_OP_SET,
+	TLM_OP_SAVE,
+	TLM_OP_LOAD
+
+} TLM_OP;
+
+// Desc: Reply status codes -- TUNE_STATUS in tune.h.
+typedef enum TLM_STATUS_TYPE {
+
+	TLM_ST_OK,
+	TLM_ST_BAD_FRAME,
+	TLM_ST_BAD_OP,
+	TLM_ST_BAD_ID,
+	TLM_ST_RANGE
+
+} TLM_STATUS;
+
+// Desc: What a decoded payload turned out to be.
+typedef enum TLM_KIND_TYPE {
+
+	TLM_KIND_FRAME,					// Telemetry, see 'frame'.
+	TLM_KIND_REPLY,					// Command reply, see 'reply'.
+	TLM_KIND_UNKNOWN				// CRC was good but the layout isn't one we know.
+
+} TLM_KIND;
+
+// Desc: A telemetry frame, unpacked.  Fields the sending version doesn't
+//       carry are left 0.
+typedef struct TLM_FRAME_TYPE {
+
+	uint8_t version;
+	uint8_t seq;
+	uint32_t time_ms;
+	uint8_t mode;					// v5 and up.
+	uint8_t state;
+	int16_t speed_L;
+	int16_t speed_R;
+	uint8_t ir;						// Bit 0 = left IR, bit 1 = right IR, bits 2-4 = S3-S5 (v5 and up).
+	uint16_t left_photo_mv;
+	uint16_t right_photo_mv;
+	uint16_t sonar_mm;
+	uint16_t left_line_mv;
+	uint16_t right_line_mv;
+	uint16_t loops;
+	uint8_t dropped;
+	uint16_t boot_ms;				// v5 and up.
+	uint16_t stack_max;				// v5 and up.
+	uint16_t ram_free_min;			// v5 and up.
+	uint16_t ram_gap;				// v5 and up.
+	uint8_t mem_failed;				// v6 only.
+
+} TLM_FRAME;
+
+// Desc: A command reply, unpacked.
+typedef struct TLM_REPLY_TYPE {
+
+	uint8_t op;
+	uint8_t id;
+	uint8_t status;
+	float value;
+
+} TLM_REPLY;
+
+// Desc: One decoded payload.
+typedef struct TLM_MSG_TYPE {
+
+	TLM_KIND kind;
+	TLM_FRAME frame;
+	TLM_REPLY reply;
+	uint8_t raw[ TLM_MAX_FRAME ];	// Payload as received, CRC stripped.
+	size_t raw_len;
+
+} TLM_MSG;
+
+// Desc: Byte-at-a-time receiver.  Collects up to the next 0x00 and keeps
+//       count of what it threw away.
+typedef struct TLM_RX_TYPE {
+
+	uint8_t buf[ TLM_MAX_FRAME + TLM_MAX_FRAME / 254 + 2 ];
+	size_t len;
+	int overrun;					// Current frame ran past 'buf' -- drop it at the 0x00.
+	unsigned long good;				// Payloads with a good CRC.
+	unsigned long bad_cobs;			// Bad COBS or too long.
+	unsigned long bad_crc;			// Decoded, but the CRC didn't check.
+	unsigned long lost;				// Telemetry frames missing from the 'seq' count.
+	int have_seq;
+	uint8_t last_seq;
+
+} TLM_RX;
+
+// ---------------------- Prototypes:
+uint16_t tlm_crc( const uint8_t *pData, size_t len );
+size_t tlm_cobs_encode( const uint8_t *pSrc, size_t len, uint8_t *pDst );
+long tlm_cobs_decode( const uint8_t *pSrc, size_t len, uint8_t *pDst );
+size_t tlm_frame_encode( const uint8_t *pData, size_t len, uint8_t *pDst );
+int tlm_unpack( const uint8_t *pData, size_t len, TLM_MSG *pMsg );
+void tlm_rx_init( TLM_RX *pRx );
+int tlm_rx_byte( TLM_RX *pRx, uint8_t byte, TLM_MSG *pMsg );
+size_t tlm_cmd_pack( uint8_t op, uint8_t id, float value, uint8_t *pDst );
+int tlm_param_id( const char *name );
+const char *tlm_param_name( int id );
+const char *tlm_status_name( int status );
+
+#endif /* TLM_H */
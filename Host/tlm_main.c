@@ -0,0 +1,108 @@
+/* Auth: Megan Bird & Gary Miller
+ * File: tlm_main.c
+ * Course: CEEN-3450 - Mobile Robotics I - University of Nebraska-Lincoln
+ * Lab: Host tools (Linux)
+ * Date: 4/27/2017
+ * Desc: Prints the robot's telemetry as it comes in.
+ *
+ *           tlm <tty>
+ *
+ *       One line per frame; the link counters are printed on Ctrl-C.
+ */
+
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include "tlm_port.h"
+
+// ---------------------- Globals:
+static volatile sig_atomic_t stop = 0;
+
+// ---------------------- Functions:
+static void on_signal( int sig )
+{
+
+	( void ) sig;
+	stop = 1;
+
+} // end on_signal()
+
+// -------------------------------------------------------------------------- //
+static void print_frame( const TLM_FRAME *f )
+{
+
+	printf( "v%u seq=%3u t=%8lu ", f->version, f->seq, ( unsigned long ) f->time_ms );
+	if ( f->version >= 5 ) {
+		printf( "mode=%u ", f->mode );
+	}
+	printf( "state=%u L=%5d R=%5d ir=%c%c photo=%u,%u sonar=%umm line=%u,%u loops=%u dropped=%u",
+			f->state, f->speed_L, f->speed_R,
+			( f->ir & 0x01 ) ? 'L' : '-', ( f->ir & 0x02 ) ? 'R' : '-',
+			f->left_photo_mv, f->right_photo_mv, f->sonar_mm,
+			f->left_line_mv, f->right_line_mv, f->loops, f->dropped );
+	if ( f->version >= 5 ) {
+		printf( " boot=%ums stack=%u free=%u gap=%u",
+				f->boot_ms, f->stack_max, f->ram_free_min, f->ram_gap );
+	}
+	if ( f->version >= 6 ) {
+		printf( " mem_failed=%u", f->mem_failed );
+	}
+	printf( "\n" );
+
+} // end print_frame()
+
+// -------------------------------------------------------------------------- //
+int main( int argc, char **argv )
+{
+
+	TLM_PORT port;
+	TLM_MSG msg;
+	struct sigaction sa;
+	int rc;
+
+	if ( argc != 2 ) {
+		fprintf( stderr, "usage: %s <tty>\n", argv[ 0 ] );
+		return 2;
+	}
+
+	if ( tlm_port_open( &port, argv[ 1 ] ) != 0 ) {
+		perror( argv[ 1 ] );
+		return 1;
+	}
+
+	memset( &sa, 0, sizeof( sa ) );
+	sa.sa_handler = on_signal;
+	sigaction( SIGINT, &sa, NULL );
+	sigaction( SIGTERM, &sa, NULL );
+
+	while ( !stop ) {
+
+		rc = tlm_port_read( &port, &msg, 200 );
+		if ( rc < 0 ) {
+			break;
+		}
+		if ( rc == 0 ) {
+			continue;
+		}
+
+		if ( msg.kind == TLM_KIND_FRAME ) {
+			print_frame( &msg.frame );
+		}
+		else if ( msg.kind == TLM_KIND_REPLY ) {
+			printf( "reply op=%u id=%u status=%u value=%g\n",
+					msg.reply.op, msg.reply.id, msg.reply.status, msg.reply.value );
+		}
+		else {
+			printf( "unknown payload: %zu bytes, first 0x%02X\n", msg.raw_len, msg.raw[ 0 ] );
+		}
+		fflush( stdout );
+
+	}
+
+	fprintf( stderr, "good=%lu bad_cobs=%lu bad_crc=%lu lost=%lu\n",
+			 port.rx.good, port.rx.bad_cobs, port.rx.bad_crc, port.rx.lost );
+	tlm_port_close( &port );
+
+	return 0;
+
+} // end main()
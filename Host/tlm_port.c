@@ -0,0 +1,212 @@
+/* Auth: Megan Bird & Gary Miller
+ * File: tlm_port.c
+ * Course: CEEN-3450 - Mobile Robotics I - University of Nebraska-Lincoln
+ * Lab: Host tools (Linux)
+ * Date: 4/27/2017
+ * Desc: Telemetry link on a Linux tty.  See tlm_port.h.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include "tlm_port.h"
+
+// ---------------------- Helpers:
+static long now_ms( void )
+{
+
+	struct timespec ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return ( long ) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+
+} // end now_ms()
+
+// ---------------------- Functions:
+int tlm_port_attach( TLM_PORT *pPort, int fd )
+{
+
+	// Takes over an already open tty: raw 8N1, TLM_BAUD, no flow control.
+	struct termios tio;
+
+	if ( tcgetattr( fd, &tio ) != 0 ) {
+		return -1;
+	}
+
+	cfmakeraw( &tio );
+	tio.c_cflag |= CLOCAL | CREAD;
+	tio.c_cflag &= ~( CSTOPB | CRTSCTS );
+	tio.c_cc[ VMIN ] = 0;
+	tio.c_cc[ VTIME ] = 0;
+	cfsetispeed( &tio, B38400 );
+	cfsetospeed( &tio, B38400 );
+
+	if ( tcsetattr( fd, TCSANOW, &tio ) != 0 ) {
+		return -1;
+	}
+
+	pPort->fd = fd;
+	pPort->in_len = 0;
+	pPort->in_pos = 0;
+	tlm_rx_init( &pPort->rx );
+
+	return 0;
+
+} // end tlm_port_attach()
+
+// -------------------------------------------------------------------------- //
+int tlm_port_open( TLM_PORT *pPort, const char *path )
+{
+
+	int fd = open( path, O_RDWR | O_NOCTTY );
+
+	if ( fd < 0 ) {
+		return -1;
+	}
+
+	if ( tlm_port_attach( pPort, fd ) != 0 ) {
+		close( fd );
+		return -1;
+	}
+
+	return 0;
+
+} // end tlm_port_open()
+
+// -------------------------------------------------------------------------- //
+void tlm_port_close( TLM_PORT *pPort )
+{
+
+	if ( pPort->fd >= 0 ) {
+		close( pPort->fd );
+	}
+	pPort->fd = -1;
+
+} // end tlm_port_close()
+
+// -------------------------------------------------------------------------- //
+int tlm_port_read( TLM_PORT *pPort, TLM_MSG *pMsg, int timeout_ms )
+{
+
+	// Returns 1 with the next good payload in 'pMsg', 0 if nothing good
+	// came in within 'timeout_ms', -1 on a read error.  Bad frames are
+	// counted in 'pPort->rx' and skipped.
+	struct pollfd pfd;
+	ssize_t n;
+	int rc;
+
+	for ( ;; ) {
+
+		while ( pPort->in_pos < pPort->in_len ) {
+			if ( tlm_rx_byte( &pPort->rx, pPort->in[ pPort->in_pos++ ], pMsg ) == 1 ) {
+				return 1;
+			}
+		}
+
+		pfd.fd = pPort->fd;
+		pfd.events = POLLIN;
+		rc = poll( &pfd, 1, timeout_ms );
+		if ( rc < 0 && errno == EINTR ) {
+			continue;
+		}
+		if ( rc < 0 ) {
+			return -1;
+		}
+		if ( rc == 0 ) {
+			return 0;
+		}
+
+		n = read( pPort->fd, pPort->in, sizeof( pPort->in ) );
+		if ( n < 0 && ( errno == EINTR || errno == EAGAIN ) ) {
+			continue;
+		}
+		if ( n <= 0 ) {
+			return -1;
+		}
+		pPort->in_len = ( size_t ) n;
+		pPort->in_pos = 0;
+
+	}
+
+} // end tlm_port_read()
+
+// -------------------------------------------------------------------------- //
+int tlm_port_send( TLM_PORT *pPort, const uint8_t *pData, size_t len )
+{
+
+	// Frames 'pData' and writes all of it.
+	uint8_t wire[ TLM_MAX_FRAME + TLM_MAX_FRAME / 254 + 2 ];
+	size_t n = tlm_frame_encode( pData, len, wire );
+	size_t done = 0;
+	ssize_t w;
+
+	while ( done < n ) {
+		w = write( pPort->fd, wire + done, n - done );
+		if ( w < 0 && errno == EINTR ) {
+			continue;
+		}
+		if ( w <= 0 ) {
+			return -1;
+		}
+		done += ( size_t ) w;
+	}
+
+	return 0;
+
+} // end tlm_port_send()
+
+// -------------------------------------------------------------------------- //
+int tlm_port_command( TLM_PORT *pPort, uint8_t op, uint8_t id, float value,
+					  TLM_REPLY *pReply, int reply_ms, int tries )
+{
+
+	// Sends a TUNE_CMD and waits for its reply, skipping telemetry.  The
+	// robot says nothing if its TX ring is full and answers a damaged
+	// command with TLM_ST_BAD_FRAME, so either way the command is sent
+	// again, up to 'tries' times.  Every op is safe to repeat.  Returns 1
+	// with the reply in 'pReply', 0 if none came, -1 on an I/O error.
+	uint8_t cmd[ TLM_CMD_LEN ];
+	size_t len = tlm_cmd_pack( op, id, value, cmd );
+	TLM_MSG msg;
+	long deadline;
+	long left;
+	int rc;
+
+	while ( tries-- > 0 ) {
+
+		if ( tlm_port_send( pPort, cmd, len ) != 0 ) {
+			return -1;
+		}
+
+		deadline = now_ms() + reply_ms;
+		while ( ( left = deadline - now_ms() ) > 0 ) {
+
+			rc = tlm_port_read( pPort, &msg, ( int ) left );
+			if ( rc < 0 ) {
+				return -1;
+			}
+			if ( rc == 0 ) {
+				break;
+			}
+
+			if ( msg.kind != TLM_KIND_REPLY ) {
+				continue;
+			}
+			if ( msg.reply.status == TLM_ST_BAD_FRAME ) {
+				break;
+			}
+			if ( msg.reply.op == op && msg.reply.id == id ) {
+				*pReply = msg.reply;
+				return 1;
+			}
+
+		}
+
+	}
+
+	return 0;
+
+} // end tlm_port_command()
@@ -0,0 +1,44 @@
+/* Auth: Megan Bird & Gary Miller
+ * File: tlm_port.h
+ * Course: CEEN-3450 - Mobile Robotics I - University of Nebraska-Lincoln
+ * Lab: Host tools (Linux)
+ * Date: 4/27/2017
+ * Desc: The robot's telemetry link on a Linux tty: raw 8N1 at TLM_BAUD,
+ *       read a frame at a time.  Works the same on a USB-serial adapter
+ *       or a pty standing in for one.
+ */
+
+#ifndef TLM_PORT_H
+#define TLM_PORT_H
+
+#include "tlm.h"
+
+// ---------------------- Defines:
+#define TLM_BAUD			38400	/* Must match TLM_BAUD in main.c. */
+#define TLM_REPLY_MS		250		/* Wait for a command reply before resending. */
+#define TLM_TRIES			4		/* Sends per command before giving up. */
+
+// ---------------------- Type Declarations:
+
+// Desc: An open link: the tty, the frame receiver, and bytes read off the
+//       tty that the receiver hasn't seen yet.
+typedef struct TLM_PORT_TYPE {
+
+	int fd;
+	TLM_RX rx;
+	uint8_t in[ 256 ];
+	size_t in_len;
+	size_t in_pos;
+
+} TLM_PORT;
+
+// ---------------------- Prototypes:
+int tlm_port_open( TLM_PORT *pPort, const char *path );
+int tlm_port_attach( TLM_PORT *pPort, int fd );
+void tlm_port_close( TLM_PORT *pPort );
+int tlm_port_read( TLM_PORT *pPort, TLM_MSG *pMsg, int timeout_ms );
+int tlm_port_send( TLM_PORT *pPort, const uint8_t *pData, size_t len );
+int tlm_port_command( TLM_PORT *pPort, uint8_t op, uint8_t id, float value,
+					  TLM_REPLY *pReply, int reply_ms, int tries );
+
+#endif /* TLM_PORT_H */
@@ -0,0 +1,565 @@
+/* Auth: Megan Bird & Gary Miller
+ * File: tlm_test.c
+ * Course: CEEN-3450 - Mobile Robotics I - University of Nebraska-Lincoln
+ * Lab: Host tools (Linux)
+ * Date: 4/27/2017
+ * Desc: Loopback test for the telemetry link.  A pty stands in for the
+ *       USB-serial adapter: the test writes encoded frames into the master
+ *       side, the way the robot would, and reads them back through
+ *       tlm_port_read() on the slave side.  Commands go the other way and
+ *       are checked on the master side.  The firmware's own command
+ *       parser (tune.c, built against mock/) is driven with the host's
+ *       frames too, once per image.  Run with 'make test'.
+ */
+
+#define _XOPEN_SOURCE 600
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "tlm_port.h"
+#include "tune.h"
+
+// ---------------------- Globals:
+static int failures = 0;
+
+#define CHECK( cond )	do { if ( !( cond ) ) { \
+							fprintf( stderr, "%s:%d: CHECK( %s ) failed\n", __FILE__, __LINE__, #cond ); \
+							failures++; } } while( 0 )
+
+// The firmware's EEPROM, for tune.c.
+static PARAMS saved;
+static int saves = 0;
+
+// ---------------------- Helpers:
+static uint8_t *put_u16( uint8_t *p, uint16_t v )
+{
+
+	*p++ = ( uint8_t ) v;
+	*p++ = ( uint8_t )( v >> 8 );
+	return p;
+
+} // end put_u16()
+
+// -------------------------------------------------------------------------- //
+static void put_float( uint8_t *p, float v )
+{
+
+	uint32_t bits;
+
+	memcpy( &bits, &v, sizeof( bits ) );
+	p = put_u16( p, ( uint16_t ) bits );
+	put_u16( p, ( uint16_t )( bits >> 16 ) );
+
+} // end put_float()
+
+// -------------------------------------------------------------------------- //
+static size_t pack_unified( uint8_t *out, uint8_t version, uint8_t seq )
+{
+
+	// A unified-image TLM_FRAME (version 5 or 6), packed the way the AVR
+	// lays it out.
+	uint8_t *p = out;
+
+	*p++ = version;
+	*p++ = seq;
+	p = put_u16( p, 0x5678 );  p = put_u16( p, 0x0012 );	// time_ms = 0x00125678
+	*p++ = 2;												// mode
+	*p++ = 3;												// state
+	p = put_u16( p, ( uint16_t ) -150 );
+	p = put_u16( p, 150 );
+	*p++ = 0x05;											// left IR + S3
+	p = put_u16( p, 2500 );
+	p = put_u16( p, 2600 );
+	p = put_u16( p, 0 );									// sonar_mm -- a zero byte pair for COBS
+	p = put_u16( p, 4100 );
+	p = put_u16( p, 900 );
+	p = put_u16( p, 321 );
+	*p++ = 0;												// dropped
+	p = put_u16( p, 412 );
+	p = put_u16( p, 180 );
+	p = put_u16( p, 950 );
+	p = put_u16( p, 1020 );
+	if ( version >= 6 ) {
+		*p++ = 3;											// mem_failed
+	}
+
+	return ( size_t )( p - out );
+
+} // end pack_unified()
+
+// -------------------------------------------------------------------------- //
+static size_t pack_v1( uint8_t *out, uint8_t seq )
+{
+
+	// A Lab 8 Part 2 TLM_FRAME.
+	uint8_t *p = out;
+
+	*p++ = 1;
+	*p++ = seq;
+	p = put_u16( p, 1000 );  p = put_u16( p, 0 );
+	*p++ = 4;
+	p = put_u16( p, 200 );
+	p = put_u16( p, 180 );
+	*p++ = 0x02;
+	p = put_u16( p, 0 );
+	p = put_u16( p, 0 );
+	p = put_u16( p, 355 );
+	p = put_u16( p, 1200 );
+	p = put_u16( p, 3300 );
+	p = put_u16( p, 40 );
+	*p++ = 1;
+
+	return ( size_t )( p - out );
+
+} // end pack_v1()
+
+// -------------------------------------------------------------------------- //
+static void send_raw( int fd, const uint8_t *p, size_t n )
+{
+
+	CHECK( write( fd, p, n ) == ( ssize_t ) n );
+
+} // end send_raw()
+
+// -------------------------------------------------------------------------- //
+static void send_frame( int fd, const uint8_t *pData, size_t len )
+{
+
+	uint8_t wire[ TLM_MAX_FRAME + 2 ];
+
+	send_raw( fd, wire, tlm_frame_encode( pData, len, wire ) );
+
+} // end send_frame()
+
+// -------------------------------------------------------------------------- //
+static void send_reply( int fd, uint8_t op, uint8_t id, uint8_t status, float value )
+{
+
+	uint8_t data[ TLM_REPLY_LEN ];
+
+	data[ 0 ] = TLM_REPLY_TAG;
+	data[ 1 ] = op;
+	data[ 2 ] = id;
+	data[ 3 ] = status;
+	put_float( &data[ 4 ], value );
+	send_frame( fd, data, TLM_REPLY_LEN );
+
+} // end send_reply()
+
+// -------------------------------------------------------------------------- //
+static long recv_cmd( int fd, uint8_t *pPlain )
+{
+
+	// Reads one framed command off the master side, returns its decoded
+	// length (payload + CRC) or -1.
+	uint8_t wire[ TLM_MAX_FRAME + 2 ];
+	size_t n = 0;
+
+	while ( n < sizeof( wire ) && read( fd, &wire[ n ], 1 ) == 1 ) {
+		if ( wire[ n++ ] == 0x00 ) {
+			return tlm_cobs_decode( wire, n - 1, pPlain );
+		}
+	}
+
+	return -1;
+
+} // end recv_cmd()
+
+// -------------------------------------------------------------------------- //
+static int fw_frame( const uint8_t *pPlain, size_t len, TLM_REPLY *pReply )
+{
+
+	// Hands a payload + CRC to the firmware the way its RX interrupt does
+	// (COBS, no delimiter) and unpacks the reply the way the host does.
+	uint8_t wire[ TLM_MAX_FRAME + 2 ];
+	TUNE_REPLY reply;
+	TLM_MSG msg;
+	size_t n;
+
+	n = tlm_cobs_encode( pPlain, len, wire );
+	tune_handle( wire, ( unsigned char ) n, &reply );
+
+	if ( tlm_unpack( ( const uint8_t * ) &reply, sizeof( reply ), &msg ) != 0 ||
+		 msg.kind != TLM_KIND_REPLY ) {
+		return -1;
+	}
+	*pReply = msg.reply;
+	return 0;
+
+} // end fw_frame()
+
+// -------------------------------------------------------------------------- //
+static int fw_command( uint8_t op, uint8_t id, float value, TLM_REPLY *pReply )
+{
+
+	uint8_t plain[ TLM_CMD_LEN + 2 ];
+	size_t n = tlm_cmd_pack( op, id, value, plain );
+	uint16_t crc = tlm_crc( plain, n );
+
+	plain[ n++ ] = ( uint8_t ) crc;
+	plain[ n++ ] = ( uint8_t )( crc >> 8 );
+	return fw_frame( plain, n, pReply );
+
+} // end fw_command()
+
+// -------------------------------------------------------------------------- //
+void params_save( void )
+{
+
+	saved = params;
+	saves++;
+
+} // end params_save()
+
+// -------------------------------------------------------------------------- //
+void params_load( void )
+{
+
+	params = saved;
+
+} // end params_load()
+
+// ---------------------- Tests:
+static void test_crc( void )
+{
+
+	// CRC-16/MCRF4XX check value, i.e. what _crc_ccitt_update() from 0xFFFF
+	// gives over "123456789".
+	CHECK( tlm_crc( ( const uint8_t * ) "123456789", 9 ) == 0x6F91 );
+
+} // end test_crc()
+
+// -------------------------------------------------------------------------- //
+static void test_cobs( void )
+{
+
+	static const uint8_t plain[] = { 0x11, 0x22, 0x00, 0x33 };
+	static const uint8_t coded[] = { 0x03, 0x11, 0x22, 0x02, 0x33 };
+	uint8_t src[ 600 ];
+	uint8_t enc[ 610 ];
+	uint8_t dec[ 610 ];
+	size_t sizes[] = { 1, 2, 253, 254, 255, 300, 508, 509 };
+	size_t i;
+	size_t k;
+	size_t n;
+	long m;
+
+	n = tlm_cobs_encode( plain, sizeof( plain ), enc );
+	CHECK( n == sizeof( coded ) && memcmp( enc, coded, n ) == 0 );
+	CHECK( tlm_cobs_decode( coded, sizeof( coded ), dec ) == sizeof( plain ) );
+	CHECK( memcmp( dec, plain, sizeof( plain ) ) == 0 );
+
+	// Runs with no zeros at all, including across the 254-byte group limit,
+	// and runs that are mostly zeros.
+	for ( k = 0; k < sizeof( sizes ) / sizeof( sizes[ 0 ] ); k++ ) {
+		for ( i = 0; i < sizes[ k ]; i++ ) {
+			src[ i ] = ( uint8_t )( 1 + i % 255 );
+		}
+		n = tlm_cobs_encode( src, sizes[ k ], enc );
+		CHECK( memchr( enc, 0, n ) == NULL );
+		m = tlm_cobs_decode( enc, n, dec );
+		CHECK( m == ( long ) sizes[ k ] && memcmp( dec, src, sizes[ k ] ) == 0 );
+
+		memset( src, 0, sizes[ k ] );
+		n = tlm_cobs_encode( src, sizes[ k ], enc );
+		m = tlm_cobs_decode( enc, n, dec );
+		CHECK( m == ( long ) sizes[ k ] && memcmp( dec, src, sizes[ k ] ) == 0 );
+	}
+
+	// A code byte that runs past the end is rejected.
+	enc[ 0 ] = 0x05;  enc[ 1 ] = 0x11;
+	CHECK( tlm_cobs_decode( enc, 2, dec ) == -1 );
+
+} // end test_cobs()
+
+// -------------------------------------------------------------------------- //
+static void test_loopback( void )
+{
+
+	TLM_PORT port;
+	TLM_MSG msg;
+	uint8_t data[ TLM_MAX_FRAME ];
+	uint8_t wire[ TLM_MAX_FRAME + 2 ];
+	uint8_t plain[ TLM_MAX_FRAME ];
+	size_t len;
+	size_t n;
+	long m;
+	int master;
+	int slave;
+
+	master = posix_openpt( O_RDWR | O_NOCTTY );
+	CHECK( master >= 0 );
+	if ( master < 0 ) {
+		return;
+	}
+	CHECK( grantpt( master ) == 0 && unlockpt( master ) == 0 );
+	slave = open( ptsname( master ), O_RDWR | O_NOCTTY );
+	CHECK( slave >= 0 );
+	if ( slave < 0 || tlm_port_attach( &port, slave ) != 0 ) {
+		CHECK( 0 );
+		close( master );
+		return;
+	}
+
+	// A unified-image frame comes through field for field.
+	len = pack_unified( data, 6, 10 );
+	CHECK( len == TLM_V6_LEN );
+	send_frame( master, data, len );
+	CHECK( tlm_port_read( &port, &msg, 1000 ) == 1 );
+	CHECK( msg.kind == TLM_KIND_FRAME );
+	CHECK( msg.frame.version == 6 && msg.frame.seq == 10 );
+	CHECK( msg.frame.time_ms == 0x00125678 );
+	CHECK( msg.frame.mode == 2 && msg.frame.state == 3 );
+	CHECK( msg.frame.speed_L == -150 && msg.frame.speed_R == 150 );
+	CHECK( msg.frame.ir == 0x05 );
+	CHECK( msg.frame.left_photo_mv == 2500 && msg.frame.right_photo_mv == 2600 );
+	CHECK( msg.frame.sonar_mm == 0 );
+	CHECK( msg.frame.left_line_mv == 4100 && msg.frame.right_line_mv == 900 );
+	CHECK( msg.frame.loops == 321 && msg.frame.dropped == 0 );
+	CHECK( msg.frame.boot_ms == 412 && msg.frame.stack_max == 180 );
+	CHECK( msg.frame.ram_free_min == 950 && msg.frame.ram_gap == 1020 );
+	CHECK( msg.frame.mem_failed == 3 );
+
+	// A frame with a corrupted CRC is dropped and counted, and the next
+	// good frame still comes through.
+	len = pack_unified( data, 6, 11 );
+	n = tlm_frame_encode( data, len, wire );
+	wire[ n - 2 ] ^= 0x40;					// Last CRC byte, still non-zero.
+	send_raw( master, wire, n );
+	len = pack_unified( data, 6, 12 );
+	send_frame( master, data, len );
+	CHECK( tlm_port_read( &port, &msg, 1000 ) == 1 );
+	CHECK( msg.kind == TLM_KIND_FRAME && msg.frame.seq == 12 );
+	CHECK( port.rx.bad_crc == 1 );
+	CHECK( port.rx.lost == 1 );				// seq 11 never arrived.
+
+	// Line noise: broken COBS and a burst longer than any frame, each
+	// ended by a 0x00.  Then a Lab 8 Part 2 frame.
+	memset( wire, 0x7E, sizeof( wire ) );
+	wire[ 0 ] = 0x09;
+	wire[ 3 ] = 0x00;
+	send_raw( master, wire, 4 );
+	memset( wire, 0x55, sizeof( wire ) );
+	send_raw( master, wire, sizeof( wire ) );
+	send_raw( master, ( const uint8_t * ) "\0", 1 );
+	len = pack_v1( data, 13 );
+	CHECK( len == TLM_V1_LEN );
+	send_frame( master, data, len );
+	CHECK( tlm_port_read( &port, &msg, 1000 ) == 1 );
+	CHECK( msg.kind == TLM_KIND_FRAME && msg.frame.version == 1 );
+	CHECK( msg.frame.seq == 13 && msg.frame.time_ms == 1000 );
+	CHECK( msg.frame.state == 4 && msg.frame.speed_L == 200 && msg.frame.speed_R == 180 );
+	CHECK( msg.frame.sonar_mm == 355 && msg.frame.loops == 40 && msg.frame.dropped == 1 );
+	CHECK( port.rx.bad_cobs == 2 );
+
+	// A unified image from before 'mem_failed' still decodes.
+	len = pack_unified( data, 5, 14 );
+	CHECK( len == TLM_V5_LEN );
+	send_frame( master, data, len );
+	CHECK( tlm_port_read( &port, &msg, 1000 ) == 1 );
+	CHECK( msg.kind == TLM_KIND_FRAME && msg.frame.version == 5 && msg.frame.seq == 14 );
+	CHECK( msg.frame.ram_gap == 1020 && msg.frame.mem_failed == 0 );
+
+	// A command reply.
+	data[ 0 ] = TLM_REPLY_TAG;
+	data[ 1 ] = 2;
+	data[ 2 ] = 7;
+	data[ 3 ] = 0;
+	put_float( &data[ 4 ], 1.25f );
+	send_frame( master, data, TLM_REPLY_LEN );
+	CHECK( tlm_port_read( &port, &msg, 1000 ) == 1 );
+	CHECK( msg.kind == TLM_KIND_REPLY );
+	CHECK( msg.reply.op == 2 && msg.reply.id == 7 && msg.reply.status == 0 );
+	CHECK( msg.reply.value == 1.25f );
+
+	// A good CRC around a layout we don't know is passed up as unknown.
+	data[ 0 ] = 9;
+	send_frame( master, data, 5 );
+	CHECK( tlm_port_read( &port, &msg, 1000 ) == 1 );
+	CHECK( msg.kind == TLM_KIND_UNKNOWN && msg.raw_len == 5 );
+
+	// Nothing more on the line.
+	CHECK( tlm_port_read( &port, &msg, 50 ) == 0 );
+	CHECK( port.rx.good == 6 );
+
+	// The host's own commands are framed the same way.
+	n = tlm_cmd_pack( 1, 3, 0.0f, data );
+	CHECK( tlm_port_send( &port, data, n ) == 0 );
+	m = recv_cmd( master, plain );
+	CHECK( m == TLM_CMD_LEN + 2 );
+	CHECK( tlm_crc( plain, ( size_t ) m ) == 0 );
+	CHECK( plain[ 0 ] == 1 && plain[ 1 ] == 3 );
+
+	tlm_port_close( &port );
+	close( master );
+
+} // end test_loopback()
+
+// -------------------------------------------------------------------------- //
+static void test_command( void )
+{
+
+	TLM_PORT port;
+	TLM_REPLY reply;
+	uint8_t data[ TLM_MAX_FRAME ];
+	uint8_t plain[ TLM_MAX_FRAME ];
+	float value;
+	int master;
+	int slave;
+
+	master = posix_openpt( O_RDWR | O_NOCTTY );
+	CHECK( master >= 0 );
+	if ( master < 0 ) {
+		return;
+	}
+	CHECK( grantpt( master ) == 0 && unlockpt( master ) == 0 );
+	slave = open( ptsname( master ), O_RDWR | O_NOCTTY );
+	if ( slave < 0 || tlm_port_attach( &port, slave ) != 0 ) {
+		CHECK( 0 );
+		close( master );
+		return;
+	}
+
+	// Names and numbers both work; the names follow PARAM_ID.
+	CHECK( tlm_param_id( "line_ms" ) == 11 && tlm_param_id( "sonar_ms" ) == 12 );
+	CHECK( tlm_param_id( "7" ) == 7 );
+	CHECK( tlm_param_id( "nope" ) == -1 && tlm_param_id( "" ) == -1 );
+
+	// SET line_ms: the reply is already waiting behind a telemetry frame,
+	// which gets skipped.
+	send_frame( master, data, pack_unified( data, 6, 20 ) );
+	send_reply( master, TLM_OP_SET, 11, TLM_ST_OK, 20.0f );
+	CHECK( tlm_port_command( &port, TLM_OP_SET, 11, 20.0f, &reply, 200, 3 ) == 1 );
+	CHECK( reply.op == TLM_OP_SET && reply.id == 11 );
+	CHECK( reply.status == TLM_ST_OK && reply.value == 20.0f );
+	CHECK( recv_cmd( master, plain ) == TLM_CMD_LEN + 2 );
+	memcpy( &value, &plain[ 2 ], sizeof( value ) );
+	CHECK( plain[ 0 ] == TLM_OP_SET && plain[ 1 ] == 11 && value == 20.0f );
+
+	// The robot didn't make out the first send -- the command goes again.
+	send_reply( master, 0, 0, TLM_ST_BAD_FRAME, 0.0f );
+	send_reply( master, TLM_OP_GET, 12, TLM_ST_OK, 125.0f );
+	CHECK( tlm_port_command( &port, TLM_OP_GET, 12, 0.0f, &reply, 200, 3 ) == 1 );
+	CHECK( reply.value == 125.0f );
+	CHECK( recv_cmd( master, plain ) == TLM_CMD_LEN + 2 );
+	CHECK( recv_cmd( master, plain ) == TLM_CMD_LEN + 2 );
+	CHECK( plain[ 0 ] == TLM_OP_GET && plain[ 1 ] == 12 );
+
+	// An out-of-range SET still gets its reply, with the status.
+	send_reply( master, TLM_OP_SET, 11, TLM_ST_RANGE, 20.0f );
+	CHECK( tlm_port_command( &port, TLM_OP_SET, 11, 5000.0f, &reply, 200, 1 ) == 1 );
+	CHECK( reply.status == TLM_ST_RANGE && reply.value == 20.0f );
+	CHECK( recv_cmd( master, plain ) == TLM_CMD_LEN + 2 );
+
+	// No robot at all: every try goes out, then it gives up.
+	CHECK( tlm_port_command( &port, TLM_OP_SAVE, 0, 0.0f, &reply, 50, 2 ) == 0 );
+	CHECK( recv_cmd( master, plain ) == TLM_CMD_LEN + 2 && plain[ 0 ] == TLM_OP_SAVE );
+	CHECK( recv_cmd( master, plain ) == TLM_CMD_LEN + 2 && plain[ 0 ] == TLM_OP_SAVE );
+
+	tlm_port_close( &port );
+	close( master );
+
+} // end test_command()
+
+// -------------------------------------------------------------------------- //
+static void test_firmware( void )
+{
+
+	TLM_REPLY reply;
+	uint8_t plain[ TLM_CMD_LEN + 2 ];
+	uint8_t wire[ TLM_MAX_FRAME + 2 ];
+	TUNE_REPLY fw;
+	size_t n;
+	int i;
+
+	// Both ends agree on the layouts and the codes.
+	CHECK( sizeof( TUNE_CMD ) == TLM_CMD_LEN && sizeof( TUNE_REPLY ) == TLM_REPLY_LEN );
+	CHECK( TUNE_REPLY_TAG == TLM_REPLY_TAG );
+	CHECK( ( int ) TUNE_GET == TLM_OP_GET && ( int ) TUNE_LOAD == TLM_OP_LOAD );
+	CHECK( ( int ) TUNE_BAD_FRAME == TLM_ST_BAD_FRAME && ( int ) TUNE_RANGE == TLM_ST_RANGE );
+	for ( i = 0; i < PARAM_COUNT; i++ ) {
+		CHECK( tlm_param_name( i ) != NULL );
+	}
+	CHECK( tlm_param_id( "line_ms" ) == PARAM_LINE_MS && tlm_param_id( "wall_kp" ) == PARAM_WALL_KP );
+
+	memset( &params, 0, sizeof( params ) );
+
+	// SET rounds a whole-number parameter, GET reads it back.
+	CHECK( fw_command( TLM_OP_SET, PARAM_LINE_MS, 19.6f, &reply ) == 0 );
+	CHECK( reply.op == TLM_OP_SET && reply.id == PARAM_LINE_MS );
+	CHECK( reply.status == TLM_ST_OK && reply.value == 20.0f );
+	CHECK( params.line_sense_ms == 20 );
+	CHECK( fw_command( TLM_OP_SET, PARAM_WALL_KP, 2.5f, &reply ) == 0 );
+	CHECK( reply.status == TLM_ST_OK && params.wall_gains.kp == 2.5f );
+	CHECK( fw_command( TLM_OP_GET, PARAM_WALL_KP, 0.0f, &reply ) == 0 );
+	CHECK( reply.status == TLM_ST_OK && reply.value == 2.5f );
+
+	// Out of range either way, and NaN, change nothing and say so.
+	CHECK( fw_command( TLM_OP_SET, PARAM_LINE_MS, 5000.0f, &reply ) == 0 );
+	CHECK( reply.status == TLM_ST_RANGE && reply.value == 20.0f );
+	CHECK( fw_command( TLM_OP_SET, PARAM_LINE_MS, -1.0f, &reply ) == 0 );
+	CHECK( reply.status == TLM_ST_RANGE && params.line_sense_ms == 20 );
+	CHECK( fw_command( TLM_OP_SET, PARAM_WALL_KP, NAN, &reply ) == 0 );
+	CHECK( reply.status == TLM_ST_RANGE && reply.value == 2.5f );
+	CHECK( params.wall_gains.kp == 2.5f );
+	CHECK( fw_command( TLM_OP_SET, PARAM_LINE_MS, NAN, &reply ) == 0 );
+	CHECK( reply.status == TLM_ST_RANGE && params.line_sense_ms == 20 );
+
+	// Ids past the table, and unknown ops.
+	CHECK( fw_command( TLM_OP_GET, PARAM_COUNT, 0.0f, &reply ) == 0 );
+	CHECK( reply.status == TLM_ST_BAD_ID && reply.id == PARAM_COUNT && reply.value == 0.0f );
+	CHECK( fw_command( TLM_OP_SET, 0xFF, 20.0f, &reply ) == 0 );
+	CHECK( reply.status == TLM_ST_BAD_ID );
+	CHECK( fw_command( 9, PARAM_LINE_MS, 0.0f, &reply ) == 0 );
+	CHECK( reply.op == 9 && reply.status == TLM_ST_BAD_OP );
+
+	// A bad CRC, a short frame, broken COBS and an overlong frame are all
+	// TLM_ST_BAD_FRAME with op and id 0, and change nothing.
+	n = tlm_cmd_pack( TLM_OP_SET, PARAM_LINE_MS, 30.0f, plain );
+	plain[ n ] = ( uint8_t ) tlm_crc( plain, n );
+	plain[ n + 1 ] = ( uint8_t )( tlm_crc( plain, n ) >> 8 ) ^ 0x01;
+	CHECK( fw_frame( plain, n + 2, &reply ) == 0 );
+	CHECK( reply.status == TLM_ST_BAD_FRAME && reply.op == 0 && reply.id == 0 );
+	CHECK( fw_frame( plain, n, &reply ) == 0 && reply.status == TLM_ST_BAD_FRAME );
+	CHECK( params.line_sense_ms == 20 );
+
+	wire[ 0 ] = 0x09;  wire[ 1 ] = TLM_OP_GET;  wire[ 2 ] = PARAM_LINE_MS;
+	tune_handle( wire, 3, &fw );
+	CHECK( fw.tag == TUNE_REPLY_TAG && fw.status == TUNE_BAD_FRAME );
+	memset( wire, 0x01, sizeof( wire ) );
+	tune_handle( wire, sizeof( wire ), &fw );
+	CHECK( fw.status == TUNE_BAD_FRAME );
+
+	// SAVE keeps what's set, LOAD throws away what came after.
+	CHECK( fw_command( TLM_OP_SAVE, 0, 0.0f, &reply ) == 0 );
+	CHECK( reply.status == TLM_ST_OK && saves == 1 );
+	CHECK( fw_command( TLM_OP_SET, PARAM_LINE_MS, 50.0f, &reply ) == 0 && params.line_sense_ms == 50 );
+	CHECK( fw_command( TLM_OP_LOAD, 0, 0.0f, &reply ) == 0 );
+	CHECK( reply.status == TLM_ST_OK && params.line_sense_ms == 20 );
+
+} // end test_firmware()
+
+// -------------------------------------------------------------------------- //
+int main( int argc, char **argv )
+{
+
+	( void ) argc;
+
+	test_crc();
+	test_cobs();
+	test_loopback();
+	test_command();
+	test_firmware();
+
+	if ( failures ) {
+		fprintf( stderr, "%s: %d check(s) failed\n", argv[ 0 ], failures );
+		return 1;
+	}
+
+	printf( "%s: all checks passed\n", argv[ 0 ] );
+	return 0;
+
+} // end main()
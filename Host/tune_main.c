@@ -0,0 +1,122 @@
+/* Auth: Megan Bird & Gary Miller
+ * File: tune_main.c
+ * Course: CEEN-3450 - Mobile Robotics I - University of Nebraska-Lincoln
+ * Lab: Host tools (Linux)
+ * Date: 4/27/2017
+ * Desc: Live tuning from the command line.
+ *
+ *           tune <tty> get <param>
+ *           tune <tty> set <param> <value>
+ *           tune <tty> save
+ *           tune <tty> load
+ *           tune list
+ *
+ *       <param> is a name from 'tune list' or a PARAM_ID number.  SET
+ *       only changes the robot's RAM copy and takes effect on its next
+ *       loop pass; SAVE writes it to EEPROM, LOAD throws it away.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tlm_port.h"
+
+// ---------------------- Functions:
+static int usage( const char *prog )
+{
+
+	fprintf( stderr,
+			 "usage: %s <tty> get <param>\n"
+			 "       %s <tty> set <param> <value>\n"
+			 "       %s <tty> save | load\n"
+			 "       %s list\n", prog, prog, prog, prog );
+	return 2;
+
+} // end usage()
+
+// -------------------------------------------------------------------------- //
+int main( int argc, char **argv )
+{
+
+	TLM_PORT port;
+	TLM_REPLY reply;
+	const char *name;
+	char *end;
+	uint8_t op;
+	int id = 0;
+	float value = 0.0f;
+	int rc;
+	int i;
+
+	if ( argc == 2 && strcmp( argv[ 1 ], "list" ) == 0 ) {
+		for ( i = 0; ( name = tlm_param_name( i ) ) != NULL; i++ ) {
+			printf( "%2d %s\n", i, name );
+		}
+		return 0;
+	}
+
+	if ( argc < 3 ) {
+		return usage( argv[ 0 ] );
+	}
+
+	if ( strcmp( argv[ 2 ], "get" ) == 0 && argc == 4 ) {
+		op = TLM_OP_GET;
+	}
+	else if ( strcmp( argv[ 2 ], "set" ) == 0 && argc == 5 ) {
+		op = TLM_OP_SET;
+		value = strtof( argv[ 4 ], &end );
+		if ( *argv[ 4 ] == '\0' || *end != '\0' ) {
+			fprintf( stderr, "%s: not a number\n", argv[ 4 ] );
+			return 2;
+		}
+	}
+	else if ( strcmp( argv[ 2 ], "save" ) == 0 && argc == 3 ) {
+		op = TLM_OP_SAVE;
+	}
+	else if ( strcmp( argv[ 2 ], "load" ) == 0 && argc == 3 ) {
+		op = TLM_OP_LOAD;
+	}
+	else {
+		return usage( argv[ 0 ] );
+	}
+
+	if ( op == TLM_OP_GET || op == TLM_OP_SET ) {
+		id = tlm_param_id( argv[ 3 ] );
+		if ( id < 0 ) {
+			fprintf( stderr, "%s: no such parameter (see '%s list')\n", argv[ 3 ], argv[ 0 ] );
+			return 2;
+		}
+	}
+
+	if ( tlm_port_open( &port, argv[ 1 ] ) != 0 ) {
+		perror( argv[ 1 ] );
+		return 1;
+	}
+
+	rc = tlm_port_command( &port, op, ( uint8_t ) id, value, &reply, TLM_REPLY_MS, TLM_TRIES );
+	tlm_port_close( &port );
+
+	if ( rc < 0 ) {
+		perror( argv[ 1 ] );
+		return 1;
+	}
+	if ( rc == 0 ) {
+		fprintf( stderr, "no reply from the robot\n" );
+		return 1;
+	}
+
+	if ( op == TLM_OP_GET || op == TLM_OP_SET ) {
+		name = tlm_param_name( id );
+		printf( "%s = %g", name ? name : argv[ 3 ], reply.value );
+	}
+	else {
+		printf( "%s", argv[ 2 ] );
+	}
+	if ( reply.status != TLM_ST_OK ) {
+		printf( " (%s)", tlm_status_name( reply.status ) );
+	}
+	printf( "\n" );
+
+	return ( reply.status == TLM_ST_OK ) ? 0 : 1;
+
+} // end main()
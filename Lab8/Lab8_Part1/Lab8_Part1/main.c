@@ -371,13 +371,15 @@ void Sonar_sense( volatile SENSOR_DATA *pSensors, TIMER16 interval_ms )
 		if( TIMER_ALARM( sense_timer ) )
 		{					
 			float distance_cm;
+			unsigned short distance_mm;
 
 			distance_cm = USONIC_DIST_CM( USONIC_ping() );
+			distance_mm = ( unsigned short )( distance_cm * 10 );
 
 			pSensors->sonar_dist = distance_cm;
 
 			LCD_clear();    //Good for sensor setup, but we want LCD to display the behavior
-			LCD_printf( "Dist = %.3f\n", distance_cm);
+			LCD_printf( "Dist = %u.%u\n", distance_mm / 10, distance_mm % 10 );
 					
 			// Snooze the alarm so it can trigger again.
 			TIMER_SNOOZE(sense_timer);
@@ -48,10 +48,103 @@
 //
 
 #include "capi324v221.h"
+#include "tune.h"
+#include <math.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <avr/eeprom.h>
+#include <avr/pgmspace.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/crc16.h>
 
 // ---------------------- Defines:
 
-#define DEG_90  135     /* Number of steps for a 90-degree (in place) turn. */
+// Tunables.  These read the RAM copy of the EEPROM parameter block (see
+// PARAMS), so they can be changed without a rebuild.  The *_DEF values are
+// the compiled-in defaults used when EEPROM holds nothing valid.
+#define DEG_90				( params.deg_90 )			/* Number of steps for a 90-degree (in place) turn. */
+#define LINE_BASE_SPEED		( params.line_base_speed )	/* Fixed line following speed (also used on the learning lap). */
+#define WALL_BASE_SPEED		( params.wall_base_speed )	/* Wall following speed. */
+#define WALL_GOAL_PERP		( params.wall_goal_perp )	/* Perpendicular distance to hold from the wall, cm. */
+
+#define DEG_90_DEF			135
+#define LINE_BASE_SPEED_DEF	150
+#define WALL_BASE_SPEED_DEF	150
+#define SONAR_TRIGGER_DEF	85		/* Sonar_Avoid() steers away from anything closer than this, cm. */
+#define WALL_GOAL_PERP_DEF	( 25.4 + 10.00 )	/* 10 in to the wall plus the sensor-to-center offset. */
+#define LINE_THRESH_DEF		1.5		/* Both line sensors below this means we're on the line, V. */
+#define EXIT_THRESH_DEF		3.0		/* Both line sensors above this means the line is gone, V. */
+
+#define PARAMS_MAGIC		0x5A17	/* Marks a parameter block in EEPROM. */
+#define PARAMS_VERSION		2		/* Bumped whenever PARAMS changes layout. */
+
+#define SEARCH_SPEED		150		/* Outer-wheel speed while searching for a lost line. */
+#define SEARCH_INNER_START	0		/* Inner-wheel speed when the search starts (tight arc). */
+#define SEARCH_INNER_STEP	2		/* Inner-wheel speed added every search tick (arc opens up). */
+#define SEARCH_TICK_MS		50		/* How often the search arc is widened. */
+#define SEARCH_TIMEOUT_MS	3000	/* Give up and let Cruise() take over after this long. */
+
+#define GAIN_POINTS			4		/* Number of points in each gain schedule. */
+
+#define LINE_SENSE_MS		( params.line_sense_ms )	/* Line sensor sample period. */
+#define SONAR_SENSE_MS		( params.sonar_sense_ms )	/* Sonar sample period. */
+#define LINE_SENSE_MS_DEF	10
+#define SONAR_SENSE_MS_DEF	125
+
+// WALL_GOAL_DIST is WALL_GOAL_PERP measured along the sonar beam, which looks
+// at the wall at 45 degrees.
+#define WALL_GOAL_DIST		( WALL_GOAL_PERP * 1.41 )
+
+#define CM_PER_STEP			0.16	/* Wheel travel per step, in cm. */
+#define WHEEL_BASE_CM		( 4 * DEG_90 * CM_PER_STEP / M_PI )	/* From the in-place 90-degree turn. */
+
+#define SONAR_ANGLE			( M_PI / 4 )	/* Sonar beam angle off the heading, toward the wall. */
+#define WALL_BASELINE_CM	3.0		/* Min travel between the two ranges used for the wall angle. */
+#define WALL_ANGLE_FILTER	0.5		/* Weight given to each new wall angle estimate. */
+#define WALL_ZETA			0.8		/* Damping ratio the wall controller is set up for. */
+
+#define CORNER_JUMP_CM		40.0	/* Jump in range that means the wall just ended. */
+#define CORNER_GONE_READS	2		/* Wall-gone readings in a row that start a corner. */
+#define CORNER_MAX_ARC		M_PI	/* Give up on finding the wall again after this much arc. */
+#define CORNER_SETTLE_CM	10.0	/* Range within this of the goal counts as 'wall found'. */
+#define CORNER_SETTLE_READS	2		/* Readings in a row that must be settled to resume. */
+
+#define TUNE_RELAY_LINE		40		/* Relay turn amplitude when tuning line following. */
+#define TUNE_RELAY_WALL		40		/* Relay turn amplitude when tuning wall following. */
+#define TUNE_HYST_LINE		0.1		/* Relay hysteresis for the line, in volts. */
+#define TUNE_HYST_WALL		2.0		/* Relay hysteresis for the wall, in cm. */
+#define TUNE_SKIP_CYCLES	2		/* Oscillation cycles to let settle before measuring. */
+#define TUNE_CYCLES			4		/* Oscillation cycles averaged for Ku and Tu. */
+#define TUNE_TIMEOUT_MS		20000	/* Give up if the relay hasn't produced a result by now. */
+
+#define LCD_ROWS			4		/* LCD size, in characters. */
+#define LCD_COLS			20
+#define LCD_FLUSH_MS		5		/* How often the LCD framebuffer is flushed. */
+#define LCD_FLUSH_BYTES		4		/* Max characters sent to the LCD per flush. */
+
+#define FMT_BUF_LEN			16		/* Big enough for any fmt_*() result: sign, 10 digits, point, decimals. */
+#define SONAR_FRAC_BITS		8		/* Sonar distance is shown as Q8 (1/256 cm). */
+
+#define ODOM_INTERVAL_MS	20		/* Odometry tick -- wheel speeds are ramped and integrated in steps this long. */
+
+#define TLM_BAUD			38400	/* Telemetry UART (USART0) baud rate. */
+#define TLM_UBRR			( ( F_CPU / ( 8UL * TLM_BAUD ) ) - 1 )	/* Double-speed mode: 0.2% error at 20 MHz. */
+#define TLM_PERIOD_MS		100		/* How often a telemetry frame is sent. */
+#define TLM_TX_LEN			64		/* UART TX ring size (at most 256). */
+#define TLM_VERSION			1		/* Bumped whenever TLM_FRAME changes -- update Host/tlm.c to match. */
+
+
+#define COURSE_BIN_STEPS	128		/* Distance covered by one course profile bin, in steps. */
+#define COURSE_BINS			64		/* Max bins per lap -- anything longer piles into the last bin. */
+#define COURSE_LAP_TURN		( 8 * DEG_90 )	/* Right-minus-left steps for one full 360-degree turn. */
+#define COURSE_LOOKAHEAD	2		/* Bins to look ahead when picking a speed. */
+#define COURSE_ERR_SCALE	50		/* Profile units per volt of line error. */
+#define COURSE_STRAIGHT_ERR	25		/* Peak error (profile units) still treated as a straight. */
+#define COURSE_CURVE_ERR	75		/* Peak error at or above this is treated as a full curve. */
+#define COURSE_FAST_SPEED	230		/* Speed on known straights. */
+#define COURSE_SLOW_SPEED	130		/* Speed going into known curves. */
 
 
 // Desc: This macro-function can be used to reset a motor-action structure
@@ -96,7 +189,9 @@ typedef enum ROBOT_STATE_TYPE {
 	IR_AVOIDING,    // 'IR Avoiding' state -- the robot is avoiding a collision using IR.
 	SONAR_AVOIDING,	// 'Sonar Avoiding' state -- the robot is avoiding a collision using sonar.
 	WALL_FOLLOWING,	// 'Wall Following' state -- the bot is following the wall at a desired distance.
-	LINE_FOLLOWING	// 'Line Following" state -- the bot is following the white line on the floor.		
+	LINE_FOLLOWING,	// 'Line Following" state -- the bot is following the white line on the floor.		
+	LINE_SEARCHING,	// 'Line Searching' state -- the bot lost the line and is sweeping to find it again.
+	AUTO_TUNING		// 'Auto Tuning' state -- relay experiment to find the PD gains.
 } ROBOT_STATE;
 
 
@@ -133,6 +228,7 @@ typedef struct SENSOR_DATA_TYPE {
 	float right_photo_ambient;	// Holds the initial ambient value of the left photo-sensor
 
 	float sonar_dist;	// Holds the value for the sonar distance, in centimeters
+	unsigned char sonar_seq;	// Bumped on every new sonar reading.
 	
 	float left_line_voltage;	// Holds the value of the left line following sensor.
 	float right_line_voltage;	// Holds the value of the right line following sensor.
@@ -141,6 +237,236 @@ typedef struct SENSOR_DATA_TYPE {
 
 typedef enum { false, true} bool;
 
+// Desc: Structure shared between 'Line_Follow()' and 'Line_Search()'.  Line_Follow()
+//       records whether it has the line and which way it was last steering, so that
+//       Line_Search() knows which way to sweep once the line is lost.
+typedef struct LINE_TRACK_TYPE {
+
+	bool following;				// TRUE while the line is under the sensors.
+	bool lost;					// TRUE once the line was followed and then lost (search pending).
+	signed char last_dir;		// Sign of the last line error: +1 = line was to the right, -1 = left.
+	unsigned short search_ticks;	// Number of SEARCH_TICK_MS ticks spent in the current search.
+	unsigned short reacquire_ms;	// How long the last successful search took, in ms.
+	unsigned char err_mag;		// Magnitude of the last line error, in COURSE_ERR_SCALE units.
+
+} LINE_TRACK;
+
+// Desc: Dead-reckoned wheel travel, from what the wheels were last told: free-running
+//       speeds are ramped at their acceleration the way the stepper driver does it,
+//       and step moves add their exact step counts.  It's a model -- a stalled or
+//       slipping wheel isn't seen.  Units are milli-steps (steps/sec * ms) so nothing
+//       is lost to rounding between updates.
+typedef struct ODOMETRY_TYPE {
+
+	signed long left_msteps;	// Total LEFT  wheel travel, in milli-steps.
+	signed long right_msteps;	// Total RIGHT wheel travel, in milli-steps.
+	unsigned long time_ms;		// Time the odometry has been running.
+	signed long rate_L;			// Modelled LEFT  wheel speed, milli-steps/sec.
+	signed long rate_R;			// Modelled RIGHT wheel speed, milli-steps/sec.
+	signed short target_L;		// Speeds the wheels were last told, steps/sec.
+	signed short target_R;
+	unsigned short accel_L;		// ... and the ramps to get there, steps/sec^2.
+	unsigned short accel_R;
+	unsigned char tick_ms;		// Period of the timer callback.
+	unsigned short ticks;		// Callback ticks not integrated yet.
+
+} ODOMETRY;
+
+// Desc: Distance travelled (steps) and heading (right-minus-left steps) from odometry.
+#define ODOM_DIST( odom )		( ( ( odom ).left_msteps + ( odom ).right_msteps ) / 2000 )
+#define ODOM_HEADING( odom )	( ( ( odom ).right_msteps - ( odom ).left_msteps ) / 1000 )
+
+// Desc: Modes for the two-lap course learner.
+typedef enum COURSE_MODE_TYPE {
+
+	COURSE_OFF = 0,		// Fixed speed line following.
+	COURSE_WAITING,		// Waiting to find the line to start the learning lap.
+	COURSE_LEARNING,	// First lap -- recording the error profile.
+	COURSE_RACING		// Later laps -- scheduling speed from the profile.
+
+} COURSE_MODE;
+
+// Desc: Course profile learned on the first lap.  Each bin holds the peak line error
+//       seen over COURSE_BIN_STEPS of track, which is all that's needed to tell
+//       straights from curves on the following laps.
+typedef struct COURSE_TYPE {
+
+	COURSE_MODE mode;
+	unsigned char profile[ COURSE_BINS ];	// Peak error per bin.
+	unsigned char n_bins;					// Bins in one lap (known after the first lap).
+	signed long lap_start;					// Odometry distance at the start of this lap.
+	signed long lap_heading;				// Odometry heading at the start of this lap.
+	unsigned long lap_start_ms;				// Odometry time at the start of this lap.
+	unsigned long last_lap_ms;				// How long the last full lap took.
+	unsigned char laps;						// Completed laps.
+	signed short base_speed;				// Speed Line_Follow() should run at.
+
+} COURSE;
+
+// Desc: One point of a gain schedule.  The scales multiply the base gains (which
+//       were tuned at 150) and are Q8.8 fixed point, so 256 = 1.0.
+typedef struct GAIN_POINT_TYPE {
+
+	signed short speed;			// Commanded forward speed for this point.
+	unsigned short kp_scale;	// kp multiplier at this speed (Q8.8).
+	unsigned short kd_scale;	// kd multiplier at this speed (Q8.8).
+
+} GAIN_POINT;
+
+// Desc: Wall-relative state estimated from the sonar and odometry.
+typedef struct WALL_STATE_TYPE {
+
+	float dist;					// Perpendicular distance from the sensor to the wall, cm.
+	float angle;				// Heading relative to the wall, radians (+ = toward the wall).
+	float last_range;			// Sonar range at the start of the current baseline.
+	signed long last_left;		// Odometry (milli-steps) at the start of the current baseline.
+	signed long last_right;
+	unsigned char last_seq;		// Last sonar reading consumed.
+	bool valid;					// TRUE once there is a baseline to work from.
+	unsigned char gone;			// Wall-gone readings in a row.
+	signed long gone_left;		// Odometry (milli-steps) at the first of them.
+	signed long gone_right;
+	unsigned long gone_ms;
+
+} WALL_STATE;
+
+// Desc: In-RAM copy of the LCD.  Everything draws into 'shadow'; LCD_flush() sends
+//       the characters that differ from 'screen' (what the LCD is showing) a few at
+//       a time, so drawing costs nothing and the LCD never holds up the loop.
+typedef struct LCD_FB_TYPE {
+
+	char shadow[ LCD_ROWS ][ LCD_COLS ];	// What we want on the screen.
+	char screen[ LCD_ROWS ][ LCD_COLS ];	// What the screen is showing.
+	unsigned char dirty;					// One bit per row that may differ.
+	unsigned char row;						// Row the flush picks up from.
+
+} LCD_FB;
+
+// Desc: Phases of going around an outside corner.
+typedef enum CORNER_PHASE_TYPE {
+
+	CORNER_NONE = 0,	// Following the wall normally.
+	CORNER_STRAIGHT,	// Running on until the bot is level with where the wall ended.
+	CORNER_ARC			// Arcing around the corner at the goal distance.
+
+} CORNER_PHASE;
+
+// Desc: Outside-corner maneuver state.
+typedef struct CORNER_TYPE {
+
+	CORNER_PHASE phase;
+	float lead_cm;				// How far to run on before starting the arc.
+	signed long start_left;		// Odometry (milli-steps) at the start of the current phase.
+	signed long start_right;
+	unsigned long start_ms;		// When the corner was detected.
+	unsigned long last_ms;		// How long the last corner took, start to resume.
+	float max_dev;				// Worst distance error once the new face was found, cm.
+	bool found;					// The arc has picked up the new face.
+	unsigned char settled;		// Settled readings in a row.
+	unsigned char last_seq;		// Last sonar reading consumed.
+
+} CORNER;
+
+// Desc: Which controller the relay auto-tuner is working on.
+typedef enum TUNE_TARGET_TYPE {
+
+	TUNE_NONE = 0,
+	TUNE_LINE,
+	TUNE_WALL
+
+} TUNE_TARGET;
+
+// Desc: Where the relay auto-tuner is in its experiment.
+typedef enum TUNE_PHASE_TYPE {
+
+	TUNE_IDLE = 0,
+	TUNE_RUNNING,
+	TUNE_DONE,
+	TUNE_FAILED
+
+} TUNE_PHASE;
+
+// Desc: State of the relay (Astrom-Hagglund) auto-tuner.
+typedef struct TUNER_TYPE {
+
+	TUNE_TARGET target;
+	TUNE_PHASE phase;
+	signed char relay;				// Current relay output sign (+1/-1).
+	unsigned char cycles;			// Full oscillation cycles seen so far.
+	bool started;					// TRUE once the first pass has set the relay up.
+	unsigned long start_ms;			// When the experiment started.
+	unsigned long cycle_start_ms;	// When the current cycle started.
+	unsigned long period_sum;		// Sum of the measured periods, ms.
+	float amp_sum;					// Sum of the measured amplitudes.
+	float err_max;					// Largest error in the current cycle.
+	float err_min;					// Smallest error in the current cycle.
+
+} TUNER;
+
+// Desc: The parameter block as kept in EEPROM.  'size' catches a PARAMS that
+//       grew without a version bump; 'crc' (CRC-16, init 0xFFFF) covers
+//       everything before it.
+typedef struct PARAM_STORE_TYPE {
+
+	unsigned short magic;			// PARAMS_MAGIC.
+	unsigned char version;			// PARAMS_VERSION.
+	unsigned char size;				// sizeof( PARAMS ).
+	PARAMS params;
+	unsigned short crc;
+
+} PARAM_STORE;
+
+// Desc: One telemetry frame.  Sent packed, little-endian, followed by a
+//       CRC-16/CCITT (init 0xFFFF, low byte first) over the frame, then COBS
+//       encoded and terminated with a 0x00 byte.  Readings are scaled to
+//       integers so the host doesn't have to know AVR float layout.
+typedef struct TLM_FRAME_TYPE {
+
+	unsigned char version;			// TLM_VERSION.
+	unsigned char seq;				// Bumped every frame -- gaps mean lost frames.
+	unsigned long time_ms;			// Odometry clock.
+	unsigned char state;			// ROBOT_STATE.
+	signed short speed_L;			// Commanded wheel speeds, steps/sec.
+	signed short speed_R;
+	unsigned char ir;				// Bit 0 = left IR, bit 1 = right IR.
+	unsigned short left_photo_mv;	// Photo-sensor voltages, mV.
+	unsigned short right_photo_mv;
+	unsigned short sonar_mm;		// Sonar distance, mm.
+	unsigned short left_line_mv;	// Line sensor voltages, mV.
+	unsigned short right_line_mv;
+	unsigned short loops;			// Trips around the arbitration loop since the last frame.
+	unsigned char dropped;			// Frames dropped for lack of TX buffer room.
+
+} TLM_FRAME;
+
+// Desc: Telemetry UART transmit ring.  The main loop fills it from 'tail',
+//       the UDRE interrupt empties it from 'head'.  Both are single bytes,
+//       so neither side has to lock the other out.
+typedef struct TLM_TX_TYPE {
+
+	unsigned char buf[ TLM_TX_LEN ];
+	volatile unsigned char head;	// Next byte to send.
+	volatile unsigned char tail;	// Next free slot.
+	unsigned char seq;				// Sequence number for the next frame.
+	unsigned char dropped;			// Frames dropped so far.
+	unsigned short loops;			// Loop passes since the last frame.
+
+} TLM_TX;
+
+// Desc: Command receiver.  The RX interrupt collects bytes in 'buf' and,
+//       on a 0x00, hands the frame over in 'frame' if the loop has picked
+//       up the last one.  Commands are only ever applied by the loop.
+typedef struct TUNE_RX_TYPE {
+
+	unsigned char buf[ TUNE_RX_LEN ];
+	unsigned char len;
+	unsigned char frame[ TUNE_RX_LEN ];
+	unsigned char frame_len;
+	volatile BOOL ready;			// 'frame' holds a command for the loop.
+	unsigned char dropped;			// Frames dropped (overlong, or loop busy).
+
+} TUNE_RX;
+
 // ------------------------------
 // ---------------------- Globals:
 volatile MOTOR_ACTION action;  	// This variable holds parameters that determine
@@ -148,23 +474,104 @@ volatile MOTOR_ACTION action;  	// This variable holds parameters that determine
 // Here, a structure named "action" of type
 // MOTOR_ACTION is declared.
 
+volatile LINE_TRACK line_track;	// Line state shared by the line behaviors.
+volatile ODOMETRY odometry;		// Dead-reckoned wheel travel.
+volatile COURSE course;			// Course profile for the two-lap learner.
+
+PARAM_STORE EEMEM param_store;	// Parameters and tuned gains, survive a power cycle.
+
+// Compiled-in parameters, used until something valid has been saved.
+const PARAMS param_defaults PROGMEM = {
+
+	DEG_90_DEF,
+	LINE_BASE_SPEED_DEF,
+	WALL_BASE_SPEED_DEF,
+	SONAR_TRIGGER_DEF,
+	WALL_GOAL_PERP_DEF,
+	LINE_THRESH_DEF,
+	EXIT_THRESH_DEF,
+	{ 70, 100 },
+	{ 0.5, 1.5 },
+	LINE_SENSE_MS_DEF,
+	SONAR_SENSE_MS_DEF
+
+};
+
+volatile TUNER tuner;			// Relay auto-tuner state.
+volatile WALL_STATE wall_state;	// Estimated wall distance and angle.
+volatile CORNER corner;			// Outside-corner maneuver state.
+LCD_FB lcd_fb;					// LCD framebuffer.
+TLM_TX tlm_tx;					// Telemetry UART transmit ring.
+TUNE_RX tune_rx;				// Live tuning command receiver.
+
+// Faster means the same turn swings the bot across the line (or toward the
+// wall) sooner, so back off kp and lean on kd as speed goes up.  Points must
+// be in increasing order of speed.
+const GAIN_POINT line_schedule[ GAIN_POINTS ] = {
+
+	{ 100, 307, 230 },		// kp x1.20, kd x0.90
+	{ 150, 256, 256 },		// kp x1.00, kd x1.00
+	{ 200, 205, 294 },		// kp x0.80, kd x1.15
+	{ 250, 166, 333 }		// kp x0.65, kd x1.30
+
+};
+
+const GAIN_POINT wall_schedule[ GAIN_POINTS ] = {
+
+	{ 100, 320, 205 },		// kp x1.25, kd x0.80
+	{ 150, 256, 256 },		// kp x1.00, kd x1.00
+	{ 200, 192, 320 },		// kp x0.75, kd x1.25
+	{ 250, 154, 384 }		// kp x0.60, kd x1.50
+
+};
+
 // ---------------------------------
 // ---------------------- Prototypes:
 void IR_sense( volatile SENSOR_DATA *pSensors, TIMER16 interval_ms );
 void Sonar_sense( volatile SENSOR_DATA *pSensors, TIMER16 interval_ms);
 void Line_sense( volatile SENSOR_DATA *pSensors, TIMER16 interval_ms );
 void Photo_init( volatile SENSOR_DATA *pSensors );
+void Odometry_sense( TIMER16 interval_ms );
+void odometry_tick( void );
+signed long odometry_ramp( signed long rate, signed short target, unsigned short accel, unsigned char tick_ms );
+void odometry_update( void );
+void odometry_drive( signed short speed_L, signed short speed_R, unsigned short accel_L, unsigned short accel_R );
+void odometry_steps( signed short steps_L, signed short steps_R );
 
 void Cruise( volatile MOTOR_ACTION *pAction );
 void Light_Follow( volatile MOTOR_ACTION *pAction, volatile SENSOR_DATA *pSensors );
 void IR_avoid( volatile MOTOR_ACTION *pAction, volatile SENSOR_DATA *pSensors );
 void Sonar_Avoid( volatile MOTOR_ACTION *pAction, volatile SENSOR_DATA *pSensors);
 void Wall_Follow( volatile MOTOR_ACTION *pAction, volatile SENSOR_DATA *pSensors );
+void Wall_estimate( volatile SENSOR_DATA *pSensors );
+void Wall_Corner( volatile MOTOR_ACTION *pAction, volatile SENSOR_DATA *pSensors );
 void Line_Follow( volatile MOTOR_ACTION *pAction, volatile SENSOR_DATA *pSensors );
+void Line_Search( volatile MOTOR_ACTION *pAction );
+void Course_Learn( void );
+void Auto_Tune( volatile MOTOR_ACTION *pAction, volatile SENSOR_DATA *pSensors );
+void params_load( void );
+void params_save( void );
+unsigned short params_crc( const PARAM_STORE *pStore );
 
 void act( volatile MOTOR_ACTION *pAction );
 void info_display( volatile MOTOR_ACTION *pAction );
+void LCD_fb_init( void );
+void LCD_fb_clear( void );
+void LCD_fb_clear_row( unsigned char row );
+void LCD_fb_puts( unsigned char row, unsigned char col, const char *str );
+void LCD_fb_sync( void );
+void LCD_flush( TIMER16 interval_ms );
+char *fmt_uint( char *buf, unsigned long value );
+char *fmt_int( char *buf, signed long value );
+char *fmt_q( char *buf, signed long value, unsigned char frac_bits, unsigned char decimals );
+void Telemetry_init( void );
+void Telemetry_send( volatile MOTOR_ACTION *pAction, volatile SENSOR_DATA *pSensors,
+					 TIMER16 interval_ms );
+BOOL tlm_queue_frame( const unsigned char *pData, unsigned char len );
+void Tuning_service( void );
 BOOL compare_actions( volatile MOTOR_ACTION *a, volatile MOTOR_ACTION *b );
+void gain_schedule( const GAIN_POINT *pTable, signed short speed,
+					const PD_GAINS *pBase, PD_GAINS *pGains );
 
 // ---------------------- Convenience Functions: -----------------------------------------------------------------------------------------------------//
 // ---------------------------------------------------------------------------------------------------------------------------------------------------//
@@ -180,42 +587,50 @@ void info_display( volatile MOTOR_ACTION *pAction )
 	if ( ( pAction->state != previous_state ) || ( pAction->state == STARTUP ) )
 	{
 
-		LCD_clear();
+		LCD_fb_clear_row( 0 );
 
 		//  Display information based on the current 'ROBOT STATE'.
 		switch( pAction->state )
 		{
 
 			case STARTUP:
-			LCD_printf( "STARTING...\n");
+			LCD_fb_puts( 0, 0, "STARTING..." );
 			break;
 
 			case CRUISING:
-			LCD_printf( "CRUISING...\n" );
+			LCD_fb_puts( 0, 0, "CRUISING..." );
 			break;
 
 			case IR_AVOIDING:
-			LCD_printf( "IR AVOIDING...\n" );
+			LCD_fb_puts( 0, 0, "IR AVOIDING..." );
 			break;
 
 			case HOMING:
-			LCD_printf( "HOMING...\n" );
+			LCD_fb_puts( 0, 0, "HOMING..." );
 			break;
 					
 			case SONAR_AVOIDING:
-			LCD_printf( "SONAR AVOIDING...\n" );
+			LCD_fb_puts( 0, 0, "SONAR AVOIDING..." );
 			break;
 					
 			case WALL_FOLLOWING:
-			LCD_printf( "WALL FOLLOWING...\n" );
+			LCD_fb_puts( 0, 0, "WALL FOLLOWING..." );
 			break;
 			
 			case LINE_FOLLOWING:
-			LCD_printf( "LINE FOLLOWING...\n" );
+			LCD_fb_puts( 0, 0, "LINE FOLLOWING..." );
+			break;
+			
+			case LINE_SEARCHING:
+			LCD_fb_puts( 0, 0, "LINE SEARCHING..." );
+			break;
+			
+			case AUTO_TUNING:
+			LCD_fb_puts( 0, 0, "AUTO TUNING..." );
 			break;
 
 			default:
-			LCD_printf( "Unknown state!\n" );
+			LCD_fb_puts( 0, 0, "Unknown state!" );
 
 		} // end switch()
 
@@ -227,6 +642,448 @@ void info_display( volatile MOTOR_ACTION *pAction )
 } // end info_display()
 
 
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+void LCD_fb_init( void )
+{
+
+	// Start from a blank screen with the framebuffer matching it.
+	unsigned char row;
+	unsigned char col;
+
+	LCD_clear();
+
+	for ( row = 0; row < LCD_ROWS; row++ ) {
+		for ( col = 0; col < LCD_COLS; col++ ) {
+			lcd_fb.shadow[ row ][ col ] = ' ';
+			lcd_fb.screen[ row ][ col ] = ' ';
+		}
+	}
+	lcd_fb.dirty = 0;
+	lcd_fb.row = 0;
+
+} // end LCD_fb_init()
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+void LCD_fb_clear( void )
+{
+
+	unsigned char row;
+
+	for ( row = 0; row < LCD_ROWS; row++ ) {
+		LCD_fb_clear_row( row );
+	}
+
+} // end LCD_fb_clear()
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+void LCD_fb_clear_row( unsigned char row )
+{
+
+	unsigned char col;
+
+	if ( row >= LCD_ROWS ) {
+		return;
+	}
+
+	for ( col = 0; col < LCD_COLS; col++ ) {
+		lcd_fb.shadow[ row ][ col ] = ' ';
+	}
+	lcd_fb.dirty |= ( 1 << row );
+
+} // end LCD_fb_clear_row()
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+void LCD_fb_puts( unsigned char row, unsigned char col, const char *str )
+{
+
+	// Anything past the end of the row is dropped.
+	if ( row >= LCD_ROWS ) {
+		return;
+	}
+
+	while ( ( *str != '\0' ) && ( col < LCD_COLS ) ) {
+		lcd_fb.shadow[ row ][ col++ ] = *str++;
+	}
+	lcd_fb.dirty |= ( 1 << row );
+
+} // end LCD_fb_puts()
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+// Integer and fixed-point formatting.  These replace "%f" so the float
+// printf library (and its ftoa engine) no longer has to be linked in.
+// Each one writes a terminated string into 'buf' and returns a pointer
+// to the terminator, so calls can be chained to build up a line.
+char *fmt_uint( char *buf, unsigned long value )
+{
+
+	ultoa( value, buf, 10 );
+
+	while ( *buf != '\0' ) {
+		buf++;
+	}
+
+	return buf;
+
+} // end fmt_uint()
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+char *fmt_int( char *buf, signed long value )
+{
+
+	if ( value < 0 ) {
+		*buf++ = '-';
+		return fmt_uint( buf, -( unsigned long )value );
+	}
+
+	return fmt_uint( buf, value );
+
+} // end fmt_int()
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+char *fmt_q( char *buf, signed long value, unsigned char frac_bits, unsigned char decimals )
+{
+
+	// Prints a Q-format value ('frac_bits' fractional bits) rounded to
+	// 'decimals' places.  The fraction is scaled by 10^decimals before it's
+	// rounded, so keep 2^frac_bits * 10^decimals under 2^32.
+	unsigned long mag;
+	unsigned long frac;
+	unsigned long mask = ( 1UL << frac_bits ) - 1;
+	unsigned long scale = 1;
+	unsigned char i;
+
+	if ( value < 0 ) {
+		*buf++ = '-';
+		mag = -( unsigned long )value;
+	}
+	else {
+		mag = value;
+	}
+
+	for ( i = 0; i < decimals; i++ ) {
+		scale *= 10;
+	}
+
+	// Fraction in units of the last printed place, rounded to nearest.
+	// Rounding up to a whole unit carries into the integer part.
+	frac = ( ( mag & mask ) * scale + ( ( 1UL << frac_bits ) >> 1 ) ) >> frac_bits;
+	mag >>= frac_bits;
+	if ( frac >= scale ) {
+		frac -= scale;
+		mag++;
+	}
+
+	buf = fmt_uint( buf, mag );
+
+	if ( decimals > 0 ) {
+
+		*buf++ = '.';
+
+		for ( i = decimals; i > 0; i-- ) {
+			buf[ i - 1 ] = '0' + ( char )( frac % 10 );
+			frac /= 10;
+		}
+		buf += decimals;
+		*buf = '\0';
+
+	}
+
+	return buf;
+
+} // end fmt_q()
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+void Telemetry_init( void )
+{
+
+	// USART0, 8N1, transmit only.  The UDRE interrupt is only turned on
+	// while there's something in the ring.
+	UBRR0 = TLM_UBRR;
+	UCSR0A = _BV( U2X0 );
+	UCSR0C = _BV( UCSZ01 ) | _BV( UCSZ00 );
+	UCSR0B = _BV( TXEN0 ) | _BV( RXEN0 ) | _BV( RXCIE0 );
+
+	tlm_tx.head = 0;
+	tlm_tx.tail = 0;
+	tune_rx.len = 0;
+	tune_rx.ready = FALSE;
+
+} // end Telemetry_init()
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+ISR( USART0_UDRE_vect )
+{
+
+	if ( tlm_tx.head != tlm_tx.tail ) {
+		UDR0 = tlm_tx.buf[ tlm_tx.head ];
+		tlm_tx.head = ( tlm_tx.head + 1 ) % TLM_TX_LEN;
+	}
+	else {
+		// Ring's empty -- stop interrupting until more is queued.
+		UCSR0B &= ~_BV( UDRIE0 );
+	}
+
+} // end ISR( USART0_UDRE_vect )
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+BOOL tlm_queue_frame( const unsigned char *pData, unsigned char len )
+{
+
+	// COBS encodes 'pData' plus its CRC straight into the TX ring and kicks
+	// the interrupt.  If the ring doesn't have room for the worst case the
+	// frame is dropped instead -- this never waits on the UART.
+	unsigned char free_bytes;
+	unsigned char pos;
+	unsigned char code_pos;
+	unsigned char code;
+	unsigned char crc_bytes[ 2 ];
+	unsigned short crc = 0xFFFF;
+	unsigned char i;
+	unsigned char byte;
+
+	free_bytes = ( tlm_tx.head + TLM_TX_LEN - tlm_tx.tail - 1 ) % TLM_TX_LEN;
+
+	// Data + CRC, one COBS code byte per 254 bytes (plus the first), and
+	// the delimiter.
+	if ( free_bytes < len + 2 + ( len + 2 ) / 254 + 1 + 1 ) {
+		return FALSE;
+	}
+
+	for ( i = 0; i < len; i++ ) {
+		crc = _crc_ccitt_update( crc, pData[ i ] );
+	}
+	crc_bytes[ 0 ] = crc & 0xFF;
+	crc_bytes[ 1 ] = crc >> 8;
+
+	// Standard COBS: each code byte is the distance to the next zero.
+	pos = tlm_tx.tail;
+	code_pos = pos;
+	pos = ( pos + 1 ) % TLM_TX_LEN;
+	code = 1;
+
+	for ( i = 0; i < len + 2; i++ ) {
+
+		byte = ( i < len ) ? pData[ i ] : crc_bytes[ i - len ];
+
+		if ( byte == 0 ) {
+			tlm_tx.buf[ code_pos ] = code;
+			code_pos = pos;
+			pos = ( pos + 1 ) % TLM_TX_LEN;
+			code = 1;
+		}
+		else {
+			tlm_tx.buf[ pos ] = byte;
+			pos = ( pos + 1 ) % TLM_TX_LEN;
+			if ( ++code == 0xFF ) {
+				tlm_tx.buf[ code_pos ] = code;
+				code_pos = pos;
+				pos = ( pos + 1 ) % TLM_TX_LEN;
+				code = 1;
+			}
+		}
+
+	}
+	tlm_tx.buf[ code_pos ] = code;
+	tlm_tx.buf[ pos ] = 0x00;
+	pos = ( pos + 1 ) % TLM_TX_LEN;
+
+	// Publish the whole frame at once, then make sure the UART is draining.
+	tlm_tx.tail = pos;
+	UCSR0B |= _BV( UDRIE0 );
+
+	return TRUE;
+
+} // end tlm_queue_frame()
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+void Telemetry_send( volatile MOTOR_ACTION *pAction, volatile SENSOR_DATA *pSensors,
+					 TIMER16 interval_ms )
+{
+
+	// Called every trip around the loop so it can count them, but only
+	// sends a frame every 'interval_ms'.
+	static BOOL timer_started = FALSE;
+	static TIMEROBJ tlm_timer;
+	TLM_FRAME frame;
+
+	tlm_tx.loops++;
+
+	if ( timer_started == FALSE ) {
+		TMRSRVC_new( &tlm_timer, TMRFLG_NOTIFY_FLAG, TMRTCM_RESTART, interval_ms );
+		timer_started = TRUE;
+	}
+	else if ( TIMER_ALARM( tlm_timer ) ) {
+
+		TIMER_SNOOZE( tlm_timer );
+
+		frame.version = TLM_VERSION;
+		frame.seq = tlm_tx.seq;
+		frame.time_ms = odometry.time_ms;
+		frame.state = pAction->state;
+		frame.speed_L = pAction->speed_L;
+		frame.speed_R = pAction->speed_R;
+		frame.ir = ( pSensors->left_IR ? 0x01 : 0 ) | ( pSensors->right_IR ? 0x02 : 0 );
+		frame.left_photo_mv = pSensors->left_photo_voltage * 1000;
+		frame.right_photo_mv = pSensors->right_photo_voltage * 1000;
+		frame.sonar_mm = pSensors->sonar_dist * 10;
+		frame.left_line_mv = pSensors->left_line_voltage * 1000;
+		frame.right_line_mv = pSensors->right_line_voltage * 1000;
+		frame.loops = tlm_tx.loops;
+		frame.dropped = tlm_tx.dropped;
+
+		if ( tlm_queue_frame( ( const unsigned char * ) &frame, sizeof( frame ) ) == TRUE ) {
+			tlm_tx.seq++;
+		}
+		else {
+			tlm_tx.dropped++;
+		}
+		tlm_tx.loops = 0;
+
+	}
+
+} // end Telemetry_send()
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+ISR( USART0_RX_vect )
+{
+
+	unsigned char byte = UDR0;
+
+	if ( byte != 0x00 ) {
+		if ( tune_rx.len < TUNE_RX_LEN ) {
+			tune_rx.buf[ tune_rx.len ] = byte;
+		}
+		// Keep counting past the end so an overlong frame gets dropped
+		// at its delimiter.
+		if ( tune_rx.len < 0xFF ) {
+			tune_rx.len++;
+		}
+		return;
+	}
+
+	if ( tune_rx.len > 0 ) {
+		if ( tune_rx.len <= TUNE_RX_LEN && tune_rx.ready == FALSE ) {
+			memcpy( tune_rx.frame, tune_rx.buf, tune_rx.len );
+			tune_rx.frame_len = tune_rx.len;
+			tune_rx.ready = TRUE;
+		}
+		else {
+			tune_rx.dropped++;
+		}
+	}
+	tune_rx.len = 0;
+
+} // end ISR( USART0_RX_vect )
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+void Tuning_service( void )
+{
+
+	// Runs at the top of the loop, so a command lands between two passes
+	// and every behavior in a pass sees the same parameters.
+	TUNE_REPLY reply;
+
+	if ( tune_rx.ready == FALSE ) {
+		return;
+	}
+
+	tune_handle( tune_rx.frame, tune_rx.frame_len, &reply );
+	tune_rx.ready = FALSE;
+
+	// If there's no room the host just doesn't get a reply, and retries.
+	tlm_queue_frame( ( const unsigned char * ) &reply, sizeof( reply ) );
+
+} // end Tuning_service()
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+void LCD_fb_sync( void )
+{
+
+	// Push everything out right now.  Only for 'ballistic' behaviors, which
+	// are about to block anyway and won't let LCD_flush() run for a while.
+	unsigned char row;
+	unsigned char col;
+
+	for ( row = 0; row < LCD_ROWS; row++ ) {
+		if ( lcd_fb.dirty & ( 1 << row ) ) {
+			for ( col = 0; col < LCD_COLS; col++ ) {
+				lcd_fb.screen[ row ][ col ] = lcd_fb.shadow[ row ][ col ];
+			}
+			LCD_printf_RC( row, 0, "%.20s", lcd_fb.screen[ row ] );
+		}
+	}
+	lcd_fb.dirty = 0;
+
+} // end LCD_fb_sync()
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+void LCD_flush( TIMER16 interval_ms )
+{
+
+	// Low priority 'task': every 'interval_ms', find the next run of changed
+	// characters and send at most LCD_FLUSH_BYTES of it.  The LCD time spent
+	// per pass is bounded no matter how much was drawn.
+	static BOOL timer_started = FALSE;
+	static TIMEROBJ flush_timer;
+
+	char run[ LCD_FLUSH_BYTES + 1 ];
+	unsigned char tries;
+	unsigned char row;
+	unsigned char col;
+	unsigned char start;
+	unsigned char n;
+
+	if ( timer_started == FALSE )
+	{
+		TMRSRVC_new( &flush_timer, TMRFLG_NOTIFY_FLAG, TMRTCM_RESTART, interval_ms );
+		timer_started = TRUE;
+		return;
+	}
+
+	if ( !TIMER_ALARM( flush_timer ) )
+	{
+		return;
+	}
+	TIMER_SNOOZE( flush_timer );
+
+	for ( tries = 0; tries < LCD_ROWS; tries++ ) {
+
+		row = lcd_fb.row;
+
+		if ( lcd_fb.dirty & ( 1 << row ) ) {
+
+			for ( col = 0; col < LCD_COLS; col++ ) {
+				if ( lcd_fb.shadow[ row ][ col ] != lcd_fb.screen[ row ][ col ] ) {
+					break;
+				}
+			}
+
+			if ( col < LCD_COLS ) {
+
+				start = col;
+				n = 0;
+				while ( ( col < LCD_COLS ) && ( n < LCD_FLUSH_BYTES ) &&
+						( lcd_fb.shadow[ row ][ col ] != lcd_fb.screen[ row ][ col ] ) ) {
+					run[ n++ ] = lcd_fb.shadow[ row ][ col ];
+					lcd_fb.screen[ row ][ col ] = lcd_fb.shadow[ row ][ col ];
+					col++;
+				}
+				run[ n ] = '\0';
+
+				LCD_printf_RC( row, start, "%s", run );
+
+				// Stay on this row until it's clean.
+				return;
+			}
+
+			lcd_fb.dirty &= ~( 1 << row );
+		}
+
+		lcd_fb.row = ( row + 1 ) % LCD_ROWS;
+	}
+
+} // end LCD_flush()
+
 // ------------------------------------------------------------------------------------------------------------------------------------------------ //
 BOOL compare_actions( volatile MOTOR_ACTION *a, volatile MOTOR_ACTION *b )
 {
@@ -251,6 +1108,102 @@ BOOL compare_actions( volatile MOTOR_ACTION *a, volatile MOTOR_ACTION *b )
 
 } // end compare_actions()
 
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+void gain_schedule( const GAIN_POINT *pTable, signed short speed,
+					const PD_GAINS *pBase, PD_GAINS *pGains )
+{
+	
+	// Linearly interpolates the kp/kd scales for 'speed' between the two
+	// neighboring table points (clamped at either end) and applies them to
+	// the base gains.  The interpolation is all integer math.
+	unsigned char i = 0;
+	unsigned short kp_scale;
+	unsigned short kd_scale;
+	signed short frac;
+
+	if ( speed <= pTable[ 0 ].speed ) {
+		kp_scale = pTable[ 0 ].kp_scale;
+		kd_scale = pTable[ 0 ].kd_scale;
+	}
+	else if ( speed >= pTable[ GAIN_POINTS - 1 ].speed ) {
+		kp_scale = pTable[ GAIN_POINTS - 1 ].kp_scale;
+		kd_scale = pTable[ GAIN_POINTS - 1 ].kd_scale;
+	}
+	else {
+		while ( speed > pTable[ i + 1 ].speed ) {
+			i++;
+		}
+		
+		// Position between point i and i+1, Q8 (0..256).
+		frac = ( (signed long) ( speed - pTable[ i ].speed ) << 8 ) /
+			   ( pTable[ i + 1 ].speed - pTable[ i ].speed );
+		
+		kp_scale = pTable[ i ].kp_scale +
+				   ( ( (signed long) pTable[ i + 1 ].kp_scale - pTable[ i ].kp_scale ) * frac >> 8 );
+		kd_scale = pTable[ i ].kd_scale +
+				   ( ( (signed long) pTable[ i + 1 ].kd_scale - pTable[ i ].kd_scale ) * frac >> 8 );
+	}
+
+	pGains->kp = pBase->kp * kp_scale / 256;
+	pGains->kd = pBase->kd * kd_scale / 256;
+
+} // end gain_schedule()
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+unsigned short params_crc( const PARAM_STORE *pStore )
+{
+
+	// CRC over everything in the store ahead of the CRC itself.
+	const unsigned char *p = ( const unsigned char * ) pStore;
+	unsigned short crc = 0xFFFF;
+	unsigned char i;
+
+	for ( i = 0; i < offsetof( PARAM_STORE, crc ); i++ ) {
+		crc = _crc16_update( crc, p[ i ] );
+	}
+
+	return crc;
+
+} // end params_crc()
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+void params_load( void )
+{
+
+	// Load the saved parameters into RAM, falling back to the compiled-in
+	// defaults if the block is blank, from another layout, or corrupt.
+	PARAM_STORE store;
+
+	eeprom_read_block( &store, &param_store, sizeof( PARAM_STORE ) );
+
+	if ( store.magic == PARAMS_MAGIC && store.version == PARAMS_VERSION &&
+		 store.size == sizeof( PARAMS ) && store.crc == params_crc( &store ) ) {
+		params = store.params;
+	}
+	else {
+		memcpy_P( &params, &param_defaults, sizeof( PARAMS ) );
+	}
+
+} // end params_load()
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+void params_save( void )
+{
+
+	PARAM_STORE store;
+
+	store.magic = PARAMS_MAGIC;
+	store.version = PARAMS_VERSION;
+	store.size = sizeof( PARAMS );
+	store.params = params;
+	store.crc = params_crc( &store );
+
+	// eeprom_update_block() only rewrites the bytes that changed, so saving
+	// after one parameter moves doesn't wear the rest of the block.
+	eeprom_update_block( &store, &param_store, sizeof( PARAM_STORE ) );
+
+} // end params_save()
+
 
 // ---------------------- Top-Level Behaviorals: ----------------------------------------------------------------------------------------------------- //
 // --------------------------------------------------------------------------------------------------------------------------------------------------- //
@@ -360,11 +1313,21 @@ void Sonar_sense( volatile SENSOR_DATA *pSensors, TIMER16 interval_ms )
 {
 	static BOOL timer_started = FALSE;
 
+	static TIMER16 period;
+
 	static TIMEROBJ sense_timer;
 
+	// SONAR_SENSE_MS can be SET over the link -- re-arm at the new period.
+	if( timer_started == TRUE && interval_ms != period )
+	{
+		TMRSRVC_stop_timer( &sense_timer );
+		timer_started = FALSE;
+	}
+
 	if(timer_started == FALSE)
 	{
 		TMRSRVC_new( &sense_timer, TMRFLG_NOTIFY_FLAG, TMRTCM_RESTART, interval_ms);
+		period = interval_ms;
 		timer_started = TRUE;
 	}
 	else
@@ -372,13 +1335,18 @@ void Sonar_sense( volatile SENSOR_DATA *pSensors, TIMER16 interval_ms )
 		if( TIMER_ALARM( sense_timer ) )
 		{					
 			float distance_cm;
+			char text[ FMT_BUF_LEN ];
 
 			distance_cm = USONIC_DIST_CM( USONIC_ping() );
 
 			pSensors->sonar_dist = distance_cm;
+			pSensors->sonar_seq++;
 
-			LCD_clear();    //Good for sensor setup, but we want LCD to display the behavior
-			LCD_printf( "Dist = %.3f\n", distance_cm);
+			// Keep the behavior on row 0 and show the distance underneath.
+			LCD_fb_clear_row( 1 );
+			LCD_fb_puts( 1, 0, "Dist = " );
+			fmt_q( text, ( signed long )( distance_cm * ( 1 << SONAR_FRAC_BITS ) ), SONAR_FRAC_BITS, 2 );
+			LCD_fb_puts( 1, 7, text );
 					
 			// Snooze the alarm so it can trigger again.
 			TIMER_SNOOZE(sense_timer);
@@ -391,12 +1359,22 @@ void Line_sense( volatile SENSOR_DATA *pSensors, TIMER16 interval_ms )
 {
 	static BOOL timer_started = FALSE;   //  Check if photo-sense is already running
 
+	static TIMER16 period;               // Period the timer was started with
+
 	static TIMEROBJ sense_timer;         // Used to control the pace at which sensor data is gathered
 
+	// LINE_SENSE_MS can be SET over the link -- re-arm at the new period.
+	if( timer_started == TRUE && interval_ms != period )
+	{
+		TMRSRVC_stop_timer( &sense_timer );
+		timer_started = FALSE;
+	}
+
 	if( timer_started == FALSE )		// If this is first time sense() runs, start the photo-sense timer.  This happens only once!!!
 	{
 		TMRSRVC_new( &sense_timer, TMRFLG_NOTIFY_FLAG, TMRTCM_RESTART, interval_ms);	// Start the photo-sense timer, adjusted to tick every 'interval_ms'
 
+		period = interval_ms;
 		timer_started = TRUE;			// Mark that timer is started
 	}
 	else
@@ -435,6 +1413,107 @@ void Photo_init( volatile SENSOR_DATA *pSensors )
 	pSensors->right_photo_ambient = ((sample * 5.0f) / 1024);
 } // end Photo_init()
 
+// ----------------------------------------------------------------------------------------------------------------------------------------- //
+void Odometry_sense( TIMER16 interval_ms )
+{
+	static BOOL timer_started = FALSE;
+
+	static TIMEROBJ sense_timer;
+
+	if( timer_started == FALSE )
+	{
+		odometry.tick_ms = interval_ms;
+		TMRSRVC_REGISTER_CBFUNC( sense_timer, odometry_tick );
+		TMRSRVC_new( &sense_timer, TMRFLG_NOTIFY_FUNC, TMRTCM_RESTART, interval_ms );
+		timer_started = TRUE;
+	}
+	else
+	{
+		odometry_update();
+	}
+} // end Odometry_sense()
+
+// ----------------------------------------------------------------------------------------------------------------------------------------- //
+void odometry_tick( void )
+{
+	// Timer callback -- runs in the timer interrupt, so no tick is lost
+	// however long a trip around the loop (or a blocking move) takes.
+	odometry.ticks++;
+} // end odometry_tick()
+
+// ----------------------------------------------------------------------------------------------------------------------------------------- //
+signed long odometry_ramp( signed long rate, signed short target, unsigned short accel, unsigned char tick_ms )
+{
+	// One tick of the stepper driver's ramp: 'accel' steps/sec^2 for
+	// 'tick_ms' is accel * tick_ms milli-steps/sec.  No ramp means no wait.
+	signed long goal = (signed long) target * 1000;
+	signed long step = (signed long) accel * tick_ms;
+
+	if( ( accel == 0 ) || ( labs( goal - rate ) <= step ) )
+		return goal;
+
+	return ( goal > rate ) ? rate + step : rate - step;
+} // end odometry_ramp()
+
+// ----------------------------------------------------------------------------------------------------------------------------------------- //
+void odometry_update( void )
+{
+	// Integrates every tick that has come in since the last call.  Travel
+	// over a tick is the area under the ramped speed (a trapezoid).
+	unsigned char sreg;
+	unsigned short ticks;
+	signed long old_L;
+	signed long old_R;
+
+	sreg = SREG;
+	cli();
+	ticks = odometry.ticks;
+	odometry.ticks = 0;
+	SREG = sreg;
+
+	while( ticks-- > 0 )
+	{
+		old_L = odometry.rate_L;
+		old_R = odometry.rate_R;
+		odometry.rate_L = odometry_ramp( old_L, odometry.target_L, odometry.accel_L, odometry.tick_ms );
+		odometry.rate_R = odometry_ramp( old_R, odometry.target_R, odometry.accel_R, odometry.tick_ms );
+
+		odometry.left_msteps  += ( old_L + odometry.rate_L ) * odometry.tick_ms / 2000;
+		odometry.right_msteps += ( old_R + odometry.rate_R ) * odometry.tick_ms / 2000;
+		odometry.time_ms += odometry.tick_ms;
+	}
+} // end odometry_update()
+
+// ----------------------------------------------------------------------------------------------------------------------------------------- //
+void odometry_drive( signed short speed_L, signed short speed_R, unsigned short accel_L, unsigned short accel_R )
+{
+	// The wheels were just told to free-run at these speeds.  Whatever
+	// time has gone by so far was at the old ones.
+	odometry_update();
+
+	odometry.target_L = speed_L;
+	odometry.target_R = speed_R;
+	odometry.accel_L = accel_L;
+	odometry.accel_R = accel_R;
+} // end odometry_drive()
+
+// ----------------------------------------------------------------------------------------------------------------------------------------- //
+void odometry_steps( signed short steps_L, signed short steps_R )
+{
+	// The wheels were stopped and then moved exactly these steps (0, 0
+	// for a plain stop).  Call it before a step move starts and again
+	// once it's done.
+	odometry_update();
+
+	odometry.rate_L = 0;
+	odometry.rate_R = 0;
+	odometry.target_L = 0;
+	odometry.target_R = 0;
+
+	odometry.left_msteps  += (signed long) steps_L * 1000;
+	odometry.right_msteps += (signed long) steps_R * 1000;
+} // end odometry_steps()
+
 // ----------------------------------------------------------------------------------------------------------------------------------------- //
 void Cruise( volatile MOTOR_ACTION *pAction )
 {
@@ -460,20 +1539,24 @@ void IR_avoid( volatile MOTOR_ACTION *pAction, volatile SENSOR_DATA *pSensors )
 	if( pSensors->right_IR == TRUE && pSensors->left_IR == TRUE)
 	{
 		pAction->state = IR_AVOIDING;
-		LCD_clear();
-		LCD_printf( "AVOIDING...\n");
+		LCD_fb_clear();
+		LCD_fb_puts( 0, 0, "AVOIDING..." );
+		LCD_fb_sync();
 
 		STEPPER_stop(STEPPER_BOTH, STEPPER_BRK_OFF);
+		odometry_steps( 0, 0 );
 
 		// Back up...
 		STEPPER_move_stwt( STEPPER_BOTH,
 		STEPPER_REV, 250, 200, 400, STEPPER_BRK_OFF,
 		STEPPER_REV, 250, 200, 400, STEPPER_BRK_OFF );
+		odometry_steps( -250, -250 );
 				
 		// ... and turn LEFT ~90-deg
 		STEPPER_move_stwt( STEPPER_BOTH,
 		STEPPER_REV, DEG_90, 200, 400, STEPPER_BRK_OFF,
 		STEPPER_FWD, DEG_90, 200, 400, STEPPER_BRK_OFF);
+		odometry_steps( -DEG_90, DEG_90 );
 
 		// ... and set the motor action structure with variables to move forward.
 		pAction->state = IR_AVOIDING;
@@ -486,20 +1569,24 @@ void IR_avoid( volatile MOTOR_ACTION *pAction, volatile SENSOR_DATA *pSensors )
 	else if( pSensors->left_IR == TRUE )
 	{
 		pAction->state = IR_AVOIDING;
-		LCD_clear();
-		LCD_printf( "AVOIDING...\n");
+		LCD_fb_clear();
+		LCD_fb_puts( 0, 0, "AVOIDING..." );
+		LCD_fb_sync();
 
 		STEPPER_stop(STEPPER_BOTH, STEPPER_BRK_OFF);
+		odometry_steps( 0, 0 );
 
 		// Back up...
 		STEPPER_move_stwt( STEPPER_BOTH,
 		STEPPER_REV, 250, 200, 400, STEPPER_BRK_OFF,
 		STEPPER_REV, 250, 200, 400, STEPPER_BRK_OFF );
+		odometry_steps( -250, -250 );
 				
 		// ... and turn LEFT ~90-deg
 		STEPPER_move_stwt( STEPPER_BOTH,
 		STEPPER_REV, DEG_90, 200, 400, STEPPER_BRK_OFF,
 		STEPPER_FWD, DEG_90, 200, 400, STEPPER_BRK_OFF);
+		odometry_steps( -DEG_90, DEG_90 );
 
 		// ... and set the motor action structure with variables to move forward.
 		pAction->state = IR_AVOIDING;
@@ -512,20 +1599,24 @@ void IR_avoid( volatile MOTOR_ACTION *pAction, volatile SENSOR_DATA *pSensors )
 	else if( pSensors->right_IR == TRUE)
 	{
 		pAction->state = IR_AVOIDING;
-		LCD_clear();
-		LCD_printf( "AVOIDING...\n");
+		LCD_fb_clear();
+		LCD_fb_puts( 0, 0, "AVOIDING..." );
+		LCD_fb_sync();
 
 		STEPPER_stop(STEPPER_BOTH, STEPPER_BRK_OFF);
+		odometry_steps( 0, 0 );
 
 		// Back up...
 		STEPPER_move_stwt( STEPPER_BOTH,
 		STEPPER_REV, 250, 200, 400, STEPPER_BRK_OFF,
 		STEPPER_REV, 250, 200, 400, STEPPER_BRK_OFF );
+		odometry_steps( -250, -250 );
 				
 		// ... and turn LEFT ~90-deg
 		STEPPER_move_stwt( STEPPER_BOTH,
 		STEPPER_REV, DEG_90, 200, 400, STEPPER_BRK_OFF,
 		STEPPER_FWD, DEG_90, 200, 400, STEPPER_BRK_OFF);
+		odometry_steps( -DEG_90, DEG_90 );
 
 		// ... and set the motor action structure with variables to move forward.
 		pAction->state = IR_AVOIDING;
@@ -572,7 +1663,7 @@ void Light_Follow(volatile MOTOR_ACTION *pAction, volatile SENSOR_DATA *pSensors
 void Sonar_Avoid( volatile MOTOR_ACTION *pAction, volatile SENSOR_DATA *pSensors)
 {
 	float base_speed = 200;
-	int trigger_distance = 85;
+	int trigger_distance = params.sonar_trigger;
 			
 	if ( pSensors->sonar_dist > 0 && pSensors->sonar_dist < trigger_distance ) {
 				
@@ -583,40 +1674,239 @@ void Sonar_Avoid( volatile MOTOR_ACTION *pAction, volatile SENSOR_DATA *pSensors
 	}
 } // end Sonar_Avoid()
 
+// --------------------------------------------------------------------------------------------------------------------------- //	
+void Wall_estimate( volatile SENSOR_DATA *pSensors ) {
+	
+	// Two sonar hits on the wall, taken a known distance apart (odometry),
+	// give the direction of the wall.  With the wall on the right and the
+	// beam at -45 degrees (unit vector u), in the frame of the first reading:
+	//
+	//		P1 = r1 * u
+	//		P2 = ( dx, dy ) + R( dtheta ) * r2 * u
+	//
+	// The wall runs along P2 - P1; its angle, less the turn made since the
+	// first reading, is our heading relative to the wall.  The perpendicular
+	// distance is then r2 * sin( 45 deg + angle ).
+	float r = pSensors->sonar_dist;
+	float ds;
+	float dtheta;
+	float ux = cos( SONAR_ANGLE );
+	float uy = -sin( SONAR_ANGLE );
+	float wx;
+	float wy;
+	float angle;
+	signed long dl;
+	signed long dr;
+	
+	if ( pSensors->sonar_seq == wall_state.last_seq ) {
+		return;
+	}
+	wall_state.last_seq = pSensors->sonar_seq;
+	
+	// No echo and no wall yet -- nothing to estimate from.
+	if ( ( r <= 0 ) && !wall_state.valid ) {
+		return;
+	}
+	
+	if ( !wall_state.valid ) {
+		wall_state.valid = true;
+		wall_state.angle = 0;
+	}
+	else if ( ( r <= 0 ) || ( ( r - wall_state.last_range ) > CORNER_JUMP_CM ) ) {
+		
+		// Missed echoes are routine, so one reading isn't enough.  Note where
+		// the wall seemed to end and keep steering on the last estimate until
+		// CORNER_GONE_READS in a row agree.
+		if ( wall_state.gone++ == 0 ) {
+			wall_state.gone_left = odometry.left_msteps;
+			wall_state.gone_right = odometry.right_msteps;
+			wall_state.gone_ms = odometry.time_ms;
+		}
+		if ( wall_state.gone < CORNER_GONE_READS ) {
+			return;
+		}
+		wall_state.gone = 0;
+		
+		// The wall ended at the first of those readings.  The beam hit it
+		// about one perpendicular distance ahead of us there, so that's how
+		// far to run on before turning.
+		corner.phase = CORNER_STRAIGHT;
+		corner.lead_cm = wall_state.dist;
+		corner.start_left = wall_state.gone_left;
+		corner.start_right = wall_state.gone_right;
+		corner.start_ms = wall_state.gone_ms;
+		corner.max_dev = 0;
+		corner.found = false;
+		corner.settled = 0;
+		corner.last_seq = pSensors->sonar_seq;
+		wall_state.valid = false;
+		return;
+	}
+	else {
+		wall_state.gone = 0;
+		
+		dl = odometry.left_msteps - wall_state.last_left;
+		dr = odometry.right_msteps - wall_state.last_right;
+		ds = ( ( dl + dr ) / 2000.0 ) * CM_PER_STEP;
+		
+		// Too short a baseline and the sonar noise swamps the angle -- keep
+		// the old start point and wait until we've moved far enough.
+		if ( ds < WALL_BASELINE_CM ) {
+			wall_state.dist = r * sin( SONAR_ANGLE + wall_state.angle );
+			return;
+		}
+		
+		dtheta = ( ( dr - dl ) / 1000.0 ) * CM_PER_STEP / WHEEL_BASE_CM;
+		
+		wx = ds * cos( dtheta / 2 ) + r * ( ux * cos( dtheta ) - uy * sin( dtheta ) ) - wall_state.last_range * ux;
+		wy = ds * sin( dtheta / 2 ) + r * ( ux * sin( dtheta ) + uy * cos( dtheta ) ) - wall_state.last_range * uy;
+		
+		angle = atan2( wy, wx ) - dtheta;
+		wall_state.angle += WALL_ANGLE_FILTER * ( angle - wall_state.angle );
+	}
+	
+	wall_state.dist = r * sin( SONAR_ANGLE + wall_state.angle );
+	wall_state.last_range = r;
+	wall_state.last_left = odometry.left_msteps;
+	wall_state.last_right = odometry.right_msteps;
+	
+} // end Wall_estimate()
+
 // --------------------------------------------------------------------------------------------------------------------------- //	
 void Wall_Follow( volatile MOTOR_ACTION *pAction, volatile SENSOR_DATA *pSensors ) {
-			
-	float measDist = pSensors->sonar_dist;
-	float base_speed = 150;
-			
-	// 15 in = 38.1 cm
-	// 10 in = 25.4 cm
-	// 20 in = 50.8 cm
-	float goalDist = (25.4 + 10.00) * 1.41;
-	// multiply desired distance by sqrt(2) as sensor is at 45 degree angle to wall
-	// add offset for center of bot to wheels
+	
+	// State feedback on distance and angle to the wall:
+	//
+	//		turn = k_dist * ( goal - dist ) + k_angle * angle
+	//
+	// Small-angle, the bot drifts toward the wall at v * angle and turns at
+	// 2 * turn / W, so the closed loop is a 2nd-order system with
+	//
+	//		wn^2 = 2 * v * k_dist / W,   k_angle = zeta * wn * W
+	//
+	// (speeds in cm/s here, hence the CM_PER_STEP conversions below).
+	// k_dist comes from the scheduled kp -- which was
+	// tuned against the 45-degree range, hence the 1.41 -- and k_angle is
+	// picked for WALL_ZETA damping.  The old derivative-of-range term only
+	// saw the heading through sonar noise; the angle estimate sees it directly.
+	float base_speed = WALL_BASE_SPEED;
+	float v = base_speed * CM_PER_STEP;
+	float k_dist;
+	float k_angle;
+	float wn;
 	int turn = 0;
-			
-	float kp = 0.5;
-	float kd = 1.5;
-			
-	float error = goalDist - measDist;
-			
-	float derivative = 0;
-	static float lastError = 0;
-			
-	derivative = error - lastError;
-			
+	
+	PD_GAINS gains;
+	gain_schedule( wall_schedule, base_speed, &params.wall_gains, &gains );
+	
+	// Wall_Corner() has the wheel while going round a corner.
+	if ( corner.phase != CORNER_NONE ) {
+		return;
+	}
+	
+	Wall_estimate( pSensors );
+	
+	if ( !wall_state.valid ) {
+		return;
+	}
+	
+	k_dist = gains.kp * 1.41;
+	wn = sqrt( 2 * v * ( k_dist * CM_PER_STEP ) / WHEEL_BASE_CM );
+	k_angle = WALL_ZETA * wn * WHEEL_BASE_CM / CM_PER_STEP;
+	
 	pAction->state = WALL_FOLLOWING;
-			
-	turn = kp * error + kd * derivative;
-			
+	
+	turn = k_dist * ( WALL_GOAL_PERP - wall_state.dist ) + k_angle * wall_state.angle;
+	
 	pAction->speed_L = base_speed - turn;
 	pAction->speed_R = base_speed + turn;
-			
-	lastError = error;
-			
+	
 } // end Wall_Follow()
+
+// --------------------------------------------------------------------------------------------------------------------------- //	
+void Wall_Corner( volatile MOTOR_ACTION *pAction, volatile SENSOR_DATA *pSensors ) {
+	
+	// When the wall ends the range jumps and the PD terms would spin the bot
+	// in place.  Instead, run on until we're level with the end of the wall,
+	// then arc around it at the goal distance:
+	//
+	//		speed_L / speed_R = ( R + W/2 ) / ( R - W/2 )
+	//
+	// Progress is measured off odometry every pass, so nothing blocks.  Once
+	// the sonar sees the new face at about the goal range for a couple of
+	// readings, hand the wheel back to Wall_Follow().
+	float base_speed = WALL_BASE_SPEED;
+	float radius = WALL_GOAL_PERP;
+	float travel_cm;
+	float r = pSensors->sonar_dist;
+	float dev;
+	
+	if ( corner.phase == CORNER_NONE ) {
+		return;
+	}
+	
+	pAction->state = WALL_FOLLOWING;
+	
+	travel_cm = ( ( odometry.left_msteps - corner.start_left ) +
+				  ( odometry.right_msteps - corner.start_right ) ) / 2000.0 * CM_PER_STEP;
+	
+	// Until the arc picks up the new face, the beam is looking into the
+	// open corner and the range says nothing about how far we've strayed.
+	// From the first settled reading on, every fresh reading counts toward
+	// the worst deviation.
+	if ( pSensors->sonar_seq != corner.last_seq ) {
+		
+		corner.last_seq = pSensors->sonar_seq;
+		dev = CORNER_SETTLE_CM;
+		
+		if ( r > 0 ) {
+			dev = ( r - WALL_GOAL_DIST ) / 1.41;
+			if ( dev < 0 ) {
+				dev = -dev;
+			}
+		}
+		
+		if ( ( corner.phase == CORNER_ARC ) && ( dev < CORNER_SETTLE_CM ) ) {
+			corner.found = true;
+		}
+		
+		if ( corner.found && ( r > 0 ) && ( dev > corner.max_dev ) ) {
+			corner.max_dev = dev;
+		}
+		
+		if ( corner.found && ( dev < CORNER_SETTLE_CM ) ) {
+			corner.settled++;
+		}
+		else {
+			corner.settled = 0;
+		}
+	}
+	
+	if ( corner.phase == CORNER_STRAIGHT ) {
+		
+		pAction->speed_L = base_speed;
+		pAction->speed_R = base_speed;
+		
+		if ( travel_cm >= corner.lead_cm ) {
+			corner.phase = CORNER_ARC;
+			corner.start_left = odometry.left_msteps;
+			corner.start_right = odometry.right_msteps;
+		}
+		return;
+	}
+	
+	// Settled, or gone round far enough that the wall isn't coming back.
+	if ( ( corner.settled >= CORNER_SETTLE_READS ) || ( travel_cm >= CORNER_MAX_ARC * radius ) ) {
+		corner.phase = CORNER_NONE;
+		corner.last_ms = odometry.time_ms - corner.start_ms;
+		return;
+	}
+	
+	// Wall is on the right, so turn right: left wheel on the outside.
+	pAction->speed_L = base_speed * ( radius + WHEEL_BASE_CM / 2 ) / radius;
+	pAction->speed_R = base_speed * ( radius - WHEEL_BASE_CM / 2 ) / radius;
+	
+} // end Wall_Corner()
 		
 // --------------------------------------------------------------------------------------------------------------------------- //
 void Line_Follow( volatile MOTOR_ACTION *pAction, volatile SENSOR_DATA *pSensors ) {
@@ -626,26 +1916,31 @@ void Line_Follow( volatile MOTOR_ACTION *pAction, volatile SENSOR_DATA *pSensors
 	float leftVoltage = pSensors->left_line_voltage;
 	float rightVoltage = pSensors->right_line_voltage;
 	
-	float base_speed = 150;
+	float base_speed = course.base_speed;
 	
-	float line_threshold = 1.5;
-	float exit_threshold = 3.0;
+	float line_threshold = params.line_threshold;
+	float exit_threshold = params.exit_threshold;
 		
 	int turn = 0;
 	
-	float kp = 70;
-	float kd = 100;	
+	PD_GAINS gains;
+	gain_schedule( line_schedule, base_speed, &params.line_gains, &gains );
 	
-	static bool following = false;
+	float kp = gains.kp;
+	float kd = gains.kd;
 
 	if ( ( leftVoltage > exit_threshold ) && ( rightVoltage > exit_threshold ) ) {
-		following = false;
+		// Line just dropped out from under us -- let Line_Search() go look for it.
+		if ( line_track.following ) {
+			line_track.lost = true;
+		}
+		line_track.following = false;
 	}
 	if ( ( leftVoltage < line_threshold ) && ( rightVoltage - 1.5 < line_threshold ) ) {
-		following = true;
+		line_track.following = true;
 	}
 	
-	if ( following ) {
+	if ( line_track.following ) {
 		
 		pAction->state = LINE_FOLLOWING;
 		
@@ -663,11 +1958,299 @@ void Line_Follow( volatile MOTOR_ACTION *pAction, volatile SENSOR_DATA *pSensors
 		pAction->speed_L = base_speed + turn;
 		pAction->speed_R = base_speed - turn;
 		
+		// Remember which side the line was on in case we lose it.
+		if ( error > 0 ) {
+			line_track.last_dir = 1;
+		}
+		else if ( error < 0 ) {
+			line_track.last_dir = -1;
+		}
+		
+		// Hand the error size to the course learner.
+		float err_mag = ( ( error < 0 ) ? -error : error ) * COURSE_ERR_SCALE;
+		line_track.err_mag = ( err_mag > 255 ) ? 255 : (unsigned char) err_mag;
+		
 		lastError = error;
 	}
 	
 } // end Line_Follow
 
+// --------------------------------------------------------------------------------------------------------------------------- //
+void Line_Search( volatile MOTOR_ACTION *pAction ) {
+	
+	// Sweeps an arc toward the side the line was last seen on.  The arc starts
+	// tight and opens up every SEARCH_TICK_MS, so the bot spirals outward until
+	// Line_Follow() picks the line back up or SEARCH_TIMEOUT_MS runs out.  The
+	// timer paces the arc -- nothing in here blocks.
+	static BOOL timer_started = FALSE;
+	static TIMEROBJ search_timer;
+	
+	signed short inner;
+	
+	if ( timer_started == FALSE ) {
+		TMRSRVC_new( &search_timer, TMRFLG_NOTIFY_FLAG, TMRTCM_RESTART, SEARCH_TICK_MS );
+		timer_started = TRUE;
+	}
+	
+	// Line_Follow() has the line again -- hand control straight back.
+	if ( line_track.following ) {
+		if ( line_track.lost ) {
+			line_track.reacquire_ms = line_track.search_ticks * SEARCH_TICK_MS;
+		}
+		line_track.lost = false;
+		line_track.search_ticks = 0;
+		return;
+	}
+	
+	if ( !line_track.lost ) {
+		return;
+	}
+	
+	if ( TIMER_ALARM( search_timer ) ) {
+		line_track.search_ticks++;
+		TIMER_SNOOZE( search_timer );
+	}
+	
+	// Time's up -- give up and let Cruise() drive.
+	if ( line_track.search_ticks >= ( SEARCH_TIMEOUT_MS / SEARCH_TICK_MS ) ) {
+		line_track.lost = false;
+		line_track.search_ticks = 0;
+		return;
+	}
+	
+	inner = SEARCH_INNER_START + SEARCH_INNER_STEP * line_track.search_ticks;
+	if ( inner > SEARCH_SPEED ) {
+		inner = SEARCH_SPEED;
+	}
+	
+	pAction->state = LINE_SEARCHING;
+	
+	// Line was to the right -- left wheel on the outside of the arc.
+	if ( line_track.last_dir > 0 ) {
+		pAction->speed_L = SEARCH_SPEED;
+		pAction->speed_R = inner;
+	}
+	else {
+		pAction->speed_L = inner;
+		pAction->speed_R = SEARCH_SPEED;
+	}
+	
+} // end Line_Search
+
+// --------------------------------------------------------------------------------------------------------------------------- //
+void Course_Learn( void ) {
+	
+	// First lap: record the peak line error for every COURSE_BIN_STEPS of
+	// track.  A lap is over once the heading has wound through a full turn,
+	// which holds for any simple closed course no matter its length.  After
+	// that: look a couple of bins ahead and speed up on straights, slow down
+	// before the curves we know are coming.
+	signed long dist = ODOM_DIST( odometry );
+	signed long heading = ODOM_HEADING( odometry );
+	signed long turned;
+	unsigned short bin;
+	unsigned char peak;
+	unsigned char i;
+	
+	switch ( course.mode ) {
+		
+		case COURSE_OFF:
+		break;
+		
+		case COURSE_WAITING:
+		if ( line_track.following ) {
+			for ( i = 0; i < COURSE_BINS; i++ ) {
+				course.profile[ i ] = 0;
+			}
+			course.lap_start = dist;
+			course.lap_heading = heading;
+			course.lap_start_ms = odometry.time_ms;
+			course.mode = COURSE_LEARNING;
+		}
+		break;
+		
+		case COURSE_LEARNING:
+		case COURSE_RACING:
+		
+		bin = ( dist - course.lap_start ) / COURSE_BIN_STEPS;
+		if ( bin >= COURSE_BINS ) {
+			bin = COURSE_BINS - 1;
+		}
+		
+		turned = heading - course.lap_heading;
+		if ( labs( turned ) >= COURSE_LAP_TURN ) {
+			
+			// Lap complete.
+			if ( course.mode == COURSE_LEARNING ) {
+				course.n_bins = bin + 1;
+				course.mode = COURSE_RACING;
+			}
+			course.lap_start = dist;
+			course.lap_heading += ( turned > 0 ) ? COURSE_LAP_TURN : -COURSE_LAP_TURN;
+			course.last_lap_ms = odometry.time_ms - course.lap_start_ms;
+			course.lap_start_ms = odometry.time_ms;
+			course.laps++;
+			bin = 0;
+		}
+		
+		if ( course.mode == COURSE_LEARNING ) {
+			if ( line_track.following && ( line_track.err_mag > course.profile[ bin ] ) ) {
+				course.profile[ bin ] = line_track.err_mag;
+			}
+			break;
+		}
+		
+		// Odometry drifts a little every lap -- don't run off the profile.
+		if ( bin >= course.n_bins ) {
+			bin = course.n_bins - 1;
+		}
+		
+		peak = 0;
+		for ( i = 0; i <= COURSE_LOOKAHEAD; i++ ) {
+			if ( course.profile[ ( bin + i ) % course.n_bins ] > peak ) {
+				peak = course.profile[ ( bin + i ) % course.n_bins ];
+			}
+		}
+		
+		if ( peak <= COURSE_STRAIGHT_ERR ) {
+			course.base_speed = COURSE_FAST_SPEED;
+		}
+		else if ( peak >= COURSE_CURVE_ERR ) {
+			course.base_speed = COURSE_SLOW_SPEED;
+		}
+		else {
+			course.base_speed = COURSE_FAST_SPEED - ( COURSE_FAST_SPEED - COURSE_SLOW_SPEED ) *
+								( peak - COURSE_STRAIGHT_ERR ) / ( COURSE_CURVE_ERR - COURSE_STRAIGHT_ERR );
+		}
+		break;
+	}
+	
+} // end Course_Learn
+
+// --------------------------------------------------------------------------------------------------------------------------- //
+void Auto_Tune( volatile MOTOR_ACTION *pAction, volatile SENSOR_DATA *pSensors ) {
+	
+	// Relay feedback: instead of PD, turn a fixed amount toward the line (or
+	// away from the wall) and flip direction whenever the error crosses zero.
+	// That holds the loop in a steady oscillation at its ultimate period Tu,
+	// and the oscillation amplitude 'a' gives the ultimate gain:
+	//
+	//		Ku = 4 * d / ( pi * sqrt( a^2 - eps^2 ) )
+	//
+	// for a relay of amplitude d with hysteresis eps.  The PD gains then
+	// follow Ziegler-Nichols: kp = 0.8 * Ku, Td = Tu / 8.  This runs as a
+	// behavior like any other, so sensing never stops.  Periods are timed
+	// on the odometry clock, which counts every tick in the timer interrupt,
+	// so a slow pass only shifts a flip to the next pass -- it can't lose
+	// time from a period.
+	float error;
+	float relay_d;
+	float hyst;
+	float amp;
+	float ku;
+	unsigned long now = odometry.time_ms;
+	unsigned long tu;
+	unsigned short sample_ms;
+	PD_GAINS *pGains;
+	
+	if ( tuner.phase != TUNE_RUNNING ) {
+		return;
+	}
+	
+	if ( tuner.target == TUNE_LINE ) {
+		
+		// Only while we're actually on the line.
+		if ( !line_track.following ) {
+			return;
+		}
+		error = pSensors->left_line_voltage - ( pSensors->right_line_voltage - 1.5 );
+		relay_d = TUNE_RELAY_LINE;
+		hyst = TUNE_HYST_LINE;
+		sample_ms = LINE_SENSE_MS;
+		pGains = &params.line_gains;
+	}
+	else {
+		error = WALL_GOAL_DIST - pSensors->sonar_dist;
+		relay_d = TUNE_RELAY_WALL;
+		hyst = TUNE_HYST_WALL;
+		sample_ms = SONAR_SENSE_MS;
+		pGains = &params.wall_gains;
+	}
+	
+	if ( !tuner.started ) {
+		tuner.started = true;
+		tuner.start_ms = now;
+		tuner.cycle_start_ms = now;
+		tuner.relay = ( error >= 0 ) ? 1 : -1;
+		tuner.err_max = error;
+		tuner.err_min = error;
+	}
+	
+	if ( ( now - tuner.start_ms ) > TUNE_TIMEOUT_MS ) {
+		tuner.phase = TUNE_FAILED;
+		return;
+	}
+	
+	if ( error > tuner.err_max ) {
+		tuner.err_max = error;
+	}
+	if ( error < tuner.err_min ) {
+		tuner.err_min = error;
+	}
+	
+	// Relay with hysteresis.  Each flip to '+' closes one cycle.
+	if ( ( tuner.relay < 0 ) && ( error > hyst ) ) {
+		
+		tuner.relay = 1;
+		
+		if ( tuner.cycles >= TUNE_SKIP_CYCLES ) {
+			tuner.period_sum += now - tuner.cycle_start_ms;
+			tuner.amp_sum += ( tuner.err_max - tuner.err_min ) / 2;
+		}
+		tuner.cycles++;
+		tuner.cycle_start_ms = now;
+		tuner.err_max = error;
+		tuner.err_min = error;
+	}
+	else if ( ( tuner.relay > 0 ) && ( error < -hyst ) ) {
+		tuner.relay = -1;
+	}
+	
+	if ( tuner.cycles >= ( TUNE_SKIP_CYCLES + TUNE_CYCLES ) ) {
+		
+		amp = tuner.amp_sum / TUNE_CYCLES;
+		tu = tuner.period_sum / TUNE_CYCLES;
+		
+		if ( amp <= hyst ) {
+			tuner.phase = TUNE_FAILED;
+			return;
+		}
+		
+		ku = ( 4 * relay_d ) / ( M_PI * sqrt( amp * amp - hyst * hyst ) );
+		
+		// The PD loops take their derivative once per sensor update, so
+		// Td goes in as a number of samples.
+		pGains->kp = 0.8 * ku;
+		pGains->kd = pGains->kp * tu / ( 8.0 * sample_ms );
+		
+		params_save();
+		tuner.phase = TUNE_DONE;
+		return;
+	}
+	
+	pAction->state = AUTO_TUNING;
+	
+	if ( tuner.target == TUNE_LINE ) {
+		pAction->speed_L = LINE_BASE_SPEED + tuner.relay * relay_d;
+		pAction->speed_R = LINE_BASE_SPEED - tuner.relay * relay_d;
+	}
+	else {
+		pAction->speed_L = WALL_BASE_SPEED - tuner.relay * relay_d;
+		pAction->speed_R = WALL_BASE_SPEED + tuner.relay * relay_d;
+	}
+	
+} // end Auto_Tune
+
 // --------------------------------------------------------------------------------------------------------------------------- //		
 void act( volatile MOTOR_ACTION *pAction )
 {
@@ -688,6 +2271,7 @@ void act( volatile MOTOR_ACTION *pAction )
 		// Perform the action.  Just call the 'free-running' version
 		// of stepper move function and feed these same parameters.
 		__MOTOR_ACTION( *pAction );
+		odometry_drive( pAction->speed_L, pAction->speed_R, pAction->accel_L, pAction->accel_R );
 
 		// Save the previous action.
 		previous_action = *pAction;
@@ -707,25 +2291,49 @@ void CBOT_main( void )
 	//STOPWATCH_open();
 	LED_open();     // Open the LED subsystem module.
 	LCD_open();     // Open the LCD subsystem module.
+	LCD_fb_init();
 	STEPPER_open(); // Open the STEPPER subsystem module.
 	ADC_open();
 	ADC_set_VREF(ADC_VREF_AVCC);	// set ADC reference to 5V
 	//USONIC_open();
+	
+	Telemetry_init();
+
+	// Pick up the saved parameters, including any auto-tuned gains.
+	params_load();
 			
 	// Reset the current motor action.
 	__RESET_ACTION( action );
 			
 	// Notify program is about to start.
-	LCD_printf( "Starting...\n" );
+	LCD_fb_puts( 0, 0, "Starting..." );
+	LCD_fb_sync();
 			
 	// Wait 3 seconds or so.
 	TMRSRVC_delay( TMR_SECS( 3 ) );
+	
+	// Holding S4 through the countdown turns on course learning.
+	course.base_speed = LINE_BASE_SPEED;
+	if ( ATTINY_get_sensors() & SNSR_SW4_STATE ) {
+		course.mode = COURSE_WAITING;
+	}
+	
+	// Holding S5 auto-tunes the line gains, S3 the wall gains.
+	if ( ATTINY_get_sensors() & SNSR_SW5_STATE ) {
+		tuner.target = TUNE_LINE;
+		tuner.phase = TUNE_RUNNING;
+	}
+	else if ( ATTINY_get_sensors() & SNSR_SW3_STATE ) {
+		USONIC_open();
+		tuner.target = TUNE_WALL;
+		tuner.phase = TUNE_RUNNING;
+	}
 			
 	// Take initial ambient light sensor readings
 	//Photo_init( &sensor_data );
 			
 	// Clear the screen and enter the arbitration loop.
-	LCD_clear();
+	LCD_fb_clear();
 			
 	// Enter the 'arbitration' while() loop -- it is important that NONE
 	// of the behavior functions listed in the arbitration loop BLOCK!
@@ -734,19 +2342,30 @@ void CBOT_main( void )
 	// regarding motor action (or any action)).
 	while( 1 )
 	{
+		// Apply any tuning command that came in during the last pass.
+		Tuning_service();
+
 		// Sensing.
 		// (IR sense happens every 125ms).
 		IR_sense( &sensor_data, 125 );
 		//Photo_sense( &sensor_data, 250 );
-		//Sonar_sense( &sensor_data, 125 );
-		Line_sense( &sensor_data, 10 );
+		//Sonar_sense( &sensor_data, SONAR_SENSE_MS );
+		Line_sense( &sensor_data, LINE_SENSE_MS );
+		if ( tuner.target == TUNE_WALL ) {
+			Sonar_sense( &sensor_data, SONAR_SENSE_MS );
+		}
+		Odometry_sense( ODOM_INTERVAL_MS );
+		Course_Learn();
 				
 		// Behaviors.
 		Cruise( &action );
 		//Light_Follow( &action, &sensor_data );
 		//Sonar_Avoid( &action, &sensor_data );
 		//Wall_Follow( &action, &sensor_data );
+		//Wall_Corner( &action, &sensor_data );
+		Line_Search( &action );
 		Line_Follow( &action, &sensor_data );
+		Auto_Tune( &action, &sensor_data );
 		IR_avoid( &action, &sensor_data );
 				
 		// Perform the action of highest priority.
@@ -756,6 +2375,12 @@ void CBOT_main( void )
 		// except for 'ballistic' behaviors).  Technically this is sort of
 		// 'optional' as it does not constitute a 'behavior'.
 		info_display( &action );
+		
+		// Send whatever changed on the display, a few characters at a time.
+		LCD_flush( LCD_FLUSH_MS );
+
+		// Queue a telemetry frame for the UART to send in the background.
+		Telemetry_send( &action, &sensor_data, TLM_PERIOD_MS );
 				
 	} // end while()
 			
@@ -52,11 +52,45 @@
 //
 
 #include "capi324v221.h"
+#include <avr/eeprom.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
 
 // ---------------------- Defines:
 
 #define DEG_90  150     /* Number of steps for a 90-degree (in place) turn. */
 
+#define PIXY_MAX_BLOCKS     6       /* Blocks kept per Pixy frame. */
+#define PIXY_TICK_MS        5       /* Resolution of Pixy frame timing. */
+#define PIXY_WINDOW_MS      10      /* A frame is closed this long after its first block. */
+#define EVT_QUEUE_LEN       8       /* Events that can be waiting to be dispatched. */
+#define PIXY_NO_BLOCK       0xFF    /* pixy_select() found nothing. */
+#define PIXY_ALL_SIGS       0xFF    /* Signature mask that takes every signature. */
+
+// Desc: Area of a Pixy block, in pixels.
+#define PIXY_AREA( block ) \
+    ( ( unsigned long )( block ).size.width * ( block ).size.height )
+
+#define PIXY_CENTER_X       160     /* Center of the Pixy image, in pixels. */
+#define PIXY_CENTER_Y       120
+
+#define TRACK_LATENCY_MS    60      /* Exposure + processing + transfer, from capture to pixy_process(). */
+#define TRACK_ALPHA         0.5     /* Alpha-beta filter position gain. */
+#define TRACK_BETA          ( TRACK_ALPHA * TRACK_ALPHA / ( 2 - TRACK_ALPHA ) ) /* Benedict-Bordner: balances noise against lag in turns. */
+#define TRACK_LOST_MS       500     /* Time with no Pixy frames before the track is dropped. */
+
+#define RANGE_CAL_POINTS    6       /* Points in the blob size -> range table. */
+#define RANGE_CAL_FIRST_CM  20      /* Range of the first point... */
+#define RANGE_CAL_STEP_CM   15      /* ...and the spacing of the rest (20, 35, ... 95 cm). */
+#define RANGE_CAL_SAMPLES   10      /* Pixy frames averaged per calibration point. */
+#define RANGE_CAL_TIMEOUT_MS 3000    /* A point that can't get its samples in this long fails the calibration. */
+#define RANGE_CAL_MAGIC     0x5A3C  /* Marks a valid calibration in EEPROM. */
+
+#define FOLLOW_STANDOFF_CM  40      /* Distance to hold from the target. */
+#define FOLLOW_ZONE_CM      3       /* Range dead zone around the standoff. */
+#define FOLLOW_KP_RANGE     5       /* Steps/sec of forward speed per cm of range error. */
+#define FOLLOW_MAX_SPEED    200     /* Fastest the robot closes on / backs off from the target. */
+
 
 // Desc: This macro-function can be used to reset a motor-action structure
 //       easily.  It is a helper macro-function.
@@ -118,18 +152,129 @@ typedef struct SENSOR_DATA_TYPE {
 
     BOOL left_IR;           // Holds the state of the left IR.
     BOOL right_IR;          // Holds the state of the right IR.
-    PIXY_DATA pixy_data;    // Holds relevant PIXY tracking data.
+    PIXY_DATA pixy_data;    // Holds relevant PIXY tracking data (the selected block).
+    unsigned short int pixy_frame;  // Number of the frame it came from.
+    unsigned short int pixy_ms;     // Pixy clock when that frame closed.
+    unsigned char pixy_blocks;      // Blocks in that frame.
+    unsigned char pixy_seq;         // Publish count when it was read.
 
     // *** Add your -own- parameters here. 
 
 } SENSOR_DATA;
 
+// Desc: Alpha-beta filter state for one image axis.  Position is in pixels
+//       from the image center and velocity in pixels per ms, so frames
+//       that come late or get dropped don't throw it off.
+typedef struct AB_AXIS_TYPE {
+
+    float pos;              // Filtered position.
+    float vel;              // Filtered velocity.
+
+} AB_AXIS;
+
+// Desc: Estimated state of the target being followed.
+typedef struct TARGET_TRACK_TYPE {
+
+    AB_AXIS x;              // Right of center is positive.
+    AB_AXIS range;          // Distance to the target, in cm.
+    BOOL valid;             // TRUE once the filter has been seeded.
+    unsigned short int time_ms; // Pixy clock of the frame last filtered.
+    signed short int speed_L;   // Follow command from the last frame, held
+    signed short int speed_R;   // until the next one.
+
+} TARGET_TRACK;
+
+// Desc: Blob size -> range calibration.  'size[ i ]' is the apparent size
+//       (in pixels) of the target at RANGE_CAL_FIRST_CM + i * RANGE_CAL_STEP_CM,
+//       so it shrinks from one entry to the next.
+typedef struct RANGE_CAL_TYPE {
+
+    unsigned short int magic;                       // RANGE_CAL_MAGIC when valid.
+    unsigned short int size[ RANGE_CAL_POINTS ];    // Apparent size at each range.
+
+} RANGE_CAL;
+
+// Desc: The blocks the Pixy reported in one frame, with a running frame
+//       number so consumers can tell frames apart (and count any they
+//       missed).
+typedef struct PIXY_FRAME_TYPE {
+
+    PIXY_DATA block[ PIXY_MAX_BLOCKS ];     // Blocks, in the order they came in.
+    unsigned char n_blocks;                 // How many.
+    unsigned short int frame;               // Frame number, counting from 1.
+    unsigned short int time_ms;             // Pixy clock when it closed.
+
+} PIXY_FRAME;
+
+// Desc: Frame rate and loss counters for the Pixy handoff.  The 8-bit
+//       counters are bumped from the interrupt, so they're kept to a size
+//       that can be read in one go.
+typedef struct PIXY_STATS_TYPE {
+
+    unsigned short int frames;      // Frames closed.
+    unsigned char fps;              // Frames closed in the last second.
+    unsigned short int dropped;     // Frames replaced before a behavior read them.
+    unsigned char overflow;         // Blocks that didn't fit in a frame's table.
+    unsigned char lost_events;      // Events the queue had no room for.
+    unsigned short int age_ms;      // Time since the last frame closed.
+
+} PIXY_STATS;
+
+// Desc: Events posted from interrupt context for the main loop to handle.
+typedef enum EVENT_TYPE {
+
+    EVT_NONE = 0,           // Queue is empty.
+    EVT_PIXY_BLOCK,         // First block of a new Pixy frame came in.
+
+} EVENT;
+
+// Desc: How 'pixy_select()' picks one block out of a frame.
+typedef enum PIXY_SELECT_TYPE {
+
+    SELECT_LARGEST = 0,     // Biggest area.
+    SELECT_NEAREST,         // Same signature as last time, closest to where it was.
+    SELECT_PRIORITY,        // Lowest signature number, then biggest area.
+
+} PIXY_SELECT;
+
 // ---------------------- Globals:
 volatile MOTOR_ACTION action;  	// This variable holds parameters that determine
                           		// the current action that is taking place.
 						  		// Here, a structure named "action" of type 
 						  		// MOTOR_ACTION is declared.
 
+// Events from interrupts.  One producer (the interrupt) moves the tail,
+// one consumer (the main loop) moves the head, and both are single bytes,
+// so neither side needs to lock the other out.
+volatile EVENT evt_queue[ EVT_QUEUE_LEN ];
+volatile unsigned char evt_head;
+volatile unsigned char evt_tail;
+
+// Pixy handoff.  The driver writes each block into 'pixy_rx' and calls
+// 'pixy_callback()' from its interrupt, which adds it to the frame being
+// collected in 'pixy_buf[ pixy_collect ]'.  The driver doesn't mark frame
+// boundaries, so the first block of each frame posts EVT_PIXY_BLOCK, and
+// 'pixy_frame_close()' closes the frame PIXY_WINDOW_MS later from the main
+// loop by flipping 'pixy_collect' -- a single byte write, so the interrupt
+// is always adding to one whole table or the other.
+PIXY_DATA pixy_rx;                      // Driver's landing spot.
+volatile PIXY_FRAME pixy_buf[ 2 ];      // Frame being collected, and the last one closed.
+volatile unsigned char pixy_collect;    // Index of the frame being collected.
+unsigned char pixy_front;               // Index of the last frame closed.
+unsigned char pixy_seq;                 // Bumped every time a frame is closed.
+unsigned short int pixy_window_ms;      // Time left before the frame is closed, 0 if none open.
+unsigned short int pixy_clock_ms;       // Time counted off by pixy_frame_close(), ms (wraps).
+volatile unsigned short int pixy_ticks; // PIXY_TICK_MS ticks not counted off yet (from the interrupt).
+volatile PIXY_STATS pixy_stats;         // Frame rate and loss counters.
+
+TARGET_TRACK target;            // Filtered Pixy target.
+
+RANGE_CAL range_cal = {         // Size -> range table in use.  Until
+    RANGE_CAL_MAGIC,            // it's calibrated, a rough guess for
+    { 80, 46, 32, 25, 20, 17 }  // a ~5 cm target (size ~ 1600 / cm).
+};
+RANGE_CAL EEMEM range_cal_store;    // Saved calibration.
+
 // ---------------------- Prototypes:
 void IR_sense( volatile SENSOR_DATA *pSensors, TIMER16 interval_ms );
 void cruise( volatile MOTOR_ACTION *pAction );
@@ -141,6 +286,24 @@ void act( volatile MOTOR_ACTION *pAction );
 void info_display( volatile MOTOR_ACTION *pAction );
 void pixy_test_display( volatile SENSOR_DATA *pSensors );
 BOOL compare_actions( volatile MOTOR_ACTION *a, volatile MOTOR_ACTION *b );
+BOOL event_post( EVENT event );
+EVENT event_get( void );
+void events_dispatch( void );
+void pixy_callback( PIXY_DATA *pData );
+void pixy_tick( void );
+void pixy_frame_close( TIMER16 interval_ms );
+unsigned char pixy_select( volatile PIXY_FRAME *pFrame, PIXY_SELECT policy,
+                           unsigned char sig_mask, volatile PIXY_DATA *pLast );
+BOOL pixy_read( volatile SENSOR_DATA *pSensors, PIXY_SELECT policy,
+                unsigned char sig_mask );
+void track_update( AB_AXIS *pAxis, float measured, unsigned short int dt_ms );
+float track_predict( AB_AXIS *pAxis, unsigned short int latency_ms );
+unsigned short int blob_size( volatile PIXY_DATA *pData );
+float range_from_size( unsigned short int size );
+void range_cal_load( void );
+void range_calibrate( volatile SENSOR_DATA *pSensors );
+void range_cal_fail( const char *why );
+void wait_button( unsigned char mask );
 
 // ---------------------- Convenience Functions:
 void info_display( volatile MOTOR_ACTION *pAction )
@@ -238,6 +401,481 @@ BOOL compare_actions( volatile MOTOR_ACTION *a, volatile MOTOR_ACTION *b )
     return rval;
 
 } // end compare_actions()
+// ----------------------------------------------------- //
+BOOL event_post( EVENT event )
+{
+
+    // Safe to call from an interrupt.  Returns FALSE (and counts it) if
+    // the queue is full.
+    unsigned char next = ( evt_tail + 1 ) % EVT_QUEUE_LEN;
+
+    if ( next == evt_head )
+    {
+
+        pixy_stats.lost_events++;
+        return FALSE;
+
+    } // end if()
+
+    evt_queue[ evt_tail ] = event;
+    evt_tail = next;
+
+    return TRUE;
+
+} // end event_post()
+// ----------------------------------------------------- //
+EVENT event_get( void )
+{
+
+    EVENT event;
+
+    if ( evt_head == evt_tail )
+        return EVT_NONE;
+
+    event = evt_queue[ evt_head ];
+    evt_head = ( evt_head + 1 ) % EVT_QUEUE_LEN;
+
+    return event;
+
+} // end event_get()
+// ----------------------------------------------------- //
+void events_dispatch( void )
+{
+
+    // Handles everything the interrupts have posted since last time.
+    EVENT event;
+
+    while( ( event = event_get() ) != EVT_NONE )
+    {
+
+        switch( event )
+        {
+
+            case EVT_PIXY_BLOCK:
+                // Give the rest of the frame's blocks time to come in.
+                if ( pixy_window_ms == 0 )
+                    pixy_window_ms = PIXY_WINDOW_MS;
+            break;
+
+            default:
+            break;
+
+        } // end switch()
+
+    } // end while()
+
+} // end events_dispatch()
+// ----------------------------------------------------- //
+void pixy_callback( PIXY_DATA *pData )
+{
+
+    // NOTE: Runs in the Pixy driver's interrupt -- keep it short.
+    volatile PIXY_FRAME *pFrame = &pixy_buf[ pixy_collect ];
+    unsigned char i;
+    unsigned char smallest;
+
+    if ( pFrame->n_blocks < PIXY_MAX_BLOCKS )
+    {
+
+        // First block of a frame -- let the main loop know one's started.
+        if ( pFrame->n_blocks == 0 )
+            event_post( EVT_PIXY_BLOCK );
+
+        pFrame->block[ pFrame->n_blocks++ ] = *pData;
+        return;
+
+    } // end if()
+
+    pixy_stats.overflow++;
+
+    // Table's full -- this block only gets in if it's bigger than the
+    // smallest one there.
+    smallest = 0;
+    for ( i = 1; i < PIXY_MAX_BLOCKS; i++ )
+    {
+
+        if ( PIXY_AREA( pFrame->block[ i ] ) < PIXY_AREA( pFrame->block[ smallest ] ) )
+            smallest = i;
+
+    } // end for()
+
+    if ( PIXY_AREA( *pData ) > PIXY_AREA( pFrame->block[ smallest ] ) )
+        pFrame->block[ smallest ] = *pData;
+
+} // end pixy_callback()
+// ----------------------------------------------------- //
+void pixy_tick( void )
+{
+
+    // Timer callback -- runs in the timer interrupt, so frame timing keeps
+    // up however long a trip around the loop takes.
+    pixy_ticks++;
+
+} // end pixy_tick()
+// ----------------------------------------------------- //
+void pixy_frame_close( TIMER16 interval_ms )
+{
+
+    // Counts off the ticks since the last call: closes the open frame once
+    // its window runs out, and keeps the frame rate and age counters.
+    static BOOL timer_started = FALSE;
+    static TIMEROBJ frame_timer;
+    static unsigned short int second_ms = 0;
+    static unsigned short int second_frames = 0;
+    unsigned char closing;
+    unsigned char sreg;
+    unsigned short int elapsed;
+
+    if ( timer_started == FALSE )
+    {
+
+        TMRSRVC_REGISTER_CBFUNC( frame_timer, pixy_tick );
+        TMRSRVC_new( &frame_timer, TMRFLG_NOTIFY_FUNC, TMRTCM_RESTART,
+            interval_ms );
+
+        timer_started = TRUE;
+        return;
+
+    } // end if()
+
+    sreg = SREG;
+    cli();
+    elapsed = pixy_ticks * interval_ms;
+    pixy_ticks = 0;
+    SREG = sreg;
+
+    if ( elapsed == 0 )
+        return;
+
+    pixy_clock_ms += elapsed;
+
+    if ( pixy_stats.age_ms < 0xFFFF - elapsed )
+        pixy_stats.age_ms += elapsed;
+    else
+        pixy_stats.age_ms = 0xFFFF;
+
+    // Frames over however long it's been, so a late call doesn't skew it.
+    second_ms += elapsed;
+    if ( second_ms >= 1000 )
+    {
+
+        pixy_stats.fps = ( unsigned long )( pixy_stats.frames - second_frames ) * 1000 / second_ms;
+        second_frames = pixy_stats.frames;
+        second_ms = 0;
+
+    } // end if()
+
+    if ( pixy_window_ms == 0 )
+        return;
+
+    if ( pixy_window_ms > elapsed )
+    {
+
+        pixy_window_ms -= elapsed;
+        return;
+
+    } // end if()
+
+    // It closed when the window ran out, which may have been a tick or two ago.
+    pixy_stats.age_ms = elapsed - pixy_window_ms;
+    pixy_window_ms = 0;
+    closing = pixy_collect;
+
+    // Empty the other table, then point the interrupt at it.
+    pixy_buf[ closing ^ 1 ].n_blocks = 0;
+    pixy_collect = closing ^ 1;
+
+    pixy_buf[ closing ].frame = ++pixy_stats.frames;
+    pixy_buf[ closing ].time_ms = pixy_clock_ms - pixy_stats.age_ms;
+    pixy_front = closing;
+    pixy_seq++;
+
+} // end pixy_frame_close()
+// ----------------------------------------------------- //
+unsigned char pixy_select( volatile PIXY_FRAME *pFrame, PIXY_SELECT policy,
+                           unsigned char sig_mask, volatile PIXY_DATA *pLast )
+{
+
+    // Picks one block out of 'pFrame' by 'policy', only looking at blocks
+    // whose signature bit is set in 'sig_mask'.  Returns its index, or
+    // PIXY_NO_BLOCK.
+    unsigned char i;
+    unsigned char best = PIXY_NO_BLOCK;
+    unsigned long score;
+    unsigned long best_score = 0;
+    volatile PIXY_DATA *pBlock;
+
+    for ( i = 0; i < pFrame->n_blocks; i++ )
+    {
+
+        pBlock = &pFrame->block[ i ];
+
+        if ( ( pBlock->signum > 7 ) || !( sig_mask & ( 1 << pBlock->signum ) ) )
+            continue;
+
+        switch( policy )
+        {
+
+            case SELECT_NEAREST:
+                // Closer scores higher.  Anything with another signature
+                // only wins if there's nothing with this one.
+                score = 0xFFFF - ( abs( pBlock->pos.x - pLast->pos.x ) +
+                                   abs( pBlock->pos.y - pLast->pos.y ) );
+                if ( pBlock->signum == pLast->signum )
+                    score += 0x10000UL;
+            break;
+
+            case SELECT_PRIORITY:
+                // Signature first, area to break ties.
+                score = ( ( unsigned long )( 8 - pBlock->signum ) << 17 ) +
+                        PIXY_AREA( *pBlock );
+            break;
+
+            default:
+                score = PIXY_AREA( *pBlock );
+
+        } // end switch()
+
+        if ( ( best == PIXY_NO_BLOCK ) || ( score > best_score ) )
+        {
+
+            best = i;
+            best_score = score;
+
+        } // end if()
+
+    } // end for()
+
+    return best;
+
+} // end pixy_select()
+// ----------------------------------------------------- //
+BOOL pixy_read( volatile SENSOR_DATA *pSensors, PIXY_SELECT policy,
+                unsigned char sig_mask )
+{
+
+    // If a frame has closed since the last read, picks a block out of it
+    // into 'pSensors->pixy_data' and returns TRUE.  Frames are closed from
+    // the main loop too, so the one in front stays put while we read it.
+    volatile PIXY_FRAME *pFrame = &pixy_buf[ pixy_front ];
+    unsigned char pick;
+
+    if ( pSensors->pixy_seq == pixy_seq )
+        return FALSE;
+
+    // Count any frames that came and went without being read.
+    if ( ( pSensors->pixy_frame != 0 ) &&
+         ( pFrame->frame - pSensors->pixy_frame > 1 ) )
+        pixy_stats.dropped += pFrame->frame - pSensors->pixy_frame - 1;
+
+    pSensors->pixy_seq = pixy_seq;
+    pSensors->pixy_frame = pFrame->frame;
+    pSensors->pixy_ms = pFrame->time_ms;
+    pSensors->pixy_blocks = pFrame->n_blocks;
+
+    pick = pixy_select( pFrame, policy, sig_mask, &pSensors->pixy_data );
+
+    if ( pick == PIXY_NO_BLOCK )
+        return FALSE;
+
+    pSensors->pixy_data = pFrame->block[ pick ];
+
+    return TRUE;
+
+} // end pixy_read()
+// ----------------------------------------------------- //
+void track_update( AB_AXIS *pAxis, float measured, unsigned short int dt_ms )
+{
+
+    // Predict where the target should be 'dt_ms' later, then correct
+    // position and velocity by a share of the miss.
+    float predicted;
+    float residual;
+
+    if ( dt_ms == 0 )
+        dt_ms = 1;
+
+    predicted = pAxis->pos + pAxis->vel * dt_ms;
+    residual = measured - predicted;
+
+    pAxis->pos = predicted + TRACK_ALPHA * residual;
+    pAxis->vel += TRACK_BETA * residual / dt_ms;
+
+} // end track_update()
+// ----------------------------------------------------- //
+float track_predict( AB_AXIS *pAxis, unsigned short int latency_ms )
+{
+
+    // The frame being processed is already 'latency_ms' old -- carry it
+    // forward to where the target is now.
+    return pAxis->pos + pAxis->vel * latency_ms;
+
+} // end track_predict()
+// ----------------------------------------------------- //
+unsigned short int blob_size( volatile PIXY_DATA *pData )
+{
+
+    // Use the larger side.  Unlike the centroid's 'y', this doesn't
+    // change with camera tilt, and it holds up better than the smaller
+    // side when the blob is clipped.
+    return ( pData->size.width > pData->size.height ) ?
+             pData->size.width : pData->size.height;
+
+} // end blob_size()
+// ----------------------------------------------------- //
+float range_from_size( unsigned short int size )
+{
+
+    // Apparent size goes as 1/range, so interpolate between table points
+    // in 1/size, which is close to linear in range.  Outside the table,
+    // clamp to the nearest end.
+    unsigned char i;
+    float inv;
+    float inv_near;
+    float inv_far;
+
+    if ( size >= range_cal.size[ 0 ] )
+        return RANGE_CAL_FIRST_CM;
+
+    if ( size <= range_cal.size[ RANGE_CAL_POINTS - 1 ] )
+        return RANGE_CAL_FIRST_CM + ( RANGE_CAL_POINTS - 1 ) * RANGE_CAL_STEP_CM;
+
+    for ( i = 0; size < range_cal.size[ i + 1 ]; i++ );
+
+    inv      = 1.0 / size;
+    inv_near = 1.0 / range_cal.size[ i ];
+    inv_far  = 1.0 / range_cal.size[ i + 1 ];
+
+    return RANGE_CAL_FIRST_CM + RANGE_CAL_STEP_CM *
+           ( i + ( inv - inv_near ) / ( inv_far - inv_near ) );
+
+} // end range_from_size()
+// ----------------------------------------------------- //
+void range_cal_load( void )
+{
+
+    RANGE_CAL saved;
+
+    // Keep the defaults unless there's a good calibration saved.
+    eeprom_read_block( &saved, &range_cal_store, sizeof( RANGE_CAL ) );
+
+    if ( saved.magic == RANGE_CAL_MAGIC )
+        range_cal = saved;
+
+} // end range_cal_load()
+// ----------------------------------------------------- //
+void wait_button( unsigned char mask )
+{
+
+    // Wait for a press and then the release, so one press is one press.
+    while( !( ATTINY_get_sensors() & mask ) );
+    while( ATTINY_get_sensors() & mask );
+
+} // end wait_button()
+// ----------------------------------------------------- //
+void range_calibrate( volatile SENSOR_DATA *pSensors )
+{
+
+    // Walks the user through putting the target at each range in the
+    // table and averages the blob size the Pixy sees there.  Only runs
+    // before the arbitration loop, so it's fine for it to block -- but not
+    // forever: S5 or a point with no target in view ends it, and the
+    // table in use isn't touched unless every point came out.
+    RANGE_CAL cal;
+    unsigned char i;
+    unsigned char n;
+    unsigned long total;
+    unsigned short int start_ms;
+    unsigned char buttons;
+
+    cal.magic = RANGE_CAL_MAGIC;
+
+    for ( i = 0; i < RANGE_CAL_POINTS; i++ )
+    {
+
+        LCD_clear();
+        LCD_printf( "Target at %d cm\n", RANGE_CAL_FIRST_CM + i * RANGE_CAL_STEP_CM );
+        LCD_printf( "then press S3\n" );
+        LCD_printf( "S5 cancels\n" );
+
+        while ( !( ( buttons = ATTINY_get_sensors() ) & ( SNSR_SW3_STATE | SNSR_SW5_STATE ) ) );
+        if ( buttons & SNSR_SW5_STATE )
+        {
+
+            range_cal_fail( "cancelled" );
+            return;
+
+        } // end if()
+        while( ATTINY_get_sensors() & SNSR_SW3_STATE );
+
+        total = 0;
+        start_ms = pixy_clock_ms;
+        for ( n = 0; n < RANGE_CAL_SAMPLES; )
+        {
+
+            events_dispatch();
+            pixy_frame_close( PIXY_TICK_MS );
+
+            if ( pixy_read( pSensors, SELECT_LARGEST, PIXY_ALL_SIGS ) == TRUE )
+            {
+
+                total += blob_size( &pSensors->pixy_data );
+                n++;
+
+            } // end if()
+
+            // No target in view, or the user has had enough.
+            if ( ATTINY_get_sensors() & SNSR_SW5_STATE )
+            {
+
+                range_cal_fail( "cancelled" );
+                return;
+
+            } // end if()
+
+            if ( ( unsigned short int )( pixy_clock_ms - start_ms ) >= RANGE_CAL_TIMEOUT_MS )
+            {
+
+                range_cal_fail( "no target" );
+                return;
+
+            } // end if()
+
+        } // end for()
+
+        cal.size[ i ] = total / RANGE_CAL_SAMPLES;
+
+        // Each point must be smaller than the one before it, or the
+        // table can't be searched.
+        if ( ( i > 0 ) && ( cal.size[ i ] >= cal.size[ i - 1 ] ) )
+        {
+
+            range_cal_fail( "size didn't shrink" );
+            return;
+
+        } // end if()
+
+    } // end for()
+
+    range_cal = cal;
+    eeprom_update_block( &cal, &range_cal_store, sizeof( RANGE_CAL ) );
+
+    LCD_clear();
+    LCD_printf( "Cal saved\n" );
+    TMRSRVC_delay( TMR_SECS( 1 ) );
+
+} // end range_calibrate()
+// ----------------------------------------------------- //
+void range_cal_fail( const char *why )
+{
+
+    // Nothing was saved and 'range_cal' wasn't touched, so the table in
+    // use before the calibration stays in use.
+    LCD_clear();
+    LCD_printf( "Cal not saved:\n%s\nold table kept\n", why );
+    TMRSRVC_delay( TMR_SECS( 2 ) );
+
+} // end range_cal_fail()
 
 // ---------------------- Top-Level Behaviorals:
 void IR_sense( volatile SENSOR_DATA *pSensors, TIMER16 interval_ms )
@@ -324,20 +962,44 @@ void pixy_process( volatile MOTOR_ACTION *pAction,
 {
 
     // Only process this behavior -if- there is NEW data from the pixy.
-    if( PIXY_has_data() )
+    // Stick with the object we're already tracking, if there is one.
+    if( pixy_read( pSensors, ( target.valid == TRUE ) ? SELECT_NEAREST : SELECT_LARGEST,
+                   PIXY_ALL_SIGS ) == TRUE )
     {
-		pAction->state = FOLLOWING;
-		
 		// For testing
 		//pixy_test_display( pSensors );
 		
-		int centerX = 160;
-		int centerY = 120;
-		int coordX = pSensors->pixy_data.pos.x - centerX;  // Right of center is positive
-		int coordY = -(pSensors->pixy_data.pos.y - centerY);  // Below center is negative
+		float measX = pSensors->pixy_data.pos.x - PIXY_CENTER_X;  // Right of center is positive
+		float measRange = range_from_size( blob_size( &pSensors->pixy_data ) );
+
+		// Time since the last frame filtered -- frames that were dropped or
+		// didn't have the target in them are part of it -- and the time since
+		// this one closed, on top of the pipeline latency.
+		unsigned short int dt_ms = pSensors->pixy_ms - target.time_ms;
+		unsigned short int lead_ms = TRACK_LATENCY_MS + pixy_stats.age_ms;
+
+		// Filter the centroid, or start over if we'd lost it.
+		if ( target.valid == FALSE )
+		{
+			target.x.pos = measX;
+			target.x.vel = 0;
+			target.range.pos = measRange;
+			target.range.vel = 0;
+			target.valid = TRUE;
+		}
+		else
+		{
+			track_update( &target.x, measX, dt_ms );
+			track_update( &target.range, measRange, dt_ms );
+		}
+		target.time_ms = pSensors->pixy_ms;
+
+		// Steer toward where the target is now, not where it was when
+		// the frame was taken.
+		int coordX = track_predict( &target.x, lead_ms );
+		int rangeErr = track_predict( &target.range, lead_ms ) - FOLLOW_STANDOFF_CM;
 		
 		// Speed
-		int kpy = 2;
 		int base_speed = 0;  // Bot is not moving by default
 		//int base_speed = 100;
 		
@@ -347,22 +1009,42 @@ void pixy_process( volatile MOTOR_ACTION *pAction,
 
 		// Dead zone logic
 		int zoneX = 15;
-		int zoneY = 15;
 		
         if ( abs(coordX) > zoneX ) {
 			// CEENBoT needs to turn left or right
 			turn = kpx * coordX;
         }
 
-		if ( abs(coordY) > zoneY ) {
-			// CEENBoT needs to move forward or back
-			base_speed = kpy * coordY;
+		if ( abs(rangeErr) > FOLLOW_ZONE_CM ) {
+			// CEENBoT needs to close in or back off to hold the standoff
+			base_speed = FOLLOW_KP_RANGE * rangeErr;
+			if ( base_speed > FOLLOW_MAX_SPEED )
+				base_speed = FOLLOW_MAX_SPEED;
+			else if ( base_speed < -FOLLOW_MAX_SPEED )
+				base_speed = -FOLLOW_MAX_SPEED;
 		}
 		
-		pAction->speed_L = base_speed + turn;
-		pAction->speed_R = base_speed - turn;
+		target.speed_L = base_speed + turn;
+		target.speed_R = base_speed - turn;
+
+    } // end if()
+
+    // Haven't seen it for a while -- don't trust the old velocity.
+    else if ( ( target.valid == TRUE ) && ( pixy_stats.age_ms >= TRACK_LOST_MS ) )
+    {
+
+        target.valid = FALSE;
 
-        PIXY_process_finished();
+    } // end else if()
+
+    // pixy_process() runs every trip around the loop but frames only come
+    // in every 20 ms -- keep following in between.
+    if ( target.valid == TRUE )
+    {
+
+        pAction->state = FOLLOWING;
+        pAction->speed_L = target.speed_L;
+        pAction->speed_R = target.speed_R;
 
     } // end if()
 
@@ -481,6 +1163,10 @@ void CBOT_main( void )
 {
 
     volatile SENSOR_DATA sensor_data;
+
+    // Nothing read from the Pixy yet.
+    sensor_data.pixy_frame = 0;
+    sensor_data.pixy_seq = 0;
     
     // ** Open the needed modules.
     LED_open();     // Open the LED subsystem module.
@@ -491,10 +1177,9 @@ void CBOT_main( void )
     if ( PIXY_open() == SUBSYS_OPEN )
     {
 
-        // Register the pixy structure, but NO callback.  The 'type casting'
-        // is to eliminate the warning from 'sensor_data' being declared 
-        // as 'volatile' above.
-        PIXY_register_callback( NULL, (PIXY_DATA *) &sensor_data.pixy_data );
+        // Register the callback and its landing structure.  Behaviors
+        // only ever see frames through 'pixy_read()'.
+        PIXY_register_callback( pixy_callback, &pixy_rx );
 
         // Start tracking.
         PIXY_track_start();
@@ -521,10 +1206,24 @@ void CBOT_main( void )
     // Wait 3 seconds or so.
     TMRSRVC_delay( TMR_SECS( 3 ) );
     
-    // Wait for S3 to enter the arbitration loop
+    // Pick up the saved size -> range calibration, if any.
+    range_cal_load();
+
+    // Wait for S3 to enter the arbitration loop.  S4 recalibrates the
+    // size -> range table first.
     LCD_clear();
-    LCD_printf( "Press S3 to begin\n" );
-    while( !(ATTINY_get_sensors() & SNSR_SW3_STATE ) );
+    LCD_printf( "Press S3 to begin\nS4 to calibrate\n" );
+    while( !(ATTINY_get_sensors() & SNSR_SW3_STATE ) )
+    {
+        if ( ATTINY_get_sensors() & SNSR_SW4_STATE )
+        {
+            wait_button( SNSR_SW4_STATE );
+            range_calibrate( &sensor_data );
+
+            LCD_clear();
+            LCD_printf( "Press S3 to begin\nS4 to calibrate\n" );
+        }
+    }
     LCD_clear();
     
     // Enter the 'arbitration' while() loop -- it is important that NONE
@@ -542,6 +1241,11 @@ void CBOT_main( void )
         // Behaviors.
         cruise( &action );
 
+        // Handle anything the interrupts posted, and group the Pixy's
+        // blocks into frames.
+        events_dispatch();
+        pixy_frame_close( PIXY_TICK_MS );
+
         // Process pixy data, _if_ there is new data to process.
         pixy_process( &action, &sensor_data );
         
@@ -556,8 +1260,6 @@ void CBOT_main( void )
         // except for 'ballistic' behaviors).  Technically this is sort of
         // 'optional' as it does not constitute a 'behavior'.
         info_display( &action );
-		
-		DELAY_ms(20);
         
     } // end while()
     
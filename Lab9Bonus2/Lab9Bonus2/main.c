@@ -52,11 +52,53 @@
 //
 
 #include "capi324v221.h"
+#include <string.h>
+#include <avr/pgmspace.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
 
 // ---------------------- Defines:
 
 #define DEG_90  150     /* Number of steps for a 90-degree (in place) turn. */
 
+#define PIXY_MAX_BLOCKS     6       /* Blocks kept per Pixy frame. */
+#define PIXY_TICK_MS        5       /* Resolution of Pixy frame timing. */
+#define PIXY_WINDOW_MS      10      /* A frame is closed this long after its first block. */
+#define PIXY_HOLD_MS        200     /* Behaviors keep acting on a frame this long. */
+#define EVT_QUEUE_LEN       8       /* Events that can be waiting to be dispatched. */
+#define PIXY_NO_BLOCK       0xFF    /* pixy_select() found nothing. */
+#define PIXY_ALL_SIGS       0xFF    /* Signature mask that takes every signature. */
+
+#define SPKR_TICK_MS    10      /* Resolution of the speaker sequencer. */
+#define SPKR_QUEUE_LEN  4       /* Songs that can be waiting to play. */
+
+#define NOTE_WHOLE      2000    /* Length of a whole note, in ms. */
+#define NOTE_SIXTEENTH  ( NOTE_WHOLE / 16 )
+#define NOTE_ARTIC_PCT  90      /* Percent of a note that sounds; the rest is silence. */
+
+// Desc: Songs are stored in flash as one 16-bit word per note:
+//       note (4 bits) | octave (3 bits) | length in sixteenths (9 bits).
+//       A rest is SPKR_NOTE_NONE.  These build and pick apart that word.
+#define SEQ_NOTE( note, octave, len16 ) \
+    ( ( ( unsigned short int )( note ) << 12 ) | \
+      ( ( unsigned short int )( octave ) << 9 ) | ( len16 ) )
+#define SEQ_REST( len16 )           SEQ_NOTE( SPKR_NOTE_NONE, 0, len16 )
+#define SEQ_NOTE_NOTE( word )       ( ( SPKR_NOTE )( ( word ) >> 12 ) )
+#define SEQ_NOTE_OCTAVE( word )     ( ( unsigned char )( ( ( word ) >> 9 ) & 0x07 ) )
+#define SEQ_NOTE_LEN( word )        ( ( word ) & 0x01FF )
+
+#define PIXY_SIGNATURES 8       /* Pixy color signatures are numbered 1-7. */
+#define REACT_TICK_MS   10      /* Resolution of the signature cooldowns. */
+#define REACT_MSG_LEN   48      /* Longest reaction message, with terminator. */
+
+// Desc: Area of a Pixy block, in pixels.
+#define PIXY_AREA( block ) \
+    ( ( unsigned long )( block ).size.width * ( block ).size.height )
+
+// Desc: Number of entries in a table -- keeps the counts in the song
+//       tables from drifting out of step with the notes.
+#define SEQ_COUNT( table )          ( sizeof( table ) / sizeof( ( table )[ 0 ] ) )
+
 
 // Desc: This macro-function can be used to reset a motor-action structure
 //       easily.  It is a helper macro-function.
@@ -93,6 +135,7 @@ typedef enum ROBOT_STATE_TYPE {
     CRUISING,      // 'Exploring' state -- the robot is 'roaming around'.
     AVOIDING,        // 'Avoiding' state -- the robot is avoiding a collision.
 	FOLLOWING,		// 'Following' state -- the robot is following a Pixy object
+	REACTING,		// 'Reacting' state -- the robot is reacting to a color signature
 
 } ROBOT_STATE;
 
@@ -118,29 +161,300 @@ typedef struct SENSOR_DATA_TYPE {
 
     BOOL left_IR;           // Holds the state of the left IR.
     BOOL right_IR;          // Holds the state of the right IR.
-    PIXY_DATA pixy_data;    // Holds relevant PIXY tracking data.
+    PIXY_DATA pixy_data;    // Holds relevant PIXY tracking data (the selected block).
+    unsigned short int pixy_frame;  // Number of the frame it came from.
+    unsigned char pixy_blocks;      // Blocks in that frame.
+    unsigned char pixy_seq;         // Publish count when it was read.
 
     // *** Add your -own- parameters here. 
 
 } SENSOR_DATA;
 
+// Desc: Songs for the speaker sequencer.  Same song -> measure -> note
+//       layering (with repeat counts) as SPKR_SONG/SPKR_MEASURE/SPKR_PLAYNOTE,
+//       but kept in flash (PROGMEM) and walked a note at a time from the
+//       main loop instead of handed to the blocking SPKR_play_song().
+//       Notes are encoded with SEQ_NOTE().
+typedef struct SEQ_MEASURE_TYPE {
+
+    const unsigned short int *notes;    // Notes in this measure (in flash).
+    unsigned char n_notes;          // How many.
+    unsigned char repeat;           // Times the measure is played.
+
+} SEQ_MEASURE;
+
+typedef struct SEQ_SONG_TYPE {
+
+    const SEQ_MEASURE *measures;    // Measures in this song (in flash).
+    unsigned char n_measures;       // How many.
+    unsigned char repeat;           // Times the song is played.
+
+} SEQ_SONG;
+
+// Desc: A non-blocking step move: each wheel turns 'steps' steps at its
+//       speed (the sign gives the direction), run by the 'react()' behavior,
+//       then control goes back to the lower behaviors.
+typedef struct MOTION_TYPE {
+
+    signed short int speed_L;       // SPEED for LEFT  motor.
+    signed short int speed_R;       // SPEED for RIGHT motor.
+    unsigned short int steps;       // Steps for each wheel.
+
+} MOTION;
+
+// Desc: What the robot does when it sees a color signature.  The table of
+//       these lives in flash and is indexed directly by signature number.
+typedef struct REACTION_TYPE {
+
+    const SEQ_SONG *song;           // Song to play (in flash), or NULL.
+    MOTION motion;                  // Motion to make, 'steps' of 0 for none.
+    const char *message;            // LCD message (in flash), or NULL.
+    unsigned short int cooldown_ms; // Ignore this signature for this long afterwards.
+
+} REACTION;
+
+// Desc: State of the reaction in progress, and how long until each
+//       signature is allowed to trigger again.
+typedef struct REACT_STATE_TYPE {
+
+    REACTION current;               // RAM copy of the reaction in progress.
+    unsigned char signum;           // Its signature, 0 if none.
+    BOOL moving;                    // TRUE until its step move is done.
+    BOOL started;                   // TRUE once the step move is under way.
+    unsigned short int cooldown_ms[ PIXY_SIGNATURES ];  // Per signature.
+    volatile unsigned short int ticks;  // Timer ticks not counted off yet (from the interrupt).
+
+} REACT_STATE;
+
+// Desc: Speaker sequencer state.  'speaker_service()' counts down the
+//       current note and moves on to the next one, pulling songs off the
+//       queue when one finishes.
+typedef struct SPKR_SEQ_TYPE {
+
+    const SEQ_SONG *queue[ SPKR_QUEUE_LEN ];    // Songs waiting to play.
+    unsigned char q_head;                       // Next song in the queue.
+    unsigned char q_count;                      // Songs in the queue.
+
+    const SEQ_SONG *song;           // Song playing now (in flash), NULL if idle.
+    SEQ_SONG song_info;             // RAM copy of '*song'.
+    SEQ_MEASURE measure_info;       // RAM copy of the current measure.
+    unsigned char song_pass;        // Times through the song so far.
+    unsigned char measure;          // Current measure.
+    unsigned char measure_pass;     // Times through the current measure so far.
+    unsigned char note;             // Current note.
+    unsigned short int on_ms;       // Time left sounding the current note.
+    unsigned short int off_ms;      // Time left in the silence after it.
+    volatile unsigned short int ticks;  // Timer ticks not counted off yet (from the interrupt).
+
+} SPKR_SEQ;
+
+// Desc: The blocks the Pixy reported in one frame, with a running frame
+//       number so consumers can tell frames apart (and count any they
+//       missed).
+typedef struct PIXY_FRAME_TYPE {
+
+    PIXY_DATA block[ PIXY_MAX_BLOCKS ];     // Blocks, in the order they came in.
+    unsigned char n_blocks;                 // How many.
+    unsigned short int frame;               // Frame number, counting from 1.
+
+} PIXY_FRAME;
+
+// Desc: Frame rate and loss counters for the Pixy handoff.  The 8-bit
+//       counters are bumped from the interrupt, so they're kept to a size
+//       that can be read in one go.
+typedef struct PIXY_STATS_TYPE {
+
+    unsigned short int frames;      // Frames closed.
+    unsigned char fps;              // Frames closed in the last second.
+    unsigned short int dropped;     // Frames replaced before a behavior read them.
+    unsigned char overflow;         // Blocks that didn't fit in a frame's table.
+    unsigned char lost_events;      // Events the queue had no room for.
+    unsigned short int age_ms;      // Time since the last frame closed.
+
+} PIXY_STATS;
+
+// Desc: Events posted from interrupt context for the main loop to handle.
+typedef enum EVENT_TYPE {
+
+    EVT_NONE = 0,           // Queue is empty.
+    EVT_PIXY_BLOCK,         // First block of a new Pixy frame came in.
+
+} EVENT;
+
+// Desc: How 'pixy_select()' picks one block out of a frame.
+typedef enum PIXY_SELECT_TYPE {
+
+    SELECT_LARGEST = 0,     // Biggest area.
+    SELECT_NEAREST,         // Same signature as last time, closest to where it was.
+    SELECT_PRIORITY,        // Lowest signature number, then biggest area.
+
+} PIXY_SELECT;
+
 // ---------------------- Globals:
 volatile MOTOR_ACTION action;  	// This variable holds parameters that determine
                           		// the current action that is taking place.
 						  		// Here, a structure named "action" of type 
 						  		// MOTOR_ACTION is declared.
 
+// Events from interrupts.  One producer (the interrupt) moves the tail,
+// one consumer (the main loop) moves the head, and both are single bytes,
+// so neither side needs to lock the other out.
+volatile EVENT evt_queue[ EVT_QUEUE_LEN ];
+volatile unsigned char evt_head;
+volatile unsigned char evt_tail;
+
+// Pixy handoff.  The driver writes each block into 'pixy_rx' and calls
+// 'pixy_callback()' from its interrupt, which adds it to the frame being
+// collected in 'pixy_buf[ pixy_collect ]'.  The driver doesn't mark frame
+// boundaries, so the first block of each frame posts EVT_PIXY_BLOCK, and
+// 'pixy_frame_close()' closes the frame PIXY_WINDOW_MS later from the main
+// loop by flipping 'pixy_collect' -- a single byte write, so the interrupt
+// is always adding to one whole table or the other.
+PIXY_DATA pixy_rx;                      // Driver's landing spot.
+volatile PIXY_FRAME pixy_buf[ 2 ];      // Frame being collected, and the last one closed.
+volatile unsigned char pixy_collect;    // Index of the frame being collected.
+unsigned char pixy_front;               // Index of the last frame closed.
+unsigned char pixy_seq;                 // Bumped every time a frame is closed.
+unsigned short int pixy_window_ms;      // Time left before the frame is closed, 0 if none open.
+volatile unsigned short int pixy_ticks; // PIXY_TICK_MS ticks not counted off yet (from the interrupt).
+volatile PIXY_STATS pixy_stats;         // Frame rate and loss counters.
+
+SPKR_SEQ speaker;               // Speaker sequencer.
+REACT_STATE reaction;           // Color signature reaction in progress.
+
+// "Seven Nation Army" - The White Stripes
+const unsigned short int SNA_measure_1[] PROGMEM = {
+    SEQ_NOTE( SPKR_NOTE_E, 2, 6 ),
+    SEQ_NOTE( SPKR_NOTE_E, 2, 2 ),
+    SEQ_NOTE( SPKR_NOTE_G, 2, 3 ),
+    SEQ_NOTE( SPKR_NOTE_E, 2, 3 ),
+    SEQ_NOTE( SPKR_NOTE_D, 2, 2 )
+};
+const unsigned short int SNA_measure_2[] PROGMEM = {
+    SEQ_NOTE( SPKR_NOTE_C, 2, 8 ),
+    SEQ_NOTE( SPKR_NOTE_B, 1, 8 )
+};
+const SEQ_MEASURE SNA_measures[] PROGMEM = {
+    { SNA_measure_1, SEQ_COUNT( SNA_measure_1 ), 1 },
+    { SNA_measure_2, SEQ_COUNT( SNA_measure_2 ), 1 }
+};
+const SEQ_SONG SevenNationArmy PROGMEM = { SNA_measures, SEQ_COUNT( SNA_measures ), 1 };
+
+// "U Can't Touch This" - MC Hammer
+const unsigned short int CCT_measure_1[] PROGMEM = {
+    SEQ_NOTE( SPKR_NOTE_D, 3, 4 ),
+    SEQ_NOTE( SPKR_NOTE_C, 3, 2 ),
+    SEQ_NOTE( SPKR_NOTE_B, 2, 2 ),
+    SEQ_NOTE( SPKR_NOTE_A, 2, 2 ),
+    SEQ_NOTE( SPKR_NOTE_C, 4, 2 ),
+    SEQ_NOTE( SPKR_NOTE_C, 4, 2 ),
+    SEQ_NOTE( SPKR_NOTE_E, 2, 2 )
+};
+const unsigned short int CCT_measure_2[] PROGMEM = {
+    SEQ_NOTE( SPKR_NOTE_G, 2, 2 ),
+    SEQ_NOTE( SPKR_NOTE_B, 3, 2 ),
+    SEQ_NOTE( SPKR_NOTE_B, 3, 2 ),
+    SEQ_NOTE( SPKR_NOTE_B, 2, 2 ),
+    SEQ_NOTE( SPKR_NOTE_A, 2, 2 ),
+    SEQ_NOTE( SPKR_NOTE_C, 4, 2 ),
+    SEQ_REST( 4 )
+};
+const SEQ_MEASURE CCT_measures[] PROGMEM = {
+    { CCT_measure_1, SEQ_COUNT( CCT_measure_1 ), 1 },
+    { CCT_measure_2, SEQ_COUNT( CCT_measure_2 ), 1 }
+};
+const SEQ_SONG UCantTouchThis PROGMEM = { CCT_measures, SEQ_COUNT( CCT_measures ), 1 };
+
+// "Smoke on the Water" - Deep Purple
+const unsigned short int SW_measure_1[] PROGMEM = {
+    SEQ_NOTE( SPKR_NOTE_D, 2, 2 ),
+    SEQ_REST( 2 ),
+    SEQ_NOTE( SPKR_NOTE_F, 2, 2 ),
+    SEQ_REST( 2 ),
+    SEQ_NOTE( SPKR_NOTE_G, 2, 4 ),
+    SEQ_REST( 2 ),
+    SEQ_NOTE( SPKR_NOTE_D, 2, 2 )
+};
+const unsigned short int SW_measure_2[] PROGMEM = {
+    SEQ_REST( 2 ),
+    SEQ_NOTE( SPKR_NOTE_F, 2, 2 ),
+    SEQ_REST( 2 ),
+    SEQ_NOTE( SPKR_NOTE_G_S, 2, 2 ),
+    SEQ_NOTE( SPKR_NOTE_G, 2, 4 ),
+    SEQ_REST( 4 )
+};
+const unsigned short int SW_measure_3[] PROGMEM = {
+    SEQ_NOTE( SPKR_NOTE_D, 2, 2 ),
+    SEQ_REST( 2 ),
+    SEQ_NOTE( SPKR_NOTE_F, 2, 2 ),
+    SEQ_REST( 2 ),
+    SEQ_NOTE( SPKR_NOTE_G, 2, 4 ),
+    SEQ_REST( 2 ),
+    SEQ_NOTE( SPKR_NOTE_F, 2, 2 )
+};
+const unsigned short int SW_measure_4[] PROGMEM = {
+    SEQ_REST( 2 ),
+    SEQ_NOTE( SPKR_NOTE_D, 2, 10 ),
+    SEQ_REST( 4 )
+};
+const SEQ_MEASURE SW_measures[] PROGMEM = {
+    { SW_measure_1, SEQ_COUNT( SW_measure_1 ), 1 },
+    { SW_measure_2, SEQ_COUNT( SW_measure_2 ), 1 },
+    { SW_measure_3, SEQ_COUNT( SW_measure_3 ), 1 },
+    { SW_measure_4, SEQ_COUNT( SW_measure_4 ), 1 }
+};
+const SEQ_SONG SmokeOnTheWater PROGMEM = { SW_measures, SEQ_COUNT( SW_measures ), 1 };
+
+// Color signature reactions.  Each one plays its song and turns ~90-deg
+// LEFT (DEG_90 steps at 200 steps/sec), then leaves that signature alone
+// for a while so the same object doesn't set it off again.
+const char sig1_message[] PROGMEM = "Color Signature #1\n\n\"Smoke on the Water\"";
+const char sig2_message[] PROGMEM = "Color Signature #2\n\n\"Seven Nation Army\"";
+const char sig3_message[] PROGMEM = "Color Signature #3\n\n\"U Can't Touch This\"";
+
+const REACTION reactions[ PIXY_SIGNATURES ] PROGMEM = {
+    { NULL, { 0, 0, 0 }, NULL, 0 },
+    { &SmokeOnTheWater, { -200, 200, DEG_90 }, sig1_message, 8000 },
+    { &SevenNationArmy, { -200, 200, DEG_90 }, sig2_message, 8000 },
+    { &UCantTouchThis,  { -200, 200, DEG_90 }, sig3_message, 8000 },
+    { NULL, { 0, 0, 0 }, NULL, 0 },
+    { NULL, { 0, 0, 0 }, NULL, 0 },
+    { NULL, { 0, 0, 0 }, NULL, 0 },
+    { NULL, { 0, 0, 0 }, NULL, 0 }
+};
+
 // ---------------------- Prototypes:
 void IR_sense( volatile SENSOR_DATA *pSensors, TIMER16 interval_ms );
 void cruise( volatile MOTOR_ACTION *pAction );
 void pixy_process( volatile MOTOR_ACTION *pAction,
                    volatile SENSOR_DATA *pSensors );
+void react( volatile MOTOR_ACTION *pAction, TIMER16 interval_ms );
+void react_tick( void );
 
 void IR_avoid( volatile MOTOR_ACTION *pAction, volatile SENSOR_DATA *pSensors );
 void act( volatile MOTOR_ACTION *pAction );
 void info_display( volatile MOTOR_ACTION *pAction );
 void pixy_test_display( volatile SENSOR_DATA *pSensors );
 BOOL compare_actions( volatile MOTOR_ACTION *a, volatile MOTOR_ACTION *b );
+BOOL event_post( EVENT event );
+EVENT event_get( void );
+void events_dispatch( void );
+void pixy_callback( PIXY_DATA *pData );
+void pixy_tick( void );
+void pixy_frame_close( TIMER16 interval_ms );
+unsigned char pixy_select( volatile PIXY_FRAME *pFrame, PIXY_SELECT policy,
+                           unsigned char sig_mask, volatile PIXY_DATA *pLast );
+BOOL pixy_read( volatile SENSOR_DATA *pSensors, PIXY_SELECT policy,
+                unsigned char sig_mask );
+void speaker_play( const SEQ_SONG *song );
+BOOL speaker_queue( const SEQ_SONG *song );
+void speaker_stop( void );
+BOOL speaker_busy( void );
+void speaker_service( TIMER16 interval_ms );
+void speaker_tick( void );
+void speaker_start_note( void );
+void speaker_start_song( const SEQ_SONG *song );
+BOOL speaker_next_note( void );
 
 // ---------------------- Convenience Functions:
 void info_display( volatile MOTOR_ACTION *pAction )
@@ -177,6 +491,17 @@ void info_display( volatile MOTOR_ACTION *pAction )
 				LCD_printf( "Following...\n" );
 			break;
 
+			case REACTING:
+				if ( reaction.current.message != NULL )
+				{
+					char message[ REACT_MSG_LEN ];
+
+					strncpy_P( message, reaction.current.message, REACT_MSG_LEN - 1 );
+					message[ REACT_MSG_LEN - 1 ] = '\0';
+					LCD_printf( "%s", message );
+				}
+			break;
+
             default:
                 LCD_printf( "Unknown state!\n" );
 
@@ -238,6 +563,498 @@ BOOL compare_actions( volatile MOTOR_ACTION *a, volatile MOTOR_ACTION *b )
     return rval;
 
 } // end compare_actions()
+// ----------------------------------------------------- //
+BOOL event_post( EVENT event )
+{
+
+    // Safe to call from an interrupt.  Returns FALSE (and counts it) if
+    // the queue is full.
+    unsigned char next = ( evt_tail + 1 ) % EVT_QUEUE_LEN;
+
+    if ( next == evt_head )
+    {
+
+        pixy_stats.lost_events++;
+        return FALSE;
+
+    } // end if()
+
+    evt_queue[ evt_tail ] = event;
+    evt_tail = next;
+
+    return TRUE;
+
+} // end event_post()
+// ----------------------------------------------------- //
+EVENT event_get( void )
+{
+
+    EVENT event;
+
+    if ( evt_head == evt_tail )
+        return EVT_NONE;
+
+    event = evt_queue[ evt_head ];
+    evt_head = ( evt_head + 1 ) % EVT_QUEUE_LEN;
+
+    return event;
+
+} // end event_get()
+// ----------------------------------------------------- //
+void events_dispatch( void )
+{
+
+    // Handles everything the interrupts have posted since last time.
+    EVENT event;
+
+    while( ( event = event_get() ) != EVT_NONE )
+    {
+
+        switch( event )
+        {
+
+            case EVT_PIXY_BLOCK:
+                // Give the rest of the frame's blocks time to come in.
+                if ( pixy_window_ms == 0 )
+                    pixy_window_ms = PIXY_WINDOW_MS;
+            break;
+
+            default:
+            break;
+
+        } // end switch()
+
+    } // end while()
+
+} // end events_dispatch()
+// ----------------------------------------------------- //
+void pixy_callback( PIXY_DATA *pData )
+{
+
+    // NOTE: Runs in the Pixy driver's interrupt -- keep it short.
+    volatile PIXY_FRAME *pFrame = &pixy_buf[ pixy_collect ];
+    unsigned char i;
+    unsigned char smallest;
+
+    if ( pFrame->n_blocks < PIXY_MAX_BLOCKS )
+    {
+
+        // First block of a frame -- let the main loop know one's started.
+        if ( pFrame->n_blocks == 0 )
+            event_post( EVT_PIXY_BLOCK );
+
+        pFrame->block[ pFrame->n_blocks++ ] = *pData;
+        return;
+
+    } // end if()
+
+    pixy_stats.overflow++;
+
+    // Table's full -- this block only gets in if it's bigger than the
+    // smallest one there.
+    smallest = 0;
+    for ( i = 1; i < PIXY_MAX_BLOCKS; i++ )
+    {
+
+        if ( PIXY_AREA( pFrame->block[ i ] ) < PIXY_AREA( pFrame->block[ smallest ] ) )
+            smallest = i;
+
+    } // end for()
+
+    if ( PIXY_AREA( *pData ) > PIXY_AREA( pFrame->block[ smallest ] ) )
+        pFrame->block[ smallest ] = *pData;
+
+} // end pixy_callback()
+// ----------------------------------------------------- //
+void pixy_tick( void )
+{
+
+    // Timer callback -- runs in the timer interrupt, so frame timing keeps
+    // up however long a trip around the loop takes.
+    pixy_ticks++;
+
+} // end pixy_tick()
+// ----------------------------------------------------- //
+void pixy_frame_close( TIMER16 interval_ms )
+{
+
+    // Counts off the ticks since the last call: closes the open frame once
+    // its window runs out, and keeps the frame rate and age counters.
+    static BOOL timer_started = FALSE;
+    static TIMEROBJ frame_timer;
+    static unsigned short int second_ms = 0;
+    static unsigned short int second_frames = 0;
+    unsigned char closing;
+    unsigned char sreg;
+    unsigned short int elapsed;
+
+    if ( timer_started == FALSE )
+    {
+
+        TMRSRVC_REGISTER_CBFUNC( frame_timer, pixy_tick );
+        TMRSRVC_new( &frame_timer, TMRFLG_NOTIFY_FUNC, TMRTCM_RESTART,
+            interval_ms );
+
+        timer_started = TRUE;
+        return;
+
+    } // end if()
+
+    sreg = SREG;
+    cli();
+    elapsed = pixy_ticks * interval_ms;
+    pixy_ticks = 0;
+    SREG = sreg;
+
+    if ( elapsed == 0 )
+        return;
+
+    if ( pixy_stats.age_ms < 0xFFFF - elapsed )
+        pixy_stats.age_ms += elapsed;
+    else
+        pixy_stats.age_ms = 0xFFFF;
+
+    // Frames over however long it's been, so a late call doesn't skew it.
+    second_ms += elapsed;
+    if ( second_ms >= 1000 )
+    {
+
+        pixy_stats.fps = ( unsigned long )( pixy_stats.frames - second_frames ) * 1000 / second_ms;
+        second_frames = pixy_stats.frames;
+        second_ms = 0;
+
+    } // end if()
+
+    if ( pixy_window_ms == 0 )
+        return;
+
+    if ( pixy_window_ms > elapsed )
+    {
+
+        pixy_window_ms -= elapsed;
+        return;
+
+    } // end if()
+
+    // It closed when the window ran out, which may have been a tick or two ago.
+    pixy_stats.age_ms = elapsed - pixy_window_ms;
+    pixy_window_ms = 0;
+    closing = pixy_collect;
+
+    // Empty the other table, then point the interrupt at it.
+    pixy_buf[ closing ^ 1 ].n_blocks = 0;
+    pixy_collect = closing ^ 1;
+
+    pixy_buf[ closing ].frame = ++pixy_stats.frames;
+    pixy_front = closing;
+    pixy_seq++;
+
+} // end pixy_frame_close()
+// ----------------------------------------------------- //
+unsigned char pixy_select( volatile PIXY_FRAME *pFrame, PIXY_SELECT policy,
+                           unsigned char sig_mask, volatile PIXY_DATA *pLast )
+{
+
+    // Picks one block out of 'pFrame' by 'policy', only looking at blocks
+    // whose signature bit is set in 'sig_mask'.  Returns its index, or
+    // PIXY_NO_BLOCK.
+    unsigned char i;
+    unsigned char best = PIXY_NO_BLOCK;
+    unsigned long score;
+    unsigned long best_score = 0;
+    volatile PIXY_DATA *pBlock;
+
+    for ( i = 0; i < pFrame->n_blocks; i++ )
+    {
+
+        pBlock = &pFrame->block[ i ];
+
+        if ( ( pBlock->signum > 7 ) || !( sig_mask & ( 1 << pBlock->signum ) ) )
+            continue;
+
+        switch( policy )
+        {
+
+            case SELECT_NEAREST:
+                // Closer scores higher.  Anything with another signature
+                // only wins if there's nothing with this one.
+                score = 0xFFFF - ( abs( pBlock->pos.x - pLast->pos.x ) +
+                                   abs( pBlock->pos.y - pLast->pos.y ) );
+                if ( pBlock->signum == pLast->signum )
+                    score += 0x10000UL;
+            break;
+
+            case SELECT_PRIORITY:
+                // Signature first, area to break ties.
+                score = ( ( unsigned long )( 8 - pBlock->signum ) << 17 ) +
+                        PIXY_AREA( *pBlock );
+            break;
+
+            default:
+                score = PIXY_AREA( *pBlock );
+
+        } // end switch()
+
+        if ( ( best == PIXY_NO_BLOCK ) || ( score > best_score ) )
+        {
+
+            best = i;
+            best_score = score;
+
+        } // end if()
+
+    } // end for()
+
+    return best;
+
+} // end pixy_select()
+// ----------------------------------------------------- //
+BOOL pixy_read( volatile SENSOR_DATA *pSensors, PIXY_SELECT policy,
+                unsigned char sig_mask )
+{
+
+    // If a frame has closed since the last read, picks a block out of it
+    // into 'pSensors->pixy_data' and returns TRUE.  Frames are closed from
+    // the main loop too, so the one in front stays put while we read it.
+    volatile PIXY_FRAME *pFrame = &pixy_buf[ pixy_front ];
+    unsigned char pick;
+
+    if ( pSensors->pixy_seq == pixy_seq )
+        return FALSE;
+
+    // Count any frames that came and went without being read.
+    if ( ( pSensors->pixy_frame != 0 ) &&
+         ( pFrame->frame - pSensors->pixy_frame > 1 ) )
+        pixy_stats.dropped += pFrame->frame - pSensors->pixy_frame - 1;
+
+    pSensors->pixy_seq = pixy_seq;
+    pSensors->pixy_frame = pFrame->frame;
+    pSensors->pixy_blocks = pFrame->n_blocks;
+
+    pick = pixy_select( pFrame, policy, sig_mask, &pSensors->pixy_data );
+
+    if ( pick == PIXY_NO_BLOCK )
+        return FALSE;
+
+    pSensors->pixy_data = pFrame->block[ pick ];
+
+    return TRUE;
+
+} // end pixy_read()
+// ----------------------------------------------------- //
+void speaker_start_note( void )
+{
+
+    unsigned short int word =
+        pgm_read_word( &speaker.measure_info.notes[ speaker.note ] );
+    unsigned short int dur_ms = SEQ_NOTE_LEN( word ) * NOTE_SIXTEENTH;
+
+    // Rests are silent for their whole length.  Notes sound for most of
+    // it and go quiet for the rest, so repeated notes don't run together.
+    if ( SEQ_NOTE_NOTE( word ) == SPKR_NOTE_NONE )
+    {
+
+        speaker.on_ms = 0;
+        SPKR_tone( 0 );
+
+    } // end if()
+    else
+    {
+
+        speaker.on_ms = ( unsigned short int )
+                        ( ( ( unsigned long ) dur_ms * NOTE_ARTIC_PCT ) / 100 );
+        SPKR_note( SEQ_NOTE_NOTE( word ), SEQ_NOTE_OCTAVE( word ), 0 );
+
+    } // end else.
+
+    speaker.off_ms = dur_ms - speaker.on_ms;
+
+} // end speaker_start_note()
+// ----------------------------------------------------- //
+void speaker_start_song( const SEQ_SONG *song )
+{
+
+    speaker.song = song;
+    memcpy_P( &speaker.song_info, song, sizeof( SEQ_SONG ) );
+    memcpy_P( &speaker.measure_info, &speaker.song_info.measures[ 0 ],
+              sizeof( SEQ_MEASURE ) );
+    speaker.song_pass = 0;
+    speaker.measure = 0;
+    speaker.measure_pass = 0;
+    speaker.note = 0;
+
+    speaker_start_note();
+
+} // end speaker_start_song()
+// ----------------------------------------------------- //
+BOOL speaker_next_note( void )
+{
+
+    // Step note -> measure repeat -> measure -> song repeat.  Returns FALSE
+    // once the song is over.  Moving to another measure copies it out
+    // of flash.
+    if ( ++speaker.note < speaker.measure_info.n_notes )
+        return TRUE;
+
+    speaker.note = 0;
+    if ( ++speaker.measure_pass < speaker.measure_info.repeat )
+        return TRUE;
+
+    speaker.measure_pass = 0;
+    if ( ++speaker.measure >= speaker.song_info.n_measures )
+    {
+
+        speaker.measure = 0;
+        if ( ++speaker.song_pass >= speaker.song_info.repeat )
+            return FALSE;
+
+    } // end if()
+
+    memcpy_P( &speaker.measure_info,
+              &speaker.song_info.measures[ speaker.measure ],
+              sizeof( SEQ_MEASURE ) );
+
+    return TRUE;
+
+} // end speaker_next_note()
+// ----------------------------------------------------- //
+void speaker_play( const SEQ_SONG *song )
+{
+
+    // Drop whatever is playing or queued and start this one right away.
+    speaker.q_count = 0;
+    speaker_start_song( song );
+
+} // end speaker_play()
+// ----------------------------------------------------- //
+BOOL speaker_queue( const SEQ_SONG *song )
+{
+
+    // Nothing playing -- just start it.
+    if ( speaker.song == NULL )
+    {
+
+        speaker_start_song( song );
+        return TRUE;
+
+    } // end if()
+
+    if ( speaker.q_count >= SPKR_QUEUE_LEN )
+        return FALSE;
+
+    speaker.queue[ ( speaker.q_head + speaker.q_count ) % SPKR_QUEUE_LEN ] = song;
+    speaker.q_count++;
+
+    return TRUE;
+
+} // end speaker_queue()
+// ----------------------------------------------------- //
+void speaker_stop( void )
+{
+
+    speaker.q_count = 0;
+    speaker.song = NULL;
+    SPKR_tone( 0 );
+
+} // end speaker_stop()
+// ----------------------------------------------------- //
+BOOL speaker_busy( void )
+{
+
+    return ( speaker.song != NULL ) ? TRUE : FALSE;
+
+} // end speaker_busy()
+// ----------------------------------------------------- //
+void speaker_tick( void )
+{
+
+    // Timer callback -- runs in the timer interrupt, so ticks are never
+    // missed however long a trip around the loop takes.
+    speaker.ticks++;
+
+} // end speaker_tick()
+// ----------------------------------------------------- //
+void speaker_service( TIMER16 interval_ms )
+{
+
+    // Counts off however much time has gone by since the last call, so the
+    // tempo holds even when the loop is slow.  Only does anything once a
+    // tick has come in, so it never holds up the rest of the loop.
+    static BOOL timer_started = FALSE;
+    static TIMEROBJ speaker_timer;
+    unsigned char sreg;
+    unsigned short int elapsed;
+
+    if ( timer_started == FALSE )
+    {
+
+        TMRSRVC_REGISTER_CBFUNC( speaker_timer, speaker_tick );
+        TMRSRVC_new( &speaker_timer, TMRFLG_NOTIFY_FUNC, TMRTCM_RESTART,
+            interval_ms );
+
+        timer_started = TRUE;
+        return;
+
+    } // end if()
+
+    sreg = SREG;
+    cli();
+    elapsed = speaker.ticks * interval_ms;
+    speaker.ticks = 0;
+    SREG = sreg;
+
+    while ( ( elapsed > 0 ) && ( speaker.song != NULL ) )
+    {
+
+        // Still sounding the note?
+        if ( speaker.on_ms > elapsed )
+        {
+
+            speaker.on_ms -= elapsed;
+            return;
+
+        } // end if()
+
+        // Note is done -- go quiet for the rest of its length.
+        if ( speaker.on_ms > 0 )
+        {
+
+            elapsed -= speaker.on_ms;
+            speaker.on_ms = 0;
+            SPKR_tone( 0 );
+
+        } // end if()
+
+        if ( speaker.off_ms > elapsed )
+        {
+
+            speaker.off_ms -= elapsed;
+            return;
+
+        } // end if()
+
+        elapsed -= speaker.off_ms;
+        speaker.off_ms = 0;
+
+        // On to the next note, or the next song in the queue.
+        if ( speaker_next_note() == TRUE )
+            speaker_start_note();
+        else if ( speaker.q_count > 0 )
+        {
+
+            const SEQ_SONG *next = speaker.queue[ speaker.q_head ];
+
+            speaker.q_head = ( speaker.q_head + 1 ) % SPKR_QUEUE_LEN;
+            speaker.q_count--;
+            speaker_start_song( next );
+
+        } // end else if()
+        else
+            speaker_stop();
+
+    } // end while()
+
+} // end speaker_service()
 
 // ---------------------- Top-Level Behaviorals:
 void IR_sense( volatile SENSOR_DATA *pSensors, TIMER16 interval_ms )
@@ -323,161 +1140,154 @@ void pixy_process( volatile MOTOR_ACTION *pAction,
                    volatile SENSOR_DATA *pSensors )
 {
 
+    unsigned char signum;
+    unsigned char ready = 0;
+
+    // Only look at signatures that have a reaction and aren't cooling
+    // down, and of those take the lowest numbered one in view.
+    for ( signum = 1; signum < PIXY_SIGNATURES; signum++ )
+    {
+        if ( ( pgm_read_word( &reactions[ signum ].cooldown_ms ) > 0 ) &&
+             ( reaction.cooldown_ms[ signum ] == 0 ) )
+            ready |= ( 1 << signum );
+    }
+
     // Only process this behavior -if- there is NEW data from the pixy.
-    if( PIXY_has_data() )
+    if( pixy_read( pSensors, SELECT_PRIORITY, ready ) == TRUE )
     {
-		pAction->state = FOLLOWING;
-		
 		// For testing
 		//pixy_test_display( pSensors );
 		
-		// Song timing
-		int measure = 2000;
-		int half = measure / 2;
-		int quarter = half / 2;
-		int eighth = quarter / 2;
-		int sixteenth = eighth / 2;
-		
-		// "Seven Nation Army" - The White Stripes
-		SPKR_PLAYNOTE SNA_measure_1[] = {
-			{ SPKR_NOTE_E, 2, 0, quarter + eighth, 90 },
-			{ SPKR_NOTE_E, 2, 0, eighth, 90 },
-			{ SPKR_NOTE_G, 2, 0, eighth + sixteenth, 90 },
-			{ SPKR_NOTE_E, 2, 0, eighth + sixteenth, 90 },
-			{ SPKR_NOTE_D, 2, 0, eighth, 90 }			
-		};
-		SPKR_PLAYNOTE SNA_measure_2[] = {
-			{ SPKR_NOTE_C, 2, 0, half, 90 },
-			{ SPKR_NOTE_B, 1, 0, half, 90 }
-		};
-		SPKR_MEASURE SNA_measures[] = {
-			{ SNA_measure_1, 5, 1 },
-			{ SNA_measure_2, 2, 1 }
-		};
-		SPKR_SONG SevenNationArmy[] = {
-			{ SNA_measures, 2, 1 }
-		};
-		
-		// "U Can't Touch This" - MC Hammer
-		SPKR_PLAYNOTE CCT_measure_1[] = {
-			{ SPKR_NOTE_D, 3, 0, quarter, 90 },
-			{ SPKR_NOTE_C, 3, 0, eighth, 90 },
-			{ SPKR_NOTE_B, 2, 0, eighth, 90 },
-			{ SPKR_NOTE_A, 2, 0, eighth, 90 },
-			//{ SPKR_NOTE_NONE, 2, 0, quarter, 100 },
-			{ SPKR_NOTE_C, 4, 0, eighth, 90 },
-			{ SPKR_NOTE_C, 4, 0, eighth, 90 },
-			{ SPKR_NOTE_E, 2, 0, eighth, 90 }
-		};
-		SPKR_PLAYNOTE CCT_measure_2[] = {
-			{ SPKR_NOTE_G, 2, 0, eighth, 90 },
-			//{ SPKR_NOTE_NONE, 2, 0, quarter, 100 },
-			{ SPKR_NOTE_B, 3, 0, eighth, 90 },
-			{ SPKR_NOTE_B, 3, 0, eighth, 90 },
-			{ SPKR_NOTE_B, 2, 0, eighth, 90 },
-			{ SPKR_NOTE_A, 2, 0, eighth, 90 },
-			//{ SPKR_NOTE_NONE, 2, 0, eighth, 100 },
-			{ SPKR_NOTE_C, 4, 0, eighth, 90 },	
-			{ SPKR_NOTE_NONE, 2, 0, quarter, 100 }
-		};
-		SPKR_MEASURE CCT_measures[] = {
-			{ CCT_measure_1, 7, 1 },
-			{ CCT_measure_2, 7, 1 }
-		};
-		SPKR_SONG UCantTouchThis[] = {
-			{ CCT_measures, 2, 1 }
-		};
-		
-		// "Smoke on the Water" - Deep Purple
-		SPKR_PLAYNOTE SW_measure_1[] = {
-			{ SPKR_NOTE_D, 2, 0, eighth, 90 },
-			{ SPKR_NOTE_NONE, 2, 0, eighth, 100 },
-			{ SPKR_NOTE_F, 2, 0, eighth, 90 },
-			{ SPKR_NOTE_NONE, 2, 0, eighth, 100 },
-			{ SPKR_NOTE_G, 2, 0, quarter, 90 },
-			{ SPKR_NOTE_NONE, 2, 0, eighth, 100 },
-			{ SPKR_NOTE_D, 2, 0, eighth, 90 }
-		};
-		SPKR_PLAYNOTE SW_measure_2[] = {
-			{ SPKR_NOTE_NONE, 2, 0, eighth, 100 },
-			{ SPKR_NOTE_F, 2, 0, eighth, 90 },
-			{ SPKR_NOTE_NONE, 2, 0, eighth, 100 },
-			{ SPKR_NOTE_G_S, 2, 0, eighth, 90 },
-			{ SPKR_NOTE_G, 2, 0, quarter, 90 },
-			{ SPKR_NOTE_NONE, 2, 0, quarter, 100 }
-		};
-		SPKR_PLAYNOTE SW_measure_3[] = {
-			{ SPKR_NOTE_D, 2, 0, eighth, 90 },
-			{ SPKR_NOTE_NONE, 2, 0, eighth, 100 },
-			{ SPKR_NOTE_F, 2, 0, eighth, 90 },
-			{ SPKR_NOTE_NONE, 2, 0, eighth, 100 },
-			{ SPKR_NOTE_G, 2, 0, quarter, 90 },
-			{ SPKR_NOTE_NONE, 2, 0, eighth, 100 },
-			{ SPKR_NOTE_F, 2, 0, eighth, 90 }
-		};
-		SPKR_PLAYNOTE SW_measure_4[] = {
-			{ SPKR_NOTE_NONE, 2, 0, eighth, 100 },
-			{ SPKR_NOTE_D, 2, 0, half + eighth, 90 },
-			{ SPKR_NOTE_NONE, 2, 0, quarter, 100 }
-		};
-		SPKR_MEASURE SW_measures[] = {
-			{ SW_measure_1, 7, 1 },
-			{ SW_measure_2, 6, 1 },
-			{ SW_measure_3, 7, 1 },
-			{ SW_measure_4, 3, 1 }
-		};
-		SPKR_SONG SmokeOnTheWater[] = {
-			{ SW_measures, 4, 1 }
-		};		
-		
-		switch (pSensors->pixy_data.signum) {
-			case 1:
-				LCD_clear();
-				LCD_printf( "Color Signature #1\n\n" );
-				LCD_printf( "\"Smoke on the Water\"" );
-				// Stop moving to play song
-				STEPPER_stop( STEPPER_BOTH, STEPPER_BRK_OFF );
-				SPKR_play_song( SmokeOnTheWater );
-				// Turn and resume BBC code
-				STEPPER_move_stwt( STEPPER_BOTH,
-				STEPPER_REV, DEG_90, 200, 400, STEPPER_BRK_OFF,
-				STEPPER_FWD, DEG_90, 200, 400, STEPPER_BRK_OFF);
-				LCD_clear();
-				break;
-			case 2:
-				LCD_clear();
-				LCD_printf( "Color Signature #2\n\n" );
-				LCD_printf( "\"Seven Nation Army\"" );
-				// Stop moving to play song
-				STEPPER_stop( STEPPER_BOTH, STEPPER_BRK_OFF );
-				SPKR_play_song( SevenNationArmy );
-				// Turn and resume BBC code
-				STEPPER_move_stwt( STEPPER_BOTH,
-				STEPPER_REV, DEG_90, 200, 400, STEPPER_BRK_OFF,
-				STEPPER_FWD, DEG_90, 200, 400, STEPPER_BRK_OFF);
-				LCD_clear();
-				break;
-			case 3:
-				LCD_clear();
-				LCD_printf( "Color Signature #3\n\n" );
-				LCD_printf( "\"U Can't Touch This\"" );
-				// Stop moving to play song
-				STEPPER_stop( STEPPER_BOTH, STEPPER_BRK_OFF );
-				SPKR_play_song( UCantTouchThis );
-				// Turn and resume BBC code
-				STEPPER_move_stwt( STEPPER_BOTH,
-				STEPPER_REV, DEG_90, 200, 400, STEPPER_BRK_OFF,
-				STEPPER_FWD, DEG_90, 200, 400, STEPPER_BRK_OFF);
-				LCD_clear();
-				break;
-		}
-
-        PIXY_process_finished();
+		// Look the signature up and start its reaction, unless it went
+		// off recently or another reaction is still moving the robot.
+		signum = pSensors->pixy_data.signum;
+
+		if ( ( signum > 0 ) && ( signum < PIXY_SIGNATURES ) &&
+			 ( reaction.cooldown_ms[ signum ] == 0 ) && ( reaction.moving == FALSE ) )
+		{
+
+			memcpy_P( &reaction.current, &reactions[ signum ], sizeof( REACTION ) );
+
+			if ( reaction.current.cooldown_ms > 0 )
+			{
+
+				reaction.signum = signum;
+				reaction.moving = ( reaction.current.motion.steps > 0 ) ? TRUE : FALSE;
+				reaction.started = FALSE;
+				reaction.cooldown_ms[ signum ] = reaction.current.cooldown_ms;
+
+				if ( reaction.current.song != NULL )
+					speaker_play( reaction.current.song );
+
+			} // end if()
+
+		} // end if()
 
     } // end if()
 
+    // Frames only come in every 20 ms, but this runs every trip around
+    // the loop -- stay 'following' as long as the camera has seen
+    // something lately, rather than flickering back to cruising.
+    if ( ( pixy_stats.frames > 0 ) && ( pixy_stats.age_ms < PIXY_HOLD_MS ) )
+        pAction->state = FOLLOWING;
+
 } // end pixy_process()
 // -------------------------------------------- //
+void react_tick( void )
+{
+
+    // Timer callback -- runs in the timer interrupt, so cooldowns keep
+    // counting even through a slow trip around the loop.
+    reaction.ticks++;
+
+} // end react_tick()
+// -------------------------------------------- //
+void react( volatile MOTOR_ACTION *pAction, TIMER16 interval_ms )
+{
+
+    // Carries out the motion 'pixy_process()' started and counts the signature
+    // cooldowns down.  The motion is a non-blocking step move with the
+    // same 400 steps/sec^2 ramp as the turn in 'IR_avoid()', so it turns
+    // the full angle however long the ramps take.  Never blocks, so
+    // sensing, the song and 'IR_avoid()' all keep running meanwhile.
+    static BOOL timer_started = FALSE;
+    static TIMEROBJ react_timer;
+    unsigned char i;
+    unsigned char sreg;
+    unsigned short int elapsed;
+    STEPPER_NSTEPS steps_left;
+
+    if ( timer_started == FALSE )
+    {
+
+        TMRSRVC_REGISTER_CBFUNC( react_timer, react_tick );
+        TMRSRVC_new( &react_timer, TMRFLG_NOTIFY_FUNC, TMRTCM_RESTART,
+            interval_ms );
+
+        timer_started = TRUE;
+
+    } // end if()
+
+    // Take off however much time has gone by since the last call.
+    sreg = SREG;
+    cli();
+    elapsed = reaction.ticks * interval_ms;
+    reaction.ticks = 0;
+    SREG = sreg;
+
+    for ( i = 0; i < PIXY_SIGNATURES; i++ )
+    {
+
+        if ( reaction.cooldown_ms[ i ] > elapsed )
+            reaction.cooldown_ms[ i ] -= elapsed;
+        else
+            reaction.cooldown_ms[ i ] = 0;
+
+    } // end for()
+
+    if ( reaction.moving == FALSE )
+        return;
+
+    // Start the move the first time through, then wait for both wheels
+    // to finish their steps.
+    if ( reaction.started == FALSE )
+    {
+
+        STEPPER_move_stnb( STEPPER_BOTH,
+            ( reaction.current.motion.speed_L < 0 ) ? STEPPER_REV : STEPPER_FWD,
+            reaction.current.motion.steps, abs( reaction.current.motion.speed_L ),
+            400, STEPPER_BRK_OFF,
+            ( reaction.current.motion.speed_R < 0 ) ? STEPPER_REV : STEPPER_FWD,
+            reaction.current.motion.steps, abs( reaction.current.motion.speed_R ),
+            400, STEPPER_BRK_OFF );
+
+        reaction.started = TRUE;
+
+    } // end if()
+    else
+    {
+
+        steps_left = STEPPER_get_nSteps();
+
+        if ( ( steps_left.left == 0 ) && ( steps_left.right == 0 ) )
+        {
+
+            reaction.moving = FALSE;
+            return;
+
+        } // end if()
+
+    } // end else.
+
+    // REACTING tells 'act()' the step move has the wheels.
+    pAction->state = REACTING;
+    pAction->speed_L = reaction.current.motion.speed_L;
+    pAction->speed_R = reaction.current.motion.speed_R;
+    pAction->accel_L = 400;
+    pAction->accel_R = 400;
+
+} // end react()
+// -------------------------------------------- //
 void IR_avoid( volatile MOTOR_ACTION *pAction, volatile SENSOR_DATA *pSensors )
 {
 
@@ -577,8 +1387,10 @@ void act( volatile MOTOR_ACTION *pAction )
     {
 
         // Perform the action.  Just call the 'free-running' version
-        // of stepper move function and feed these same parameters.
-        __MOTOR_ACTION( *pAction );
+        // of stepper move function and feed these same parameters --
+        // unless a reaction's step move has the wheels.
+        if ( pAction->state != REACTING )
+            __MOTOR_ACTION( *pAction );
 
         // Save the previous action.
         previous_action = *pAction;
@@ -591,6 +1403,10 @@ void CBOT_main( void )
 {
 
     volatile SENSOR_DATA sensor_data;
+
+    // Nothing read from the Pixy yet.
+    sensor_data.pixy_frame = 0;
+    sensor_data.pixy_seq = 0;
     
     // ** Open the needed modules.
     LED_open();     // Open the LED subsystem module.
@@ -602,10 +1418,9 @@ void CBOT_main( void )
     if ( PIXY_open() == SUBSYS_OPEN )
     {
 
-        // Register the pixy structure, but NO callback.  The 'type casting'
-        // is to eliminate the warning from 'sensor_data' being declared 
-        // as 'volatile' above.
-        PIXY_register_callback( NULL, (PIXY_DATA *) &sensor_data.pixy_data );
+        // Register the callback and its landing structure.  Behaviors
+        // only ever see frames through 'pixy_read()'.
+        PIXY_register_callback( pixy_callback, &pixy_rx );
 
         // Start tracking.
         PIXY_track_start();
@@ -649,12 +1464,23 @@ void CBOT_main( void )
         // Sense must always happen first.
         // (IR sense happens every 125ms).
         IR_sense( &sensor_data, 125 );
+
+        // Keep any song going.
+        speaker_service( SPKR_TICK_MS );
         
         // Behaviors.
         cruise( &action );
 
+        // Handle anything the interrupts posted, and group the Pixy's
+        // blocks into frames.
+        events_dispatch();
+        pixy_frame_close( PIXY_TICK_MS );
+
         // Process pixy data, _if_ there is new data to process.
         pixy_process( &action, &sensor_data );
+
+        // Carry out any color signature reaction it started.
+        react( &action, REACT_TICK_MS );
         
         // Note that 'avoidance' relies on sensor data to determine
         // whether or not 'avoidance' is necessary.
@@ -667,8 +1493,6 @@ void CBOT_main( void )
         // except for 'ballistic' behaviors).  Technically this is sort of
         // 'optional' as it does not constitute a 'behavior'.
         info_display( &action );
-		
-		DELAY_ms(20);
         
     } // end while()
     
@@ -0,0 +1,36 @@
+/* Auth: Megan Bird & Gary Miller
+ * File: config.h
+ * Course: CEEN-3450  Mobile Robotics I  University of Nebraska-Lincoln
+ * Lab: Unified image (Labs 6 - 9)
+ * Date: 4/27/2017
+ * Desc: Every buffer in the image is sized here.  Nothing is allocated at
+ *       run time -- the firmware has no heap -- so these plus the globals
+ *       in main.c are all the RAM there is, and 'avr-size -C' counts it.
+ *
+ *       The CEENBoT library still calls malloc()/free(): TMRSRVC_new() for
+ *       a 4-byte node per timer (TMRSRVC_delay() makes one and frees it
+ *       when it expires) and SPKR_open( SPKR_TONE_MODE ) for its frequency
+ *       table.  main.c answers those from the fixed pools sized below, so
+ *       avr-libc's allocator is never linked.  The post-build step checks
+ *       for it ('__brkval' in the image) and fails the build if it shows up.
+ */
+
+#ifndef CONFIG_H
+#define CONFIG_H
+
+// ---------------------- Buffers:
+#define FMT_BUF_LEN			16		/* Big enough for any fmt_*() result: sign, 10 digits, point, decimals. */
+#define TLM_TX_LEN			64		/* UART TX ring size (at most 256). */
+#define TUNE_RX_LEN			16		/* Longest encoded command frame, delimiter included. */
+#define COURSE_BINS			64		/* Max bins per lap -- anything longer piles into the last bin. */
+#define PIXY_MAX_BLOCKS		6		/* Blocks kept per Pixy frame. */
+#define EVT_QUEUE_LEN		8		/* Events that can be waiting to be dispatched. */
+#define SPKR_QUEUE_LEN		4		/* Songs that can be waiting to play. */
+#define REACT_MSG_LEN		48		/* Longest reaction message, with terminator. */
+
+// ---------------------- Library allocation pools:
+#define MEM_NODE_BYTES		4		/* TMRSRVC_new()'s timer node. */
+#define MEM_NODES			16		/* 12 timers in main.c, one TMRSRVC_delay() at a time, and spares. */
+#define MEM_BLOCK_BYTES		288		/* SPKR tone mode frequency table. */
+
+#endif /* CONFIG_H */
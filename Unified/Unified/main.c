@@ -0,0 +1,4576 @@
+/* Auth: Megan Bird & Gary Miller
+ * File: main.c
+ * Course: CEEN-3450  Mobile Robotics I  University of Nebraska-Lincoln
+ * Lab: Unified image (Labs 6 - 9)
+ * Date: 4/26/2017
+ * Desc: Every behavior from the labs in one image.  The mode (which set of
+ *       behaviors is arbitrated) is picked at boot with S3/S4/S5 and kept in
+ *       EEPROM, so switching tasks no longer means reflashing.
+ *
+ *       Flash budget: the behaviors only one mode uses are put in their own
+ *       '.text.mode.<name>' section with MODE_TEXT(), and the post-build step
+ *       in Unified.cproj writes 'avr-size -A' of main.o (one line per mode
+ *       section) and 'avr-size -C' of the image (total against the 32 KB) to
+ *       <config>\Unified.modes.txt.  Everything else is shared by all modes.
+ *
+ *       RAM budget: there's no heap -- every buffer is sized in config.h.
+ *       Free RAM is painted at reset and every telemetry frame carries the
+ *       stack high-water mark and the free gap below it (lowest and
+ *       current).  The build also writes <config>\Unified.stack.txt,
+ *       gcc's per-function stack usage (-fstack-usage), for the worst-case
+ *       depth of any one call.
+ */
+
+// Behavior-Based Control Skeleton code.
+//
+// Desc: Provides a C program structure that emulates multi-tasking and
+//       modularity for Behavior-based control with easy scalability.
+//
+// Supplied for: Students of Mobile Robotics I, Fall 2013.
+// University of Nebraska-Lincoln Dept. of Computer & Electronics Engineering
+// Alisa N. Gilmore, P.E., Instructor, Course Developer.  Jose Santos, T.A.
+// Version 1.3  Updated 10/11/2011.
+// Version 1.4  Updated 12/2/2013
+//
+//      - Updated __MOTOR_ACTION() macro-function to invoke new functions
+//        added to the API: `STEPPER_set_accel2()' and `STEPPER_run2()'.
+//        In particular `STEPPER_run2()' now takes positive or negative
+//        speed values to imply the direction of each wheel.
+//
+// Version 1.5  Updated 2/25/2015
+//
+//      - Fixed an error in __MOTOR_ACTION() and __RESET_ACTION() macros
+//        where there was an extra curly brace ({) that should have been
+//        removed.
+//
+// Version 1.6  Updated 2/24/2016
+//
+//      - In the 'IR_sense()' function, we now make use of the 'TIMER_ALARM()'
+//        and 'TIMER_SNOOZE()' macros that were introduced in API version 2.x,
+//        which makes usage of the timer object clear.   Before, students
+//        manipulated the 'tc' flag inside the timer object directly, but this
+//        always caused confusion, the 'TIMER_ALARM()' and 'TIMER_SNOOZE()'
+//        macros achieve the same thing, but transparently.
+//
+//      - Also fixed __MOTOR_ACTION() macro, which previously invoked
+//        'STEPPER_run2()', but the API has been modified so that this same
+//        effect is now achieved with the function 'STEPPER_runn()', which
+//        means to run the stepper motors and allow negative values to mean
+//        reverse motion (that's what the second 'n' in 'runn' stands for).
+//        This might change again in the future, because for consistency in the
+//        API, it should have been called 'STEPPER_runn2()' since it takes two
+//        parameters and not just one.
+//
+
+#include "capi324v221.h"
+#include "config.h"
+#include "tune.h"
+#include <math.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <avr/eeprom.h>
+#include <avr/pgmspace.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/crc16.h>
+
+// ---------------------- Defines:
+
+// Tunables.  These read the RAM copy of the EEPROM parameter block (see
+// PARAMS), so they can be changed without a rebuild.  The *_DEF values are
+// the compiled-in defaults used when EEPROM holds nothing valid.
+#define DEG_90				( params.deg_90 )			/* Number of steps for a 90-degree (in place) turn. */
+#define LINE_BASE_SPEED		( params.line_base_speed )	/* Fixed line following speed (also used on the learning lap). */
+#define WALL_BASE_SPEED		( params.wall_base_speed )	/* Wall following speed. */
+#define WALL_GOAL_PERP		( params.wall_goal_perp )	/* Perpendicular distance to hold from the wall, cm. */
+
+#define DEG_90_DEF			135
+#define LINE_BASE_SPEED_DEF	150
+#define WALL_BASE_SPEED_DEF	150
+#define SONAR_TRIGGER_DEF	85		/* Sonar_Avoid() steers away from anything closer than this, cm. */
+#define WALL_GOAL_PERP_DEF	( 25.4 + 10.00 )	/* 10 in to the wall plus the sensor-to-center offset. */
+#define LINE_THRESH_DEF		1.5		/* Both line sensors below this means we're on the line, V. */
+#define EXIT_THRESH_DEF		3.0		/* Both line sensors above this means the line is gone, V. */
+
+#define PARAMS_MAGIC		0x5A17	/* Marks a parameter block in EEPROM. */
+#define PARAMS_VERSION		4		/* Bumped whenever PARAMS changes layout. */
+
+#define PIXY_ZONE_X_DEF		15		/* Pixy_Follow() doesn't turn for targets this close to center, pixels. */
+#define FOLLOW_STANDOFF_DEF	40		/* Distance Pixy_Follow() holds from the target, cm. */
+
+// Desc: Puts a function that only one mode uses in that mode's own text
+//       section, so the post-build size report can show what each mode costs.
+#define MODE_TEXT( mode )	__attribute__(( section( ".text.mode." #mode ) ))
+
+#define MODE_MENU_MS		( params.menu_ms )	/* The boot menu starts the selected mode after this long with no input. */
+#define MODE_MENU_MS_DEF	3000	/* 0 skips the menu and starts the saved mode (S3 held at power-on brings it back). */
+#define MODE_POLL_MS		50		/* How often the boot menu looks at the buttons. */
+#define MODE_USES_SONAR( m )	( ( ( m ) == MODE_WALL ) || ( ( m ) == MODE_LIGHT ) )
+
+#define BOOT_TICK_MS		1		/* Boot clock resolution. */
+#define CAL_SAMPLE_MS		2		/* Boot calibration ADC sample period. */
+#define CAL_MIN_SAMPLES		32		/* ADC samples boot calibration needs before any mode starts. */
+#define CAL_MAX_SAMPLES		4096	/* Stop summing after this many -- plenty, and the sums can't overflow. */
+#define CAL_SONAR_MS		50		/* Time between sonar self-test pings (lets the last echo die out). */
+#define CAL_SONAR_PINGS		4		/* Pings in the sonar self-test. */
+#define CAL_SONAR_GOOD		2		/* Pings that have to come back in range to pass. */
+#define CAL_SONAR_MIN_CM	2.0		/* Sonar self-test valid range, cm. */
+#define CAL_SONAR_MAX_CM	330.0
+#define LINE_OFFSET_DEF		1.5		/* Right line sensor reads this much above the left over the same surface, V. */
+#define LINE_OFFSET_TOL		0.75	/* A calibrated offset further than this from LINE_OFFSET_DEF is thrown out, V. */
+#define PHOTO_SENSE_MS		250		/* Photo-sensor sample period. */
+#define CRUISE_SPEED		150		/* Cruise() speed. */
+
+#define SEARCH_SPEED		150		/* Outer-wheel speed while searching for a lost line. */
+#define SEARCH_INNER_START	0		/* Inner-wheel speed when the search starts (tight arc). */
+#define SEARCH_INNER_STEP	2		/* Inner-wheel speed added every search tick (arc opens up). */
+#define SEARCH_TICK_MS		50		/* How often the search arc is widened. */
+#define SEARCH_TIMEOUT_MS	3000	/* Give up and let Cruise() take over after this long. */
+
+#define GAIN_POINTS			4		/* Number of points in each gain schedule. */
+
+#define LINE_SENSE_MS		( params.line_sense_ms )	/* Line sensor sample period. */
+#define SONAR_SENSE_MS		( params.sonar_sense_ms )	/* Sonar sample period. */
+#define LINE_SENSE_MS_DEF	10
+#define SONAR_SENSE_MS_DEF	125
+
+// WALL_GOAL_DIST is WALL_GOAL_PERP measured along the sonar beam, which looks
+// at the wall at 45 degrees.
+#define WALL_GOAL_DIST		( WALL_GOAL_PERP * 1.41 )
+
+#define CM_PER_STEP			0.16	/* Wheel travel per step, in cm. */
+#define WHEEL_BASE_CM		( 4 * DEG_90 * CM_PER_STEP / M_PI )	/* From the in-place 90-degree turn. */
+
+#define SONAR_ANGLE			( M_PI / 4 )	/* Sonar beam angle off the heading, toward the wall. */
+#define WALL_BASELINE_CM	3.0		/* Min travel between the two ranges used for the wall angle. */
+#define WALL_ANGLE_FILTER	0.5		/* Weight given to each new wall angle estimate. */
+#define WALL_ZETA			0.8		/* Damping ratio the wall controller is set up for. */
+
+#define CORNER_JUMP_CM		40.0	/* Jump in range that means the wall just ended. */
+#define CORNER_GONE_READS	2		/* Wall-gone readings in a row that start a corner. */
+#define CORNER_MAX_ARC		M_PI	/* Give up on finding the wall again after this much arc. */
+#define CORNER_SETTLE_CM	10.0	/* Range within this of the goal counts as 'wall found'. */
+#define CORNER_SETTLE_READS	2		/* Readings in a row that must be settled to resume. */
+
+#define TUNE_RELAY_LINE		40		/* Relay turn amplitude when tuning line following. */
+#define TUNE_RELAY_WALL		40		/* Relay turn amplitude when tuning wall following. */
+#define TUNE_HYST_LINE		0.1		/* Relay hysteresis for the line, in volts. */
+#define TUNE_HYST_WALL		2.0		/* Relay hysteresis for the wall, in cm. */
+#define TUNE_SKIP_CYCLES	2		/* Oscillation cycles to let settle before measuring. */
+#define TUNE_CYCLES			4		/* Oscillation cycles averaged for Ku and Tu. */
+#define TUNE_TIMEOUT_MS		20000	/* Give up if the relay hasn't produced a result by now. */
+
+#define LCD_ROWS			4		/* LCD size, in characters. */
+#define LCD_COLS			20
+#define LCD_FLUSH_MS		5		/* How often the LCD framebuffer is flushed. */
+#define LCD_FLUSH_BYTES		4		/* Max characters sent to the LCD per flush. */
+
+#define SONAR_FRAC_BITS		8		/* Sonar distance is shown as Q8 (1/256 cm). */
+
+#define ADC_TO_MV( s )		( ( unsigned short )( ( ( unsigned long )( s ) * 5000UL ) >> 10 ) )	/* 10-bit sample to mV, AVCC reference. */
+#define MV_TO_V( mv )		( ( mv ) * 0.001 )
+#define MM_TO_CM( mm )		( ( mm ) * 0.1 )
+#define SENSE_STAMP()		( ( unsigned short ) odometry.time_ms )	/* Timestamp for SENSOR_DATA, ms. */
+
+#define ODOM_INTERVAL_MS	20		/* Odometry tick -- wheel speeds are ramped and integrated in steps this long. */
+
+#define TLM_BAUD			38400	/* Telemetry UART (USART0) baud rate. */
+#define TLM_UBRR			( ( F_CPU / ( 8UL * TLM_BAUD ) ) - 1 )	/* Double-speed mode: 0.2% error at 20 MHz. */
+#define TLM_PERIOD_MS		100		/* How often a telemetry frame is sent. */
+#define STACK_CANARY		0xC5	/* Painted over free RAM at reset; bytes still this were never touched. */
+#define TLM_VERSION			6		/* Bumped whenever TLM_FRAME changes -- update Host/tlm.c to match. */
+
+
+#define COURSE_BIN_STEPS	128		/* Distance covered by one course profile bin, in steps. */
+#define COURSE_LAP_TURN		( 8 * DEG_90 )	/* Right-minus-left steps for one full 360-degree turn. */
+#define COURSE_LOOKAHEAD	2		/* Bins to look ahead when picking a speed. */
+#define COURSE_ERR_SCALE	50		/* Profile units per volt of line error. */
+#define COURSE_STRAIGHT_ERR	25		/* Peak error (profile units) still treated as a straight. */
+#define COURSE_CURVE_ERR	75		/* Peak error at or above this is treated as a full curve. */
+#define COURSE_FAST_SPEED	230		/* Speed on known straights. */
+#define COURSE_SLOW_SPEED	130		/* Speed going into known curves. */
+
+#define PIXY_TICK_MS		5		/* Resolution of Pixy frame timing. */
+#define PIXY_WINDOW_MS		10		/* A frame is closed this long after its first block. */
+#define PIXY_HOLD_MS		200		/* Pixy_Trigger() keeps acting on a frame this long. */
+#define PIXY_NO_BLOCK		0xFF	/* pixy_select() found nothing. */
+#define PIXY_ALL_SIGS		0xFF	/* Signature mask that takes every signature. */
+#define PIXY_SIGNATURES		8		/* Pixy color signatures are numbered 1-7. */
+
+// Desc: Area of a Pixy block, in pixels.
+#define PIXY_AREA( block ) \
+	( ( unsigned long )( block ).size.width * ( block ).size.height )
+
+#define PIXY_CENTER_X		160		/* Center of the Pixy image, in pixels. */
+#define PIXY_CENTER_Y		120
+
+#define TRACK_LATENCY_MS	60		/* Exposure + processing + transfer, from capture to Pixy_Follow(). */
+#define TRACK_ALPHA			0.5		/* Alpha-beta filter position gain. */
+#define TRACK_BETA			( TRACK_ALPHA * TRACK_ALPHA / ( 2 - TRACK_ALPHA ) )	/* Benedict-Bordner: balances noise against lag in turns. */
+#define TRACK_LOST_MS		500		/* Time with no Pixy frames before the track is dropped. */
+
+#define RANGE_CAL_SAMPLES	10		/* Pixy frames averaged per calibration point. */
+#define RANGE_CAL_TIMEOUT_MS	3000	/* A point that can't get its samples in this long fails the calibration. */
+#define RANGE_CAL_MAGIC		0x5A3C	/* Marks a valid calibration in EEPROM. */
+
+#define FOLLOW_ZONE_CM		3		/* Range dead zone around the standoff. */
+#define FOLLOW_KP_RANGE		5		/* Steps/sec of forward speed per cm of range error. */
+#define FOLLOW_MAX_SPEED	200		/* Fastest the robot closes on / backs off from the target. */
+
+#define SPKR_TICK_MS		10		/* Resolution of the speaker sequencer. */
+
+#define NOTE_WHOLE			2000	/* Length of a whole note, in ms. */
+#define NOTE_SIXTEENTH		( NOTE_WHOLE / 16 )
+#define NOTE_ARTIC_PCT		90		/* Percent of a note that sounds; the rest is silence. */
+
+// Desc: Songs are stored in flash as one 16-bit word per note:
+//       note (4 bits) | octave (3 bits) | length in sixteenths (9 bits).
+//       A rest is SPKR_NOTE_NONE.  These build and pick apart that word.
+#define SEQ_NOTE( note, octave, len16 ) \
+	( ( ( unsigned short int )( note ) << 12 ) | \
+	  ( ( unsigned short int )( octave ) << 9 ) | ( len16 ) )
+#define SEQ_REST( len16 )			SEQ_NOTE( SPKR_NOTE_NONE, 0, len16 )
+#define SEQ_NOTE_NOTE( word )		( ( SPKR_NOTE )( ( word ) >> 12 ) )
+#define SEQ_NOTE_OCTAVE( word )		( ( unsigned char )( ( ( word ) >> 9 ) & 0x07 ) )
+#define SEQ_NOTE_LEN( word )		( ( word ) & 0x01FF )
+
+// Desc: Number of entries in a table -- keeps the counts in the song
+//       tables from drifting out of step with the notes.
+#define SEQ_COUNT( table )			( sizeof( table ) / sizeof( ( table )[ 0 ] ) )
+
+#define REACT_TICK_MS		10		/* Resolution of the signature cooldowns. */
+
+
+// Desc: This macro-function can be used to reset a motor-action structure
+//       easily.  It is a helper macro-function.
+#define __RESET_ACTION( motor_action )    \
+do {									  \
+	( motor_action ).speed_L = 0;         \
+	( motor_action ).speed_R = 0;         \
+	( motor_action ).accel_L = 0;         \
+	( motor_action ).accel_R = 0;         \
+	( motor_action ).state = STARTUP;     \
+} while( 0 ) /* end __RESET_ACTION() */
+
+
+
+// Desc: This macro-fuction translates action to motion -- it is a helper
+//       macro-function.
+#define __MOTOR_ACTION( motor_action )   \
+do {                                     \
+	STEPPER_set_accel2( ( motor_action ).accel_L, ( motor_action ).accel_R ); \
+	STEPPER_runn( ( motor_action ).speed_L, ( motor_action ).speed_R );       \
+} while( 0 ) /* end __MOTOR_ACTION() */
+
+// Desc: This macro-function is used to set the action, in a more natural
+//       manner (as if it was a function).
+
+
+
+// ---------------------- Type Declarations:
+
+
+// Desc: The following custom enumerated type can be used to specify the
+//       current state of the robot.  This parameter can be expanded upon
+//       as complexity grows without interfering with the 'act()' function.
+//		 It is a new type which can take the values of 0, 1, or 2 using
+//		 the SYMBOLIC representations of STARTUP, EXPLORING, etc.
+typedef enum ROBOT_STATE_TYPE {
+
+	STARTUP = 0,    // 'Startup' state -- initial state upon RESET.
+	CRUISING,       // 'Cruising' state -- the robot is 'roaming around'.
+	HOMING,		    // 'Homing' state -- the robot is 'homing towards the light'.
+	IR_AVOIDING,    // 'IR Avoiding' state -- the robot is avoiding a collision using IR.
+	SONAR_AVOIDING,	// 'Sonar Avoiding' state -- the robot is avoiding a collision using sonar.
+	WALL_FOLLOWING,	// 'Wall Following' state -- the bot is following the wall at a desired distance.
+	LINE_FOLLOWING,	// 'Line Following" state -- the bot is following the white line on the floor.		
+	LINE_SEARCHING,	// 'Line Searching' state -- the bot lost the line and is sweeping to find it again.
+	AUTO_TUNING,	// 'Auto Tuning' state -- relay experiment to find the PD gains.
+	FOLLOWING,		// 'Following' state -- the robot is following a Pixy object.
+	REACTING		// 'Reacting' state -- the robot is reacting to a Pixy color signature.
+} ROBOT_STATE;
+
+
+
+		
+// Desc: Structure encapsulates a 'motor' action. It contains parameters that
+//       controls the motors 'down the line' with information depicting the
+//       current state of the robot.  The 'state' variable is useful to
+//       'print' information on the LCD based on the current 'state', for
+//       example.
+typedef struct MOTOR_ACTION_TYPE {
+
+	ROBOT_STATE state;              // Holds the current STATE of the robot.
+	signed short int speed_L;       // SPEED for LEFT  motor.
+	signed short int speed_R;       // SPEED for RIGHT motor.
+	unsigned short int accel_L;     // ACCELERATION for LEFT  motor.
+	unsigned short int accel_R;     // ACCELERATION for RIGHT motor.
+			
+} MOTOR_ACTION;
+
+// Desc: The motor command last published.  Behaviors build a MOTOR_ACTION
+//       each pass through action_state()/action_speed()/action_accel(),
+//       which note in 'action_changed' any field they leave different from
+//       this.  action_publish() copies the winner in and bumps 'version'
+//       only then, so anything downstream finds out about a new command
+//       with one byte compare.  Packed, the command is 9 bytes (the enum is
+//       1 byte under -fshort-enums).  Only the loop may publish -- the
+//       setters and action_publish() update 'action_changed' unguarded --
+//       but an interrupt may read the command with action_snapshot().
+typedef struct MOTOR_COMMAND_TYPE {
+
+	unsigned char version;			// Bumped on every change (wraps).
+	MOTOR_ACTION action;			// The command itself.
+
+} MOTOR_COMMAND;
+
+// Desc: Bits in 'action_changed', one per MOTOR_ACTION field.
+#define ACTION_STATE		0x01
+#define ACTION_SPEED_L		0x02
+#define ACTION_SPEED_R		0x04
+#define ACTION_ACCEL_L		0x08
+#define ACTION_ACCEL_R		0x10
+
+
+		
+// Desc: Structure encapsulates 'sensed' data.  Readings are kept as the
+//       integers the hardware gives (mV, mm) and the on/off states as bits,
+//       so copying it, framing it for telemetry and comparing readings never
+//       touch soft-float; behaviors that do float math convert locally with
+//       MV_TO_V() / MM_TO_CM().  Each sensor group also notes when it was
+//       last read, on the odometry clock.
+//
+//       Footprint (packed): 24 bytes ahead of the Pixy fields -- 1 of bits,
+//       15 of readings, 8 of timestamps.  The same readings as floats and
+//       BOOLs took 31 bytes, without timestamps.
+typedef struct SENSOR_DATA_TYPE {
+
+	unsigned char left_IR : 1;		// Holds the state of the left IR.
+	unsigned char right_IR : 1;		// Holds the state of the right IR.
+	unsigned char sw3 : 1;			// Push-button states, read along with the IR.
+	unsigned char sw4 : 1;
+	unsigned char sw5 : 1;
+
+	unsigned short left_photo_mv;			// Left photo-sensor, mV.
+	unsigned short right_photo_mv;			// Right photo-sensor, mV.
+	unsigned short left_photo_ambient_mv;	// Left photo-sensor ambient from boot calibration, mV.
+	unsigned short right_photo_ambient_mv;	// Right photo-sensor ambient from boot calibration, mV.
+
+	unsigned short sonar_mm;		// Sonar distance, mm.
+	unsigned char sonar_seq;		// Bumped on every new sonar reading.
+	
+	unsigned short left_line_mv;	// Left line following sensor, mV.
+	unsigned short right_line_mv;	// Right line following sensor, mV.
+
+	unsigned short ir_ms;			// Odometry clock (low 16 bits) at each group's last read.
+	unsigned short photo_ms;
+	unsigned short sonar_ms;
+	unsigned short line_ms;
+
+	PIXY_DATA pixy_data;			// Holds relevant PIXY tracking data (the selected block).
+	unsigned short int pixy_frame;	// Number of the frame it came from.
+	unsigned short int pixy_ms;		// Pixy clock when that frame closed.
+	unsigned char pixy_blocks;		// Blocks in that frame.
+	unsigned char pixy_seq;			// Publish count when it was read.
+
+} SENSOR_DATA;
+
+typedef enum { false, true} bool;
+
+// Desc: Structure shared between 'Line_Follow()' and 'Line_Search()'.  Line_Follow()
+//       records whether it has the line and which way it was last steering, so that
+//       Line_Search() knows which way to sweep once the line is lost.
+typedef struct LINE_TRACK_TYPE {
+
+	bool following;				// TRUE while the line is under the sensors.
+	bool lost;					// TRUE once the line was followed and then lost (search pending).
+	signed char last_dir;		// Sign of the last line error: +1 = line was to the right, -1 = left.
+	unsigned short search_ticks;	// Number of SEARCH_TICK_MS ticks spent in the current search.
+	unsigned short reacquire_ms;	// How long the last successful search took, in ms.
+	unsigned char err_mag;		// Magnitude of the last line error, in COURSE_ERR_SCALE units.
+
+} LINE_TRACK;
+
+// Desc: Dead-reckoned wheel travel, from what the wheels were last told: free-running
+//       speeds are ramped at their acceleration the way the stepper driver does it,
+//       and step moves add their exact step counts.  It's a model -- a stalled or
+//       slipping wheel isn't seen.  Units are milli-steps (steps/sec * ms) so nothing
+//       is lost to rounding between updates.
+typedef struct ODOMETRY_TYPE {
+
+	signed long left_msteps;	// Total LEFT  wheel travel, in milli-steps.
+	signed long right_msteps;	// Total RIGHT wheel travel, in milli-steps.
+	unsigned long time_ms;		// Time the odometry has been running.
+	signed long rate_L;			// Modelled LEFT  wheel speed, milli-steps/sec.
+	signed long rate_R;			// Modelled RIGHT wheel speed, milli-steps/sec.
+	signed short target_L;		// Speeds the wheels were last told, steps/sec.
+	signed short target_R;
+	unsigned short accel_L;		// ... and the ramps to get there, steps/sec^2.
+	unsigned short accel_R;
+	unsigned char tick_ms;		// Period of the timer callback.
+	unsigned short ticks;		// Callback ticks not integrated yet.
+
+} ODOMETRY;
+
+// Desc: Distance travelled (steps) and heading (right-minus-left steps) from odometry.
+#define ODOM_DIST( odom )		( ( ( odom ).left_msteps + ( odom ).right_msteps ) / 2000 )
+#define ODOM_HEADING( odom )	( ( ( odom ).right_msteps - ( odom ).left_msteps ) / 1000 )
+
+// Desc: Modes for the two-lap course learner.
+typedef enum COURSE_MODE_TYPE {
+
+	COURSE_OFF = 0,		// Fixed speed line following.
+	COURSE_WAITING,		// Waiting to find the line to start the learning lap.
+	COURSE_LEARNING,	// First lap -- recording the error profile.
+	COURSE_RACING		// Later laps -- scheduling speed from the profile.
+
+} COURSE_MODE;
+
+// Desc: Course profile learned on the first lap.  Each bin holds the peak line error
+//       seen over COURSE_BIN_STEPS of track, which is all that's needed to tell
+//       straights from curves on the following laps.
+typedef struct COURSE_TYPE {
+
+	COURSE_MODE mode;
+	unsigned char profile[ COURSE_BINS ];	// Peak error per bin.
+	unsigned char n_bins;					// Bins in one lap (known after the first lap).
+	signed long lap_start;					// Odometry distance at the start of this lap.
+	signed long lap_heading;				// Odometry heading at the start of this lap.
+	unsigned long lap_start_ms;				// Odometry time at the start of this lap.
+	unsigned long last_lap_ms;				// How long the last full lap took.
+	unsigned char laps;						// Completed laps.
+	signed short base_speed;				// Speed Line_Follow() should run at.
+
+} COURSE;
+
+// Desc: One point of a gain schedule.  The scales multiply the base gains (which
+//       were tuned at 150) and are Q8.8 fixed point, so 256 = 1.0.
+typedef struct GAIN_POINT_TYPE {
+
+	signed short speed;			// Commanded forward speed for this point.
+	unsigned short kp_scale;	// kp multiplier at this speed (Q8.8).
+	unsigned short kd_scale;	// kd multiplier at this speed (Q8.8).
+
+} GAIN_POINT;
+
+// Desc: Wall-relative state estimated from the sonar and odometry.
+typedef struct WALL_STATE_TYPE {
+
+	float dist;					// Perpendicular distance from the sensor to the wall, cm.
+	float angle;				// Heading relative to the wall, radians (+ = toward the wall).
+	float last_range;			// Sonar range at the start of the current baseline.
+	signed long last_left;		// Odometry (milli-steps) at the start of the current baseline.
+	signed long last_right;
+	unsigned char last_seq;		// Last sonar reading consumed.
+	bool valid;					// TRUE once there is a baseline to work from.
+	unsigned char gone;			// Wall-gone readings in a row.
+	signed long gone_left;		// Odometry (milli-steps) at the first of them.
+	signed long gone_right;
+	unsigned long gone_ms;
+
+} WALL_STATE;
+
+// Desc: In-RAM copy of the LCD.  Everything draws into 'shadow'; LCD_flush() sends
+//       the characters that differ from 'screen' (what the LCD is showing) a few at
+//       a time, so drawing costs nothing and the LCD never holds up the loop.
+typedef struct LCD_FB_TYPE {
+
+	char shadow[ LCD_ROWS ][ LCD_COLS ];	// What we want on the screen.
+	char screen[ LCD_ROWS ][ LCD_COLS ];	// What the screen is showing.
+	unsigned char dirty;					// One bit per row that may differ.
+	unsigned char row;						// Row the flush picks up from.
+
+} LCD_FB;
+
+// Desc: Phases of going around an outside corner.
+typedef enum CORNER_PHASE_TYPE {
+
+	CORNER_NONE = 0,	// Following the wall normally.
+	CORNER_STRAIGHT,	// Running on until the bot is level with where the wall ended.
+	CORNER_ARC			// Arcing around the corner at the goal distance.
+
+} CORNER_PHASE;
+
+// Desc: Outside-corner maneuver state.
+typedef struct CORNER_TYPE {
+
+	CORNER_PHASE phase;
+	float lead_cm;				// How far to run on before starting the arc.
+	signed long start_left;		// Odometry (milli-steps) at the start of the current phase.
+	signed long start_right;
+	unsigned long start_ms;		// When the corner was detected.
+	unsigned long last_ms;		// How long the last corner took, start to resume.
+	float max_dev;				// Worst distance error once the new face was found, cm.
+	bool found;					// The arc has picked up the new face.
+	unsigned char settled;		// Settled readings in a row.
+	unsigned char last_seq;		// Last sonar reading consumed.
+
+} CORNER;
+
+// Desc: Which controller the relay auto-tuner is working on.
+typedef enum TUNE_TARGET_TYPE {
+
+	TUNE_NONE = 0,
+	TUNE_LINE,
+	TUNE_WALL
+
+} TUNE_TARGET;
+
+// Desc: Where the relay auto-tuner is in its experiment.
+typedef enum TUNE_PHASE_TYPE {
+
+	TUNE_IDLE = 0,
+	TUNE_RUNNING,
+	TUNE_DONE,
+	TUNE_FAILED
+
+} TUNE_PHASE;
+
+// Desc: State of the relay (Astrom-Hagglund) auto-tuner.
+typedef struct TUNER_TYPE {
+
+	TUNE_TARGET target;
+	TUNE_PHASE phase;
+	signed char relay;				// Current relay output sign (+1/-1).
+	unsigned char cycles;			// Full oscillation cycles seen so far.
+	bool started;					// TRUE once the first pass has set the relay up.
+	unsigned long start_ms;			// When the experiment started.
+	unsigned long cycle_start_ms;	// When the current cycle started.
+	unsigned long period_sum;		// Sum of the measured periods, ms.
+	float amp_sum;					// Sum of the measured amplitudes.
+	float err_max;					// Largest error in the current cycle.
+	float err_min;					// Smallest error in the current cycle.
+
+} TUNER;
+
+// Desc: The parameter block as kept in EEPROM.  'size' catches a PARAMS that
+//       grew without a version bump; 'crc' (CRC-16, init 0xFFFF) covers
+//       everything before it.
+typedef struct PARAM_STORE_TYPE {
+
+	unsigned short magic;			// PARAMS_MAGIC.
+	unsigned char version;			// PARAMS_VERSION.
+	unsigned char size;				// sizeof( PARAMS ).
+	PARAMS params;
+	unsigned short crc;
+
+} PARAM_STORE;
+
+// Desc: One telemetry frame.  Sent packed, little-endian, followed by a
+//       CRC-16/CCITT (init 0xFFFF, low byte first) over the frame, then COBS
+//       encoded and terminated with a 0x00 byte.  Readings are scaled to
+//       integers so the host doesn't have to know AVR float layout.
+typedef struct TLM_FRAME_TYPE {
+
+	unsigned char version;			// TLM_VERSION.
+	unsigned char seq;				// Bumped every frame -- gaps mean lost frames.
+	unsigned long time_ms;			// Odometry clock.
+	unsigned char mode;				// MODE running.
+	unsigned char state;			// ROBOT_STATE.
+	signed short speed_L;			// Commanded wheel speeds, steps/sec.
+	signed short speed_R;
+	unsigned char ir;				// Bit 0 = left IR, bit 1 = right IR, bits 2-4 = S3-S5.
+	unsigned short left_photo_mv;	// Photo-sensor voltages, mV.
+	unsigned short right_photo_mv;
+	unsigned short sonar_mm;		// Sonar distance, mm.
+	unsigned short left_line_mv;	// Line sensor voltages, mV.
+	unsigned short right_line_mv;
+	unsigned short loops;			// Trips around the arbitration loop since the last frame.
+	unsigned char dropped;			// Frames dropped for lack of TX buffer room.
+	unsigned short boot_ms;			// CBOT_main() to the first motor command, ms (0 until then).
+	unsigned short stack_max;		// Deepest the stack has been, bytes.
+	unsigned short ram_free_min;	// Least free RAM there has been below the stack, bytes.
+	unsigned short ram_gap;			// Free RAM below the stack right now, bytes.
+	unsigned char mem_failed;		// malloc() requests the pools couldn't meet.
+
+} TLM_FRAME;
+
+// Desc: Telemetry UART transmit ring.  The main loop fills it from 'tail',
+//       the UDRE interrupt empties it from 'head'.  Both are single bytes,
+//       so neither side has to lock the other out.
+typedef struct TLM_TX_TYPE {
+
+	unsigned char buf[ TLM_TX_LEN ];
+	volatile unsigned char head;	// Next byte to send.
+	volatile unsigned char tail;	// Next free slot.
+	unsigned char seq;				// Sequence number for the next frame.
+	unsigned char dropped;			// Frames dropped so far.
+	unsigned short loops;			// Loop passes since the last frame.
+
+} TLM_TX;
+
+// Desc: Command receiver.  The RX interrupt collects bytes in 'buf' and,
+//       on a 0x00, hands the frame over in 'frame' if the loop has picked
+//       up the last one.  Commands are only ever applied by the loop.
+typedef struct TUNE_RX_TYPE {
+
+	unsigned char buf[ TUNE_RX_LEN ];
+	unsigned char len;
+	unsigned char frame[ TUNE_RX_LEN ];
+	unsigned char frame_len;
+	volatile BOOL ready;			// 'frame' holds a command for the loop.
+	unsigned char dropped;			// Frames dropped (overlong, or loop busy).
+
+} TUNE_RX;
+
+// Desc: Boot calibration, gathered while the boot menu is up.  ADC channels
+//       6 and 4 carry the photo-sensors in MODE_LIGHT and the line sensors in
+//       the line modes, so one pair of sums serves both.
+typedef struct CAL_TYPE {
+
+	unsigned long left_sum;			// ADC channel 6 samples, summed.
+	unsigned long right_sum;		// ADC channel 4 samples, summed.
+	unsigned short samples;			// Samples in each sum.
+	unsigned char pings;			// Sonar self-test pings so far.
+	unsigned char pings_good;		// ... and how many came back in range.
+	float line_offset;				// Right line sensor minus left, V.
+
+} CAL;
+
+// Desc: Boot timing.  'ms' is counted in the timer interrupt from the
+//       first boot_clock() call until boot_clock_stop() at the first motor
+//       command.
+typedef struct BOOT_TYPE {
+
+	volatile unsigned long ms;		// Time since CBOT_main() started.
+	unsigned short first_output_ms;	// Time to the first motor command, 0 until then, 0xFFFF at most.
+	TIMEROBJ timer;					// Calls boot_tick() every BOOT_TICK_MS.
+
+} BOOT;
+
+// Desc: RAM headroom, from the paint 'stack_paint()' leaves over free RAM.
+//       There's no heap, so everything from the end of .bss to the top of
+//       RAM is the stack's; whatever paint is left was never used.
+typedef struct RAM_STATS_TYPE {
+
+	unsigned short stack_max;		// Deepest the stack has been, bytes.
+	unsigned short free_min;		// Paint left below the stack, bytes.
+	unsigned short gap;				// End of .bss to the stack pointer right now, bytes.
+	unsigned char mem_failed;		// malloc() requests the pools couldn't meet.
+
+} RAM_STATS;
+
+// Desc: One block of the small-allocation pool.  Free blocks are chained
+//       through 'next'; handed out, the whole block is the caller's.
+typedef union MEM_NODE_TYPE {
+
+	union MEM_NODE_TYPE *next;
+	unsigned char bytes[ MEM_NODE_BYTES ];
+
+} MEM_NODE;
+
+// Desc: Alpha-beta filter state for one image axis.  Position is in pixels
+//       from the image center and velocity in pixels per ms, so frames
+//       that come late or get dropped don't throw it off.
+typedef struct AB_AXIS_TYPE {
+
+	float pos;				// Filtered position.
+	float vel;				// Filtered velocity.
+
+} AB_AXIS;
+
+// Desc: Estimated state of the target being followed.
+typedef struct TARGET_TRACK_TYPE {
+
+	AB_AXIS x;				// Right of center is positive.
+	AB_AXIS range;			// Distance to the target, in cm.
+	BOOL valid;				// TRUE once the filter has been seeded.
+	unsigned short int time_ms;	// Pixy clock of the frame last filtered.
+	signed short int speed_L;	// Follow command from the last frame, held
+	signed short int speed_R;	// until the next one.
+
+} TARGET_TRACK;
+
+// Desc: Blob size -> range calibration.  'size[ i ]' is the apparent size
+//       (in pixels) of the target at RANGE_CAL_FIRST_CM + i * RANGE_CAL_STEP_CM,
+//       so it shrinks from one entry to the next.
+typedef struct RANGE_CAL_TYPE {
+
+	unsigned short int magic;						// RANGE_CAL_MAGIC when valid.
+	unsigned short int size[ RANGE_CAL_POINTS ];	// Apparent size at each range.
+
+} RANGE_CAL;
+
+// Desc: The blocks the Pixy reported in one frame, with a running frame
+//       number so consumers can tell frames apart (and count any they
+//       missed).
+typedef struct PIXY_FRAME_TYPE {
+
+	PIXY_DATA block[ PIXY_MAX_BLOCKS ];		// Blocks, in the order they came in.
+	unsigned char n_blocks;					// How many.
+	unsigned short int frame;				// Frame number, counting from 1.
+	unsigned short int time_ms;				// Pixy clock when it closed.
+
+} PIXY_FRAME;
+
+// Desc: Frame rate and loss counters for the Pixy handoff.  The 8-bit
+//       counters are bumped from the interrupt, so they're kept to a size
+//       that can be read in one go.
+typedef struct PIXY_STATS_TYPE {
+
+	unsigned short int frames;		// Frames closed.
+	unsigned char fps;				// Frames closed in the last second.
+	unsigned short int dropped;		// Frames replaced before a behavior read them.
+	unsigned char overflow;			// Blocks that didn't fit in a frame's table.
+	unsigned char lost_events;		// Events the queue had no room for.
+	unsigned short int age_ms;		// Time since the last frame closed.
+
+} PIXY_STATS;
+
+// Desc: Events posted from interrupt context for the main loop to handle.
+typedef enum EVENT_TYPE {
+
+	EVT_NONE = 0,			// Queue is empty.
+	EVT_PIXY_BLOCK,			// First block of a new Pixy frame came in.
+
+} EVENT;
+
+// Desc: How 'pixy_select()' picks one block out of a frame.
+typedef enum PIXY_SELECT_TYPE {
+
+	SELECT_LARGEST = 0,		// Biggest area.
+	SELECT_NEAREST,			// Same signature as last time, closest to where it was.
+	SELECT_PRIORITY,		// Lowest signature number, then biggest area.
+
+} PIXY_SELECT;
+
+// Desc: Songs for the speaker sequencer.  Same song -> measure -> note
+//       layering (with repeat counts) as SPKR_SONG/SPKR_MEASURE/SPKR_PLAYNOTE,
+//       but kept in flash (PROGMEM) and walked a note at a time from the
+//       main loop instead of handed to the blocking SPKR_play_song().
+//       Notes are encoded with SEQ_NOTE().
+typedef struct SEQ_MEASURE_TYPE {
+
+	const unsigned short int *notes;	// Notes in this measure (in flash).
+	unsigned char n_notes;				// How many.
+	unsigned char repeat;				// Times the measure is played.
+
+} SEQ_MEASURE;
+
+typedef struct SEQ_SONG_TYPE {
+
+	const SEQ_MEASURE *measures;	// Measures in this song (in flash).
+	unsigned char n_measures;		// How many.
+	unsigned char repeat;			// Times the song is played.
+
+} SEQ_SONG;
+
+// Desc: A non-blocking step move: each wheel turns 'steps' steps at its
+//       speed (the sign gives the direction), run by the 'React()' behavior,
+//       then control goes back to the lower behaviors.
+typedef struct MOTION_TYPE {
+
+	signed short int speed_L;		// SPEED for LEFT  motor.
+	signed short int speed_R;		// SPEED for RIGHT motor.
+	unsigned short int steps;		// Steps for each wheel.
+
+} MOTION;
+
+// Desc: What the robot does when it sees a color signature.  The table of
+//       these lives in flash and is indexed directly by signature number.
+typedef struct REACTION_TYPE {
+
+	const SEQ_SONG *song;			// Song to play (in flash), or NULL.
+	MOTION motion;					// Motion to make, 'steps' of 0 for none.
+	const char *message;			// LCD message (in flash), or NULL.
+	unsigned short int cooldown_ms;	// Ignore this signature for this long afterwards.
+
+} REACTION;
+
+// Desc: State of the reaction in progress, and how long until each
+//       signature is allowed to trigger again.
+typedef struct REACT_STATE_TYPE {
+
+	REACTION current;				// RAM copy of the reaction in progress.
+	unsigned char signum;			// Its signature, 0 if none.
+	BOOL moving;					// TRUE until its step move is done.
+	BOOL started;					// TRUE once the step move is under way.
+	unsigned short int cooldown_ms[ PIXY_SIGNATURES ];	// Per signature.
+	volatile unsigned short int ticks;	// Timer ticks not counted off yet (from the interrupt).
+
+} REACT_STATE;
+
+// Desc: Speaker sequencer state.  'speaker_service()' counts down the
+//       current note and moves on to the next one, pulling songs off the
+//       queue when one finishes.
+typedef struct SPKR_SEQ_TYPE {
+
+	const SEQ_SONG *queue[ SPKR_QUEUE_LEN ];	// Songs waiting to play.
+	unsigned char q_head;						// Next song in the queue.
+	unsigned char q_count;						// Songs in the queue.
+
+	const SEQ_SONG *song;			// Song playing now (in flash), NULL if idle.
+	SEQ_SONG song_info;				// RAM copy of '*song'.
+	SEQ_MEASURE measure_info;		// RAM copy of the current measure.
+	unsigned char song_pass;		// Times through the song so far.
+	unsigned char measure;			// Current measure.
+	unsigned char measure_pass;		// Times through the current measure so far.
+	unsigned char note;				// Current note.
+	unsigned short int on_ms;		// Time left sounding the current note.
+	unsigned short int off_ms;		// Time left in the silence after it.
+	volatile unsigned short int ticks;	// Timer ticks not counted off yet (from the interrupt).
+
+} SPKR_SEQ;
+
+// ------------------------------
+// ---------------------- Globals:
+volatile MOTOR_ACTION action;  	// This variable holds parameters that determine
+// the current action that is taking place.
+// Here, a structure named "action" of type
+// MOTOR_ACTION is declared.
+volatile MOTOR_COMMAND motor_cmd;	// Last command published (version 0 = stopped).
+unsigned char action_changed;	// ACTION_* fields of 'action' that differ from 'motor_cmd'.
+
+volatile LINE_TRACK line_track;	// Line state shared by the line behaviors.
+volatile ODOMETRY odometry;		// Dead-reckoned wheel travel.
+volatile COURSE course;			// Course profile for the two-lap learner.
+
+PARAM_STORE EEMEM param_store;	// Parameters and tuned gains, survive a power cycle.
+
+// Compiled-in parameters, used until something valid has been saved.
+const PARAMS param_defaults PROGMEM = {
+
+	DEG_90_DEF,
+	LINE_BASE_SPEED_DEF,
+	WALL_BASE_SPEED_DEF,
+	SONAR_TRIGGER_DEF,
+	WALL_GOAL_PERP_DEF,
+	LINE_THRESH_DEF,
+	EXIT_THRESH_DEF,
+	{ 70, 100 },
+	{ 0.5, 1.5 },
+	LINE_SENSE_MS_DEF,
+	SONAR_SENSE_MS_DEF,
+	MODE_LINE,
+	PIXY_ZONE_X_DEF,
+	FOLLOW_STANDOFF_DEF,
+	MODE_MENU_MS_DEF
+
+};
+
+volatile TUNER tuner;			// Relay auto-tuner state.
+volatile WALL_STATE wall_state;	// Estimated wall distance and angle.
+volatile CORNER corner;			// Outside-corner maneuver state.
+LCD_FB lcd_fb;					// LCD framebuffer.
+TLM_TX tlm_tx;					// Telemetry UART transmit ring.
+TUNE_RX tune_rx;				// Live tuning command receiver.
+MODE mode;						// Mode picked at boot.
+CAL cal = { 0, 0, 0, 0, 0, LINE_OFFSET_DEF };	// Boot calibration.
+BOOT boot;						// Boot timing.
+RAM_STATS ram_stats;			// RAM headroom.
+
+// Linker symbols bounding free RAM: '_end' is the end of .bss, '__stack'
+// the top of RAM.  There's no heap, so it's all stack.
+extern unsigned char _end;
+extern unsigned char __stack;
+
+// Pools the library's malloc() calls are served from (see config.h).
+MEM_NODE mem_nodes[ MEM_NODES ];
+MEM_NODE *mem_free_nodes;		// Free list through 'mem_nodes', built on first use.
+BOOL mem_nodes_ready;
+unsigned char mem_block[ MEM_BLOCK_BYTES ];
+BOOL mem_block_used;
+unsigned char mem_failed;		// Requests that couldn't be met.
+
+// Boot menu names, indexed by MODE.
+const char mode_line_name[] PROGMEM = "LINE FOLLOW";
+const char mode_race_name[] PROGMEM = "LINE RACE";
+const char mode_wall_name[] PROGMEM = "WALL FOLLOW";
+const char mode_light_name[] PROGMEM = "LIGHT HOMING";
+const char mode_pixy_name[] PROGMEM = "PIXY FOLLOW";
+const char mode_react_name[] PROGMEM = "PIXY REACT";
+
+const char * const mode_names[ MODE_COUNT ] PROGMEM = {
+
+	mode_line_name,
+	mode_race_name,
+	mode_wall_name,
+	mode_light_name,
+	mode_pixy_name,
+	mode_react_name
+
+};
+
+// Events from interrupts.  One producer (the interrupt) moves the tail,
+// one consumer (the main loop) moves the head, and both are single bytes,
+// so neither side needs to lock the other out.
+volatile EVENT evt_queue[ EVT_QUEUE_LEN ];
+volatile unsigned char evt_head;
+volatile unsigned char evt_tail;
+
+// Pixy handoff.  The driver writes each block into 'pixy_rx' and calls
+// 'pixy_callback()' from its interrupt, which adds it to the frame being
+// collected in 'pixy_buf[ pixy_collect ]'.  The driver doesn't mark frame
+// boundaries, so the first block of each frame posts EVT_PIXY_BLOCK, and
+// 'pixy_frame_close()' closes the frame PIXY_WINDOW_MS later from the main
+// loop by flipping 'pixy_collect' -- a single byte write, so the interrupt
+// is always adding to one whole table or the other.
+PIXY_DATA pixy_rx;						// Driver's landing spot.
+volatile PIXY_FRAME pixy_buf[ 2 ];		// Frame being collected, and the last one closed.
+volatile unsigned char pixy_collect;	// Index of the frame being collected.
+unsigned char pixy_front;				// Index of the last frame closed.
+unsigned char pixy_seq;					// Bumped every time a frame is closed.
+unsigned short int pixy_window_ms;		// Time left before the frame is closed, 0 if none open.
+unsigned short int pixy_clock_ms;		// Time counted off by pixy_frame_close(), ms (wraps).
+volatile unsigned short int pixy_ticks;	// PIXY_TICK_MS ticks not counted off yet (from the interrupt).
+volatile PIXY_STATS pixy_stats;			// Frame rate and loss counters.
+
+TARGET_TRACK target;			// Filtered Pixy target.
+
+RANGE_CAL range_cal = {			// Size -> range table in use.  Until
+	RANGE_CAL_MAGIC,			// it's calibrated, a rough guess for
+	{ 80, 46, 32, 25, 20, 17 }	// a ~5 cm target (size ~ 1600 / cm).
+};
+RANGE_CAL EEMEM range_cal_store;	// Saved calibration.
+
+SPKR_SEQ speaker;				// Speaker sequencer.
+REACT_STATE reaction;			// Color signature reaction in progress.
+
+// "Seven Nation Army" - The White Stripes
+const unsigned short int SNA_measure_1[] PROGMEM = {
+	SEQ_NOTE( SPKR_NOTE_E, 2, 6 ),
+	SEQ_NOTE( SPKR_NOTE_E, 2, 2 ),
+	SEQ_NOTE( SPKR_NOTE_G, 2, 3 ),
+	SEQ_NOTE( SPKR_NOTE_E, 2, 3 ),
+	SEQ_NOTE( SPKR_NOTE_D, 2, 2 )
+};
+const unsigned short int SNA_measure_2[] PROGMEM = {
+	SEQ_NOTE( SPKR_NOTE_C, 2, 8 ),
+	SEQ_NOTE( SPKR_NOTE_B, 1, 8 )
+};
+const SEQ_MEASURE SNA_measures[] PROGMEM = {
+	{ SNA_measure_1, SEQ_COUNT( SNA_measure_1 ), 1 },
+	{ SNA_measure_2, SEQ_COUNT( SNA_measure_2 ), 1 }
+};
+const SEQ_SONG SevenNationArmy PROGMEM = { SNA_measures, SEQ_COUNT( SNA_measures ), 1 };
+
+// "U Can't Touch This" - MC Hammer
+const unsigned short int CCT_measure_1[] PROGMEM = {
+	SEQ_NOTE( SPKR_NOTE_D, 3, 4 ),
+	SEQ_NOTE( SPKR_NOTE_C, 3, 2 ),
+	SEQ_NOTE( SPKR_NOTE_B, 2, 2 ),
+	SEQ_NOTE( SPKR_NOTE_A, 2, 2 ),
+	SEQ_NOTE( SPKR_NOTE_C, 4, 2 ),
+	SEQ_NOTE( SPKR_NOTE_C, 4, 2 ),
+	SEQ_NOTE( SPKR_NOTE_E, 2, 2 )
+};
+const unsigned short int CCT_measure_2[] PROGMEM = {
+	SEQ_NOTE( SPKR_NOTE_G, 2, 2 ),
+	SEQ_NOTE( SPKR_NOTE_B, 3, 2 ),
+	SEQ_NOTE( SPKR_NOTE_B, 3, 2 ),
+	SEQ_NOTE( SPKR_NOTE_B, 2, 2 ),
+	SEQ_NOTE( SPKR_NOTE_A, 2, 2 ),
+	SEQ_NOTE( SPKR_NOTE_C, 4, 2 ),
+	SEQ_REST( 4 )
+};
+const SEQ_MEASURE CCT_measures[] PROGMEM = {
+	{ CCT_measure_1, SEQ_COUNT( CCT_measure_1 ), 1 },
+	{ CCT_measure_2, SEQ_COUNT( CCT_measure_2 ), 1 }
+};
+const SEQ_SONG UCantTouchThis PROGMEM = { CCT_measures, SEQ_COUNT( CCT_measures ), 1 };
+
+// "Smoke on the Water" - Deep Purple
+const unsigned short int SW_measure_1[] PROGMEM = {
+	SEQ_NOTE( SPKR_NOTE_D, 2, 2 ),
+	SEQ_REST( 2 ),
+	SEQ_NOTE( SPKR_NOTE_F, 2, 2 ),
+	SEQ_REST( 2 ),
+	SEQ_NOTE( SPKR_NOTE_G, 2, 4 ),
+	SEQ_REST( 2 ),
+	SEQ_NOTE( SPKR_NOTE_D, 2, 2 )
+};
+const unsigned short int SW_measure_2[] PROGMEM = {
+	SEQ_REST( 2 ),
+	SEQ_NOTE( SPKR_NOTE_F, 2, 2 ),
+	SEQ_REST( 2 ),
+	SEQ_NOTE( SPKR_NOTE_G_S, 2, 2 ),
+	SEQ_NOTE( SPKR_NOTE_G, 2, 4 ),
+	SEQ_REST( 4 )
+};
+const unsigned short int SW_measure_3[] PROGMEM = {
+	SEQ_NOTE( SPKR_NOTE_D, 2, 2 ),
+	SEQ_REST( 2 ),
+	SEQ_NOTE( SPKR_NOTE_F, 2, 2 ),
+	SEQ_REST( 2 ),
+	SEQ_NOTE( SPKR_NOTE_G, 2, 4 ),
+	SEQ_REST( 2 ),
+	SEQ_NOTE( SPKR_NOTE_F, 2, 2 )
+};
+const unsigned short int SW_measure_4[] PROGMEM = {
+	SEQ_REST( 2 ),
+	SEQ_NOTE( SPKR_NOTE_D, 2, 10 ),
+	SEQ_REST( 4 )
+};
+const SEQ_MEASURE SW_measures[] PROGMEM = {
+	{ SW_measure_1, SEQ_COUNT( SW_measure_1 ), 1 },
+	{ SW_measure_2, SEQ_COUNT( SW_measure_2 ), 1 },
+	{ SW_measure_3, SEQ_COUNT( SW_measure_3 ), 1 },
+	{ SW_measure_4, SEQ_COUNT( SW_measure_4 ), 1 }
+};
+const SEQ_SONG SmokeOnTheWater PROGMEM = { SW_measures, SEQ_COUNT( SW_measures ), 1 };
+
+// Color signature reactions.  Each one plays its song and turns ~90-deg
+// LEFT (DEG_90_DEF steps at 200 steps/sec -- this table is in flash, so
+// it can't follow a retuned DEG_90), then leaves that signature alone for
+// a while so the same object doesn't set it off again.
+const char sig1_message[] PROGMEM = "Color Signature #1\n\n\"Smoke on the Water\"";
+const char sig2_message[] PROGMEM = "Color Signature #2\n\n\"Seven Nation Army\"";
+const char sig3_message[] PROGMEM = "Color Signature #3\n\n\"U Can't Touch This\"";
+
+const REACTION reactions[ PIXY_SIGNATURES ] PROGMEM = {
+	{ NULL, { 0, 0, 0 }, NULL, 0 },
+	{ &SmokeOnTheWater, { -200, 200, DEG_90_DEF }, sig1_message, 8000 },
+	{ &SevenNationArmy, { -200, 200, DEG_90_DEF }, sig2_message, 8000 },
+	{ &UCantTouchThis,  { -200, 200, DEG_90_DEF }, sig3_message, 8000 },
+	{ NULL, { 0, 0, 0 }, NULL, 0 },
+	{ NULL, { 0, 0, 0 }, NULL, 0 },
+	{ NULL, { 0, 0, 0 }, NULL, 0 },
+	{ NULL, { 0, 0, 0 }, NULL, 0 }
+};
+
+// Faster means the same turn swings the bot across the line (or toward the
+// wall) sooner, so back off kp and lean on kd as speed goes up.  Points must
+// be in increasing order of speed.
+const GAIN_POINT line_schedule[ GAIN_POINTS ] = {
+
+	{ 100, 307, 230 },		// kp x1.20, kd x0.90
+	{ 150, 256, 256 },		// kp x1.00, kd x1.00
+	{ 200, 205, 294 },		// kp x0.80, kd x1.15
+	{ 250, 166, 333 }		// kp x0.65, kd x1.30
+
+};
+
+const GAIN_POINT wall_schedule[ GAIN_POINTS ] = {
+
+	{ 100, 320, 205 },		// kp x1.25, kd x0.80
+	{ 150, 256, 256 },		// kp x1.00, kd x1.00
+	{ 200, 192, 320 },		// kp x0.75, kd x1.25
+	{ 250, 154, 384 }		// kp x0.60, kd x1.50
+
+};
+
+// ---------------------------------
+// ---------------------- Prototypes:
+// Shared by every mode.
+void IR_sense( volatile SENSOR_DATA *pSensors, TIMER16 interval_ms );
+void Sonar_sense( volatile SENSOR_DATA *pSensors, TIMER16 interval_ms);
+void Odometry_sense( TIMER16 interval_ms );
+void odometry_tick( void );
+signed long odometry_ramp( signed long rate, signed short target, unsigned short accel, unsigned char tick_ms );
+void odometry_update( void );
+void odometry_drive( signed short speed_L, signed short speed_R, unsigned short accel_L, unsigned short accel_R );
+void odometry_steps( signed short steps_L, signed short steps_R );
+void Cruise( volatile MOTOR_ACTION *pAction );
+void IR_avoid( volatile MOTOR_ACTION *pAction, volatile SENSOR_DATA *pSensors );
+MODE Mode_select( BOOL *pSetup );
+void wait_button( unsigned char mask );
+void boot_tick( void );
+unsigned long boot_clock( void );
+void boot_clock_stop( void );
+BOOL Calibrate( MODE choice );
+void Calibrate_apply( volatile SENSOR_DATA *pSensors, MODE choice );
+
+// MODE_LIGHT.
+void Photo_sense( volatile SENSOR_DATA *pSensors, TIMER16 interval_ms ) MODE_TEXT( light );
+void Photo_init( volatile SENSOR_DATA *pSensors ) MODE_TEXT( light );
+void Light_Follow( volatile MOTOR_ACTION *pAction, volatile SENSOR_DATA *pSensors ) MODE_TEXT( light );
+void Sonar_Avoid( volatile MOTOR_ACTION *pAction, volatile SENSOR_DATA *pSensors) MODE_TEXT( light );
+
+// MODE_WALL.
+void Wall_Follow( volatile MOTOR_ACTION *pAction, volatile SENSOR_DATA *pSensors ) MODE_TEXT( wall );
+void Wall_estimate( volatile SENSOR_DATA *pSensors ) MODE_TEXT( wall );
+void Wall_Corner( volatile MOTOR_ACTION *pAction, volatile SENSOR_DATA *pSensors ) MODE_TEXT( wall );
+
+// MODE_LINE and MODE_RACE.
+void Line_sense( volatile SENSOR_DATA *pSensors, TIMER16 interval_ms ) MODE_TEXT( line );
+void Line_Follow( volatile MOTOR_ACTION *pAction, volatile SENSOR_DATA *pSensors ) MODE_TEXT( line );
+void Line_Search( volatile MOTOR_ACTION *pAction ) MODE_TEXT( line );
+void Course_Learn( void ) MODE_TEXT( line );
+
+// Auto-tuning (MODE_LINE, MODE_RACE and MODE_WALL).
+void Auto_Tune( volatile MOTOR_ACTION *pAction, volatile SENSOR_DATA *pSensors ) MODE_TEXT( tune );
+
+// MODE_PIXY and MODE_REACT.
+void pixy_start( void ) MODE_TEXT( pixy );
+BOOL event_post( EVENT event ) MODE_TEXT( pixy );
+EVENT event_get( void ) MODE_TEXT( pixy );
+void events_dispatch( void ) MODE_TEXT( pixy );
+void pixy_callback( PIXY_DATA *pData ) MODE_TEXT( pixy );
+void pixy_tick( void ) MODE_TEXT( pixy );
+void pixy_frame_close( TIMER16 interval_ms ) MODE_TEXT( pixy );
+unsigned char pixy_select( volatile PIXY_FRAME *pFrame, PIXY_SELECT policy,
+						   unsigned char sig_mask, volatile PIXY_DATA *pLast ) MODE_TEXT( pixy );
+BOOL pixy_read( volatile SENSOR_DATA *pSensors, PIXY_SELECT policy,
+				unsigned char sig_mask ) MODE_TEXT( pixy );
+
+// MODE_PIXY.
+void Pixy_Follow( volatile MOTOR_ACTION *pAction, volatile SENSOR_DATA *pSensors ) MODE_TEXT( follow );
+void track_update( AB_AXIS *pAxis, float measured, unsigned short int dt_ms ) MODE_TEXT( follow );
+float track_predict( AB_AXIS *pAxis, unsigned short int latency_ms ) MODE_TEXT( follow );
+unsigned short int blob_size( volatile PIXY_DATA *pData ) MODE_TEXT( follow );
+float range_from_size( unsigned short int size ) MODE_TEXT( follow );
+void range_cal_load( void ) MODE_TEXT( follow );
+void range_calibrate( volatile SENSOR_DATA *pSensors ) MODE_TEXT( follow );
+void range_cal_fail( const char *why ) MODE_TEXT( follow );
+
+// MODE_REACT.
+void Pixy_Trigger( volatile MOTOR_ACTION *pAction, volatile SENSOR_DATA *pSensors ) MODE_TEXT( react );
+void React( volatile MOTOR_ACTION *pAction, TIMER16 interval_ms ) MODE_TEXT( react );
+void react_tick( void ) MODE_TEXT( react );
+void speaker_play( const SEQ_SONG *song ) MODE_TEXT( react );
+BOOL speaker_queue( const SEQ_SONG *song ) MODE_TEXT( react );
+void speaker_stop( void ) MODE_TEXT( react );
+BOOL speaker_busy( void ) MODE_TEXT( react );
+void speaker_service( TIMER16 interval_ms ) MODE_TEXT( react );
+void speaker_tick( void ) MODE_TEXT( react );
+void speaker_start_note( void ) MODE_TEXT( react );
+void speaker_start_song( const SEQ_SONG *song ) MODE_TEXT( react );
+BOOL speaker_next_note( void ) MODE_TEXT( react );
+
+void params_load( void );
+void params_save( void );
+unsigned short params_crc( const PARAM_STORE *pStore );
+
+void act( volatile MOTOR_ACTION *pAction );
+void info_display( volatile MOTOR_ACTION *pAction );
+void LCD_fb_init( void );
+void LCD_fb_clear( void );
+void LCD_fb_clear_row( unsigned char row );
+void LCD_fb_puts( unsigned char row, unsigned char col, const char *str );
+void LCD_fb_sync( void );
+void LCD_flush( TIMER16 interval_ms );
+char *fmt_uint( char *buf, unsigned long value );
+char *fmt_int( char *buf, signed long value );
+char *fmt_q( char *buf, signed long value, unsigned char frac_bits, unsigned char decimals );
+void Telemetry_init( void );
+void Telemetry_send( volatile MOTOR_ACTION *pAction, volatile SENSOR_DATA *pSensors,
+					 TIMER16 interval_ms );
+BOOL tlm_queue_frame( const unsigned char *pData, unsigned char len );
+void Tuning_service( void );
+void stack_paint( void ) __attribute__(( naked, used, section( ".init1" ) ));
+void Stack_check( void );
+void *malloc( size_t size );
+void free( void *ptr );
+void action_state( volatile MOTOR_ACTION *pAction, ROBOT_STATE state );
+void action_speed( volatile MOTOR_ACTION *pAction, signed short int speed_L, signed short int speed_R );
+void action_accel( volatile MOTOR_ACTION *pAction, unsigned short int accel_L, unsigned short int accel_R );
+BOOL action_publish( volatile MOTOR_ACTION *pAction );
+unsigned char action_snapshot( MOTOR_ACTION *pAction );
+void gain_schedule( const GAIN_POINT *pTable, signed short speed,
+					const PD_GAINS *pBase, PD_GAINS *pGains );
+
+// ---------------------- Convenience Functions: -----------------------------------------------------------------------------------------------------//
+// ---------------------------------------------------------------------------------------------------------------------------------------------------//
+void info_display( volatile MOTOR_ACTION *pAction )
+{
+
+	// NOTE:  We keep track of the 'previous' state to prevent the LCD
+	//        display from being needlessly written, if there's  nothing
+	//        new to display.  Otherwise, the screen will 'flicker' from
+	//        too many writes.
+	static ROBOT_STATE previous_state = STARTUP;
+
+	if ( ( pAction->state != previous_state ) || ( pAction->state == STARTUP ) )
+	{
+
+		// A reaction message takes up the whole screen.
+		if ( previous_state == REACTING ) {
+			LCD_fb_clear();
+		}
+		else {
+			LCD_fb_clear_row( 0 );
+		}
+
+		//  Display information based on the current 'ROBOT STATE'.
+		switch( pAction->state )
+		{
+
+			case STARTUP:
+			LCD_fb_puts( 0, 0, "STARTING..." );
+			break;
+
+			case CRUISING:
+			LCD_fb_puts( 0, 0, "CRUISING..." );
+			break;
+
+			case IR_AVOIDING:
+			LCD_fb_puts( 0, 0, "IR AVOIDING..." );
+			break;
+
+			case HOMING:
+			LCD_fb_puts( 0, 0, "HOMING..." );
+			break;
+					
+			case SONAR_AVOIDING:
+			LCD_fb_puts( 0, 0, "SONAR AVOIDING..." );
+			break;
+					
+			case WALL_FOLLOWING:
+			LCD_fb_puts( 0, 0, "WALL FOLLOWING..." );
+			break;
+			
+			case LINE_FOLLOWING:
+			LCD_fb_puts( 0, 0, "LINE FOLLOWING..." );
+			break;
+			
+			case LINE_SEARCHING:
+			LCD_fb_puts( 0, 0, "LINE SEARCHING..." );
+			break;
+			
+			case AUTO_TUNING:
+			LCD_fb_puts( 0, 0, "AUTO TUNING..." );
+			break;
+
+			case FOLLOWING:
+			LCD_fb_puts( 0, 0, "FOLLOWING..." );
+			break;
+
+			case REACTING:
+			if ( reaction.current.message != NULL ) {
+
+				char message[ REACT_MSG_LEN ];
+				char *line = message;
+				char *end;
+				unsigned char row = 0;
+
+				strncpy_P( message, reaction.current.message, REACT_MSG_LEN - 1 );
+				message[ REACT_MSG_LEN - 1 ] = '\0';
+
+				// One LCD row per line of the message.
+				LCD_fb_clear();
+				while ( ( line != NULL ) && ( row < LCD_ROWS ) ) {
+					end = strchr( line, '\n' );
+					if ( end != NULL ) {
+						*end++ = '\0';
+					}
+					LCD_fb_puts( row++, 0, line );
+					line = end;
+				}
+			}
+			break;
+
+			default:
+			LCD_fb_puts( 0, 0, "Unknown state!" );
+
+		} // end switch()
+
+		// Note the new state in effect.
+		previous_state = pAction->state;
+
+	} // end if()
+
+} // end info_display()
+
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+void LCD_fb_init( void )
+{
+
+	// Start from a blank screen with the framebuffer matching it.
+	unsigned char row;
+	unsigned char col;
+
+	LCD_clear();
+
+	for ( row = 0; row < LCD_ROWS; row++ ) {
+		for ( col = 0; col < LCD_COLS; col++ ) {
+			lcd_fb.shadow[ row ][ col ] = ' ';
+			lcd_fb.screen[ row ][ col ] = ' ';
+		}
+	}
+	lcd_fb.dirty = 0;
+	lcd_fb.row = 0;
+
+} // end LCD_fb_init()
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+void LCD_fb_clear( void )
+{
+
+	unsigned char row;
+
+	for ( row = 0; row < LCD_ROWS; row++ ) {
+		LCD_fb_clear_row( row );
+	}
+
+} // end LCD_fb_clear()
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+void LCD_fb_clear_row( unsigned char row )
+{
+
+	unsigned char col;
+
+	if ( row >= LCD_ROWS ) {
+		return;
+	}
+
+	for ( col = 0; col < LCD_COLS; col++ ) {
+		lcd_fb.shadow[ row ][ col ] = ' ';
+	}
+	lcd_fb.dirty |= ( 1 << row );
+
+} // end LCD_fb_clear_row()
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+void LCD_fb_puts( unsigned char row, unsigned char col, const char *str )
+{
+
+	// Anything past the end of the row is dropped.
+	if ( row >= LCD_ROWS ) {
+		return;
+	}
+
+	while ( ( *str != '\0' ) && ( col < LCD_COLS ) ) {
+		lcd_fb.shadow[ row ][ col++ ] = *str++;
+	}
+	lcd_fb.dirty |= ( 1 << row );
+
+} // end LCD_fb_puts()
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+// Integer and fixed-point formatting.  These replace "%f" so the float
+// printf library (and its ftoa engine) no longer has to be linked in.
+// Each one writes a terminated string into 'buf' and returns a pointer
+// to the terminator, so calls can be chained to build up a line.
+char *fmt_uint( char *buf, unsigned long value )
+{
+
+	ultoa( value, buf, 10 );
+
+	while ( *buf != '\0' ) {
+		buf++;
+	}
+
+	return buf;
+
+} // end fmt_uint()
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+char *fmt_int( char *buf, signed long value )
+{
+
+	if ( value < 0 ) {
+		*buf++ = '-';
+		return fmt_uint( buf, -( unsigned long )value );
+	}
+
+	return fmt_uint( buf, value );
+
+} // end fmt_int()
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+char *fmt_q( char *buf, signed long value, unsigned char frac_bits, unsigned char decimals )
+{
+
+	// Prints a Q-format value ('frac_bits' fractional bits) rounded to
+	// 'decimals' places.  The fraction is scaled by 10^decimals before it's
+	// rounded, so keep 2^frac_bits * 10^decimals under 2^32.
+	unsigned long mag;
+	unsigned long frac;
+	unsigned long mask = ( 1UL << frac_bits ) - 1;
+	unsigned long scale = 1;
+	unsigned char i;
+
+	if ( value < 0 ) {
+		*buf++ = '-';
+		mag = -( unsigned long )value;
+	}
+	else {
+		mag = value;
+	}
+
+	for ( i = 0; i < decimals; i++ ) {
+		scale *= 10;
+	}
+
+	// Fraction in units of the last printed place, rounded to nearest.
+	// Rounding up to a whole unit carries into the integer part.
+	frac = ( ( mag & mask ) * scale + ( ( 1UL << frac_bits ) >> 1 ) ) >> frac_bits;
+	mag >>= frac_bits;
+	if ( frac >= scale ) {
+		frac -= scale;
+		mag++;
+	}
+
+	buf = fmt_uint( buf, mag );
+
+	if ( decimals > 0 ) {
+
+		*buf++ = '.';
+
+		for ( i = decimals; i > 0; i-- ) {
+			buf[ i - 1 ] = '0' + ( char )( frac % 10 );
+			frac /= 10;
+		}
+		buf += decimals;
+		*buf = '\0';
+
+	}
+
+	return buf;
+
+} // end fmt_q()
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+void Telemetry_init( void )
+{
+
+	// USART0, 8N1, transmit only.  The UDRE interrupt is only turned on
+	// while there's something in the ring.
+	UBRR0 = TLM_UBRR;
+	UCSR0A = _BV( U2X0 );
+	UCSR0C = _BV( UCSZ01 ) | _BV( UCSZ00 );
+	UCSR0B = _BV( TXEN0 ) | _BV( RXEN0 ) | _BV( RXCIE0 );
+
+	tlm_tx.head = 0;
+	tlm_tx.tail = 0;
+	tune_rx.len = 0;
+	tune_rx.ready = FALSE;
+
+} // end Telemetry_init()
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+ISR( USART0_UDRE_vect )
+{
+
+	if ( tlm_tx.head != tlm_tx.tail ) {
+		UDR0 = tlm_tx.buf[ tlm_tx.head ];
+		tlm_tx.head = ( tlm_tx.head + 1 ) % TLM_TX_LEN;
+	}
+	else {
+		// Ring's empty -- stop interrupting until more is queued.
+		UCSR0B &= ~_BV( UDRIE0 );
+	}
+
+} // end ISR( USART0_UDRE_vect )
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+BOOL tlm_queue_frame( const unsigned char *pData, unsigned char len )
+{
+
+	// COBS encodes 'pData' plus its CRC straight into the TX ring and kicks
+	// the interrupt.  If the ring doesn't have room for the worst case the
+	// frame is dropped instead -- this never waits on the UART.
+	unsigned char free_bytes;
+	unsigned char pos;
+	unsigned char code_pos;
+	unsigned char code;
+	unsigned char crc_bytes[ 2 ];
+	unsigned short crc = 0xFFFF;
+	unsigned char i;
+	unsigned char byte;
+
+	free_bytes = ( tlm_tx.head + TLM_TX_LEN - tlm_tx.tail - 1 ) % TLM_TX_LEN;
+
+	// Data + CRC, one COBS code byte per 254 bytes (plus the first), and
+	// the delimiter.
+	if ( free_bytes < len + 2 + ( len + 2 ) / 254 + 1 + 1 ) {
+		return FALSE;
+	}
+
+	for ( i = 0; i < len; i++ ) {
+		crc = _crc_ccitt_update( crc, pData[ i ] );
+	}
+	crc_bytes[ 0 ] = crc & 0xFF;
+	crc_bytes[ 1 ] = crc >> 8;
+
+	// Standard COBS: each code byte is the distance to the next zero.
+	pos = tlm_tx.tail;
+	code_pos = pos;
+	pos = ( pos + 1 ) % TLM_TX_LEN;
+	code = 1;
+
+	for ( i = 0; i < len + 2; i++ ) {
+
+		byte = ( i < len ) ? pData[ i ] : crc_bytes[ i - len ];
+
+		if ( byte == 0 ) {
+			tlm_tx.buf[ code_pos ] = code;
+			code_pos = pos;
+			pos = ( pos + 1 ) % TLM_TX_LEN;
+			code = 1;
+		}
+		else {
+			tlm_tx.buf[ pos ] = byte;
+			pos = ( pos + 1 ) % TLM_TX_LEN;
+			if ( ++code == 0xFF ) {
+				tlm_tx.buf[ code_pos ] = code;
+				code_pos = pos;
+				pos = ( pos + 1 ) % TLM_TX_LEN;
+				code = 1;
+			}
+		}
+
+	}
+	tlm_tx.buf[ code_pos ] = code;
+	tlm_tx.buf[ pos ] = 0x00;
+	pos = ( pos + 1 ) % TLM_TX_LEN;
+
+	// Publish the whole frame at once, then make sure the UART is draining.
+	tlm_tx.tail = pos;
+	UCSR0B |= _BV( UDRIE0 );
+
+	return TRUE;
+
+} // end tlm_queue_frame()
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+void Telemetry_send( volatile MOTOR_ACTION *pAction, volatile SENSOR_DATA *pSensors,
+					 TIMER16 interval_ms )
+{
+
+	// Called every trip around the loop so it can count them, but only
+	// sends a frame every 'interval_ms'.
+	static BOOL timer_started = FALSE;
+	static TIMEROBJ tlm_timer;
+	TLM_FRAME frame;
+
+	tlm_tx.loops++;
+
+	if ( timer_started == FALSE ) {
+		TMRSRVC_new( &tlm_timer, TMRFLG_NOTIFY_FLAG, TMRTCM_RESTART, interval_ms );
+		timer_started = TRUE;
+	}
+	else if ( TIMER_ALARM( tlm_timer ) ) {
+
+		TIMER_SNOOZE( tlm_timer );
+
+		frame.version = TLM_VERSION;
+		frame.seq = tlm_tx.seq;
+		frame.time_ms = odometry.time_ms;
+		frame.mode = mode;
+		frame.boot_ms = boot.first_output_ms;
+
+		Stack_check();
+		frame.stack_max = ram_stats.stack_max;
+		frame.ram_free_min = ram_stats.free_min;
+		frame.ram_gap = ram_stats.gap;
+		frame.mem_failed = ram_stats.mem_failed;
+		frame.state = pAction->state;
+		frame.speed_L = pAction->speed_L;
+		frame.speed_R = pAction->speed_R;
+		frame.ir = pSensors->left_IR | ( pSensors->right_IR << 1 ) | ( pSensors->sw3 << 2 ) |
+				   ( pSensors->sw4 << 3 ) | ( pSensors->sw5 << 4 );
+		frame.left_photo_mv = pSensors->left_photo_mv;
+		frame.right_photo_mv = pSensors->right_photo_mv;
+		frame.sonar_mm = pSensors->sonar_mm;
+		frame.left_line_mv = pSensors->left_line_mv;
+		frame.right_line_mv = pSensors->right_line_mv;
+		frame.loops = tlm_tx.loops;
+		frame.dropped = tlm_tx.dropped;
+
+		if ( tlm_queue_frame( ( const unsigned char * ) &frame, sizeof( frame ) ) == TRUE ) {
+			tlm_tx.seq++;
+		}
+		else {
+			tlm_tx.dropped++;
+		}
+		tlm_tx.loops = 0;
+
+	}
+
+} // end Telemetry_send()
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+void stack_paint( void )
+{
+
+	// Runs from .init1, before the C runtime has set up the stack pointer,
+	// so it can't use the stack -- hence assembly.  Fills everything from
+	// the end of .bss to the top of RAM with STACK_CANARY.
+	__asm__ __volatile__ (
+		"	ldi r30, lo8(_end)		\n"
+		"	ldi r31, hi8(_end)		\n"
+		"	ldi r24, %0				\n"
+		"	ldi r25, hi8(__stack)	\n"
+		"	rjmp 2f					\n"
+		"1:	st Z+, r24				\n"
+		"2:	cpi r30, lo8(__stack)	\n"
+		"	cpc r31, r25			\n"
+		"	brlo 1b					\n"
+		"	breq 1b					\n"
+		:: "M" ( STACK_CANARY )
+	);
+
+} // end stack_paint()
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+void Stack_check( void )
+{
+
+	// Walk up from the end of .bss to the first byte that isn't paint --
+	// that's as deep as the stack has been.  The walk is only as long as the
+	// free gap, and only runs when a telemetry frame goes out.
+	unsigned char *pHeap_top = &_end;
+	unsigned char *pSP = ( unsigned char * ) SP;
+	unsigned char *p = pHeap_top;
+
+	while ( ( p < pSP ) && ( *p == STACK_CANARY ) ) {
+		p++;
+	}
+
+	ram_stats.stack_max = &__stack - p + 1;
+	ram_stats.free_min = p - pHeap_top;
+	ram_stats.gap = ( pSP > pHeap_top ) ? pSP - pHeap_top : 0;
+	ram_stats.mem_failed = mem_failed;
+
+} // end Stack_check()
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+void *malloc( size_t size )
+{
+
+	// Stands in for avr-libc's malloc() so there's no heap.  Only the CEENBoT
+	// library calls it: timer nodes come from 'mem_nodes', the speaker's
+	// frequency table gets 'mem_block'.  Anything else, or running out,
+	// returns NULL like a full heap would, and is counted.
+	MEM_NODE *pNode;
+	unsigned char sreg;
+	unsigned char i;
+
+	if ( mem_nodes_ready == FALSE ) {
+		for ( i = 0; i < MEM_NODES - 1; i++ ) {
+			mem_nodes[ i ].next = &mem_nodes[ i + 1 ];
+		}
+		mem_nodes[ MEM_NODES - 1 ].next = NULL;
+		mem_free_nodes = &mem_nodes[ 0 ];
+		mem_nodes_ready = TRUE;
+	}
+
+	if ( size <= MEM_NODE_BYTES ) {
+		// free() can run from the timer interrupt -- take the node atomically.
+		sreg = SREG;
+		cli();
+		pNode = mem_free_nodes;
+		if ( pNode != NULL ) {
+			mem_free_nodes = pNode->next;
+		}
+		SREG = sreg;
+		if ( pNode != NULL ) {
+			return pNode;
+		}
+	}
+
+	if ( size > MEM_NODE_BYTES && size <= MEM_BLOCK_BYTES && mem_block_used == FALSE ) {
+		mem_block_used = TRUE;
+		return mem_block;
+	}
+
+	mem_failed++;
+	return NULL;
+
+} // end malloc()
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+void free( void *ptr )
+{
+
+	// TMRSRVC_process() frees run-once timer nodes from the timer interrupt,
+	// while TMRSRVC_new() may be taking one in the main loop.
+	unsigned char sreg;
+
+	if ( ptr == mem_block ) {
+		mem_block_used = FALSE;
+	}
+	else if ( ptr >= ( void * ) &mem_nodes[ 0 ] && ptr < ( void * ) &mem_nodes[ MEM_NODES ] ) {
+		sreg = SREG;
+		cli();
+		( ( MEM_NODE * ) ptr )->next = mem_free_nodes;
+		mem_free_nodes = ( MEM_NODE * ) ptr;
+		SREG = sreg;
+	}
+
+} // end free()
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+ISR( USART0_RX_vect )
+{
+
+	unsigned char byte = UDR0;
+
+	if ( byte != 0x00 ) {
+		if ( tune_rx.len < TUNE_RX_LEN ) {
+			tune_rx.buf[ tune_rx.len ] = byte;
+		}
+		// Keep counting past the end so an overlong frame gets dropped
+		// at its delimiter.
+		if ( tune_rx.len < 0xFF ) {
+			tune_rx.len++;
+		}
+		return;
+	}
+
+	if ( tune_rx.len > 0 ) {
+		if ( tune_rx.len <= TUNE_RX_LEN && tune_rx.ready == FALSE ) {
+			memcpy( tune_rx.frame, tune_rx.buf, tune_rx.len );
+			tune_rx.frame_len = tune_rx.len;
+			tune_rx.ready = TRUE;
+		}
+		else {
+			tune_rx.dropped++;
+		}
+	}
+	tune_rx.len = 0;
+
+} // end ISR( USART0_RX_vect )
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+void Tuning_service( void )
+{
+
+	// Runs at the top of the loop, so a command lands between two passes
+	// and every behavior in a pass sees the same parameters.
+	TUNE_REPLY reply;
+
+	if ( tune_rx.ready == FALSE ) {
+		return;
+	}
+
+	tune_handle( tune_rx.frame, tune_rx.frame_len, &reply );
+	tune_rx.ready = FALSE;
+
+	// If there's no room the host just doesn't get a reply, and retries.
+	tlm_queue_frame( ( const unsigned char * ) &reply, sizeof( reply ) );
+
+} // end Tuning_service()
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+void LCD_fb_sync( void )
+{
+
+	// Push everything out right now.  Only for 'ballistic' behaviors, which
+	// are about to block anyway and won't let LCD_flush() run for a while.
+	unsigned char row;
+	unsigned char col;
+
+	for ( row = 0; row < LCD_ROWS; row++ ) {
+		if ( lcd_fb.dirty & ( 1 << row ) ) {
+			for ( col = 0; col < LCD_COLS; col++ ) {
+				lcd_fb.screen[ row ][ col ] = lcd_fb.shadow[ row ][ col ];
+			}
+			LCD_printf_RC( row, 0, "%.20s", lcd_fb.screen[ row ] );
+		}
+	}
+	lcd_fb.dirty = 0;
+
+} // end LCD_fb_sync()
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+void LCD_flush( TIMER16 interval_ms )
+{
+
+	// Low priority 'task': every 'interval_ms', find the next run of changed
+	// characters and send at most LCD_FLUSH_BYTES of it.  The LCD time spent
+	// per pass is bounded no matter how much was drawn.
+	static BOOL timer_started = FALSE;
+	static TIMEROBJ flush_timer;
+
+	char run[ LCD_FLUSH_BYTES + 1 ];
+	unsigned char tries;
+	unsigned char row;
+	unsigned char col;
+	unsigned char start;
+	unsigned char n;
+
+	if ( timer_started == FALSE )
+	{
+		TMRSRVC_new( &flush_timer, TMRFLG_NOTIFY_FLAG, TMRTCM_RESTART, interval_ms );
+		timer_started = TRUE;
+		return;
+	}
+
+	if ( !TIMER_ALARM( flush_timer ) )
+	{
+		return;
+	}
+	TIMER_SNOOZE( flush_timer );
+
+	for ( tries = 0; tries < LCD_ROWS; tries++ ) {
+
+		row = lcd_fb.row;
+
+		if ( lcd_fb.dirty & ( 1 << row ) ) {
+
+			for ( col = 0; col < LCD_COLS; col++ ) {
+				if ( lcd_fb.shadow[ row ][ col ] != lcd_fb.screen[ row ][ col ] ) {
+					break;
+				}
+			}
+
+			if ( col < LCD_COLS ) {
+
+				start = col;
+				n = 0;
+				while ( ( col < LCD_COLS ) && ( n < LCD_FLUSH_BYTES ) &&
+						( lcd_fb.shadow[ row ][ col ] != lcd_fb.screen[ row ][ col ] ) ) {
+					run[ n++ ] = lcd_fb.shadow[ row ][ col ];
+					lcd_fb.screen[ row ][ col ] = lcd_fb.shadow[ row ][ col ];
+					col++;
+				}
+				run[ n ] = '\0';
+
+				LCD_printf_RC( row, start, "%s", run );
+
+				// Stay on this row until it's clean.
+				return;
+			}
+
+			lcd_fb.dirty &= ~( 1 << row );
+		}
+
+		lcd_fb.row = ( row + 1 ) % LCD_ROWS;
+	}
+
+} // end LCD_flush()
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+void action_state( volatile MOTOR_ACTION *pAction, ROBOT_STATE state )
+{
+
+	// Behaviors set the command through these three, never the fields
+	// directly.  Each write is checked against the published command on
+	// the spot, so the last behavior to write a field in a pass decides
+	// its 'action_changed' bit the same way it decides the field.
+	pAction->state = state;
+
+	if ( state != motor_cmd.action.state )
+		action_changed |= ACTION_STATE;
+	else
+		action_changed &= ~ACTION_STATE;
+
+} // end action_state()
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+void action_speed( volatile MOTOR_ACTION *pAction, signed short int speed_L, signed short int speed_R )
+{
+
+	pAction->speed_L = speed_L;
+	pAction->speed_R = speed_R;
+
+	if ( speed_L != motor_cmd.action.speed_L )
+		action_changed |= ACTION_SPEED_L;
+	else
+		action_changed &= ~ACTION_SPEED_L;
+
+	if ( speed_R != motor_cmd.action.speed_R )
+		action_changed |= ACTION_SPEED_R;
+	else
+		action_changed &= ~ACTION_SPEED_R;
+
+} // end action_speed()
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+void action_accel( volatile MOTOR_ACTION *pAction, unsigned short int accel_L, unsigned short int accel_R )
+{
+
+	pAction->accel_L = accel_L;
+	pAction->accel_R = accel_R;
+
+	if ( accel_L != motor_cmd.action.accel_L )
+		action_changed |= ACTION_ACCEL_L;
+	else
+		action_changed &= ~ACTION_ACCEL_L;
+
+	if ( accel_R != motor_cmd.action.accel_R )
+		action_changed |= ACTION_ACCEL_R;
+	else
+		action_changed &= ~ACTION_ACCEL_R;
+
+} // end action_accel()
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+BOOL action_publish( volatile MOTOR_ACTION *pAction )
+{
+
+	// Runs once a pass, after arbitration.  The setters have already
+	// worked out whether the winning command is new, so there's nothing
+	// to compare here -- just copy it in and bump the version.  Loop only
+	// (see MOTOR_COMMAND); interrupts are held off for the copy just so an
+	// action_snapshot() from one never sees half a publish.
+	unsigned char sreg;
+
+	if ( action_changed == 0 )
+		return FALSE;
+
+	sreg = SREG;
+	cli();
+
+	motor_cmd.action = *pAction;
+	motor_cmd.version++;
+
+	SREG = sreg;
+
+	action_changed = 0;
+
+	return TRUE;
+
+} // end action_publish()
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+unsigned char action_snapshot( MOTOR_ACTION *pAction )
+{
+
+	// Copies out the published command and returns its version, both
+	// from the same publish.
+	unsigned char sreg;
+	unsigned char version;
+
+	sreg = SREG;
+	cli();
+
+	*pAction = motor_cmd.action;
+	version = motor_cmd.version;
+
+	SREG = sreg;
+
+	return version;
+
+} // end action_snapshot()
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+void gain_schedule( const GAIN_POINT *pTable, signed short speed,
+					const PD_GAINS *pBase, PD_GAINS *pGains )
+{
+	
+	// Linearly interpolates the kp/kd scales for 'speed' between the two
+	// neighboring table points (clamped at either end) and applies them to
+	// the base gains.  The interpolation is all integer math.
+	unsigned char i = 0;
+	unsigned short kp_scale;
+	unsigned short kd_scale;
+	signed short frac;
+
+	if ( speed <= pTable[ 0 ].speed ) {
+		kp_scale = pTable[ 0 ].kp_scale;
+		kd_scale = pTable[ 0 ].kd_scale;
+	}
+	else if ( speed >= pTable[ GAIN_POINTS - 1 ].speed ) {
+		kp_scale = pTable[ GAIN_POINTS - 1 ].kp_scale;
+		kd_scale = pTable[ GAIN_POINTS - 1 ].kd_scale;
+	}
+	else {
+		while ( speed > pTable[ i + 1 ].speed ) {
+			i++;
+		}
+		
+		// Position between point i and i+1, Q8 (0..256).
+		frac = ( (signed long) ( speed - pTable[ i ].speed ) << 8 ) /
+			   ( pTable[ i + 1 ].speed - pTable[ i ].speed );
+		
+		kp_scale = pTable[ i ].kp_scale +
+				   ( ( (signed long) pTable[ i + 1 ].kp_scale - pTable[ i ].kp_scale ) * frac >> 8 );
+		kd_scale = pTable[ i ].kd_scale +
+				   ( ( (signed long) pTable[ i + 1 ].kd_scale - pTable[ i ].kd_scale ) * frac >> 8 );
+	}
+
+	pGains->kp = pBase->kp * kp_scale / 256;
+	pGains->kd = pBase->kd * kd_scale / 256;
+
+} // end gain_schedule()
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+unsigned short params_crc( const PARAM_STORE *pStore )
+{
+
+	// CRC over everything in the store ahead of the CRC itself.
+	const unsigned char *p = ( const unsigned char * ) pStore;
+	unsigned short crc = 0xFFFF;
+	unsigned char i;
+
+	for ( i = 0; i < offsetof( PARAM_STORE, crc ); i++ ) {
+		crc = _crc16_update( crc, p[ i ] );
+	}
+
+	return crc;
+
+} // end params_crc()
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+void params_load( void )
+{
+
+	// Load the saved parameters into RAM, falling back to the compiled-in
+	// defaults if the block is blank, from another layout, or corrupt.
+	PARAM_STORE store;
+
+	eeprom_read_block( &store, &param_store, sizeof( PARAM_STORE ) );
+
+	if ( store.magic == PARAMS_MAGIC && store.version == PARAMS_VERSION &&
+		 store.size == sizeof( PARAMS ) && store.crc == params_crc( &store ) ) {
+		params = store.params;
+	}
+	else {
+		memcpy_P( &params, &param_defaults, sizeof( PARAMS ) );
+	}
+
+} // end params_load()
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+void params_save( void )
+{
+
+	PARAM_STORE store;
+
+	store.magic = PARAMS_MAGIC;
+	store.version = PARAMS_VERSION;
+	store.size = sizeof( PARAMS );
+	store.params = params;
+	store.crc = params_crc( &store );
+
+	// eeprom_update_block() only rewrites the bytes that changed, so saving
+	// after one parameter moves doesn't wear the rest of the block.
+	eeprom_update_block( &store, &param_store, sizeof( PARAM_STORE ) );
+
+} // end params_save()
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+void wait_button( unsigned char mask )
+{
+
+	// Wait for a press and then the release, so one press is one press.
+	while( !( ATTINY_get_sensors() & mask ) );
+	while( ATTINY_get_sensors() & mask );
+
+} // end wait_button()
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+MODE Mode_select( BOOL *pSetup )
+{
+
+	// Boot menu.  S3 steps through the modes, S4 starts the one shown and
+	// S5 starts it with its setup step (auto-tune or range calibration).
+	// Left alone, the saved mode starts after MODE_MENU_MS; with that set to
+	// 0 the menu is skipped, unless S3 is held at power-on.  Whatever was
+	// picked is saved as the next boot's default.
+	//
+	// Nothing here blocks: the menu is drawn through LCD_flush() and the
+	// buttons are watched for presses, so Calibrate() keeps sampling the
+	// whole time.  Once a mode is picked it still won't start until
+	// calibration has enough for it.
+	MODE choice = ( params.mode < MODE_COUNT ) ? ( MODE ) params.mode : MODE_LINE;
+	unsigned long now = boot_clock();
+	unsigned long idle_start = now;
+	unsigned long poll_last = now;
+	unsigned char buttons = ATTINY_get_sensors();
+	unsigned char last_buttons = buttons;
+	unsigned char pressed;
+	char name[ LCD_COLS + 1 ];
+	BOOL shown = FALSE;
+	BOOL picked = FALSE;
+
+	*pSetup = FALSE;
+
+	// Instant start.
+	if ( ( MODE_MENU_MS == 0 ) && !( buttons & SNSR_SW3_STATE ) )
+		picked = TRUE;
+
+	while( 1 )
+	{
+
+		now = boot_clock();
+
+		if ( ( Calibrate( choice ) == TRUE ) && ( picked == TRUE ) )
+			break;
+
+		if ( picked == TRUE )
+			continue;
+
+		if ( shown == FALSE )
+		{
+
+			strncpy_P( name, ( const char * ) pgm_read_word( &mode_names[ choice ] ), LCD_COLS );
+			name[ LCD_COLS ] = '\0';
+
+			LCD_fb_clear();
+			LCD_fb_puts( 0, 0, name );
+			LCD_fb_puts( 2, 0, "S3 next  S4 start" );
+			LCD_fb_puts( 3, 0, "S5 setup" );
+
+			shown = TRUE;
+
+		} // end if()
+
+		LCD_flush( LCD_FLUSH_MS );
+
+		if ( now - poll_last < MODE_POLL_MS )
+			continue;
+
+		poll_last = now;
+
+		if ( now - idle_start >= MODE_MENU_MS )
+		{
+
+			picked = TRUE;
+			continue;
+
+		} // end if()
+
+		// Only act on presses, so a button held from power-on doesn't count.
+		buttons = ATTINY_get_sensors();
+		pressed = buttons & ~last_buttons;
+		last_buttons = buttons;
+
+		if ( pressed & SNSR_SW3_STATE )
+		{
+
+			choice = ( MODE )( ( choice + 1 ) % MODE_COUNT );
+			idle_start = now;
+			shown = FALSE;
+
+		} // end if()
+
+		else if ( pressed & SNSR_SW4_STATE )
+			picked = TRUE;
+
+		else if ( pressed & SNSR_SW5_STATE )
+		{
+
+			*pSetup = TRUE;
+			picked = TRUE;
+
+		} // end else if()
+
+	} // end while()
+
+	if ( params.mode != choice )
+	{
+
+		params.mode = choice;
+		params_save();
+
+	} // end if()
+
+	LCD_fb_clear();
+
+	return choice;
+
+} // end Mode_select()
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+void boot_tick( void )
+{
+
+	// Timer callback -- runs in the timer interrupt, so blocking sonar pings
+	// and setup steps that wait on the user are counted too.
+	boot.ms += BOOT_TICK_MS;
+
+} // end boot_tick()
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+unsigned long boot_clock( void )
+{
+
+	// Milliseconds since CBOT_main() started.  The first call starts the
+	// clock; after boot_clock_stop() it stays where it stopped.
+	static BOOL timer_started = FALSE;
+	unsigned char sreg;
+	unsigned long ms;
+
+	if ( timer_started == FALSE )
+	{
+
+		TMRSRVC_REGISTER_CBFUNC( boot.timer, boot_tick );
+		TMRSRVC_new( &boot.timer, TMRFLG_NOTIFY_FUNC, TMRTCM_RESTART,
+			BOOT_TICK_MS );
+
+		timer_started = TRUE;
+
+	} // end if()
+
+	// Four bytes -- don't let a tick land halfway through the read.
+	sreg = SREG;
+	cli();
+	ms = boot.ms;
+	SREG = sreg;
+
+	return ms;
+
+} // end boot_clock()
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+void boot_clock_stop( void )
+{
+
+	// Nothing reads the boot clock once the loop is running, so don't
+	// keep paying for a 1 ms interrupt callback.
+	static BOOL stopped = FALSE;
+
+	if ( stopped == FALSE )
+	{
+
+		TMRSRVC_stop_timer( &boot.timer );
+		stopped = TRUE;
+
+	} // end if()
+
+} // end boot_clock_stop()
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+BOOL Calibrate( MODE choice )
+{
+
+	// One step of boot calibration, paced off the boot clock so it can run
+	// under the boot menu.  ADC channels 6 and 4 are summed for as long as
+	// the menu is up, which averages out noise and lamp flicker.  Modes that
+	// use the sonar also get a self-test -- a few pings that have to come
+	// back in range.  Returns TRUE once 'choice' has enough to start.
+	static unsigned long sample_last = 0;
+	static unsigned long ping_last = 0;
+	static BOOL sonar_open = FALSE;
+	unsigned long now = boot_clock();
+	float distance_cm;
+
+	if ( ( now - sample_last >= CAL_SAMPLE_MS ) && ( cal.samples < CAL_MAX_SAMPLES ) )
+	{
+
+		sample_last = now;
+
+		ADC_set_channel( ADC_CHAN6 );
+		cal.left_sum += ADC_sample();
+
+		ADC_set_channel( ADC_CHAN4 );
+		cal.right_sum += ADC_sample();
+
+		cal.samples++;
+
+	} // end if()
+
+	if ( MODE_USES_SONAR( choice ) && ( cal.pings < CAL_SONAR_PINGS ) &&
+		 ( now - ping_last >= CAL_SONAR_MS ) )
+	{
+
+		if ( sonar_open == FALSE )
+		{
+
+			USONIC_open();
+			sonar_open = TRUE;
+
+		} // end if()
+
+		ping_last = now;
+
+		distance_cm = USONIC_DIST_CM( USONIC_ping() );
+
+		cal.pings++;
+		if ( ( distance_cm > CAL_SONAR_MIN_CM ) && ( distance_cm < CAL_SONAR_MAX_CM ) )
+			cal.pings_good++;
+
+	} // end if()
+
+	if ( cal.samples < CAL_MIN_SAMPLES )
+		return FALSE;
+
+	if ( MODE_USES_SONAR( choice ) && ( cal.pings < CAL_SONAR_PINGS ) )
+		return FALSE;
+
+	return TRUE;
+
+} // end Calibrate()
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+void Calibrate_apply( volatile SENSOR_DATA *pSensors, MODE choice )
+{
+
+	// Turns what Calibrate() collected into what 'choice' uses.
+	float offset;
+
+	switch( choice )
+	{
+
+		case MODE_LINE:
+		case MODE_RACE:
+			// Both line sensors see the same surface at the start, so what
+			// the right one reads over the left is its offset.  Anything
+			// far from the usual offset means they didn't -- keep that.
+			offset = ( ( float ) cal.right_sum - ( float ) cal.left_sum ) * 5.0f /
+					 ( 1024.0f * cal.samples );
+			if ( fabs( offset - LINE_OFFSET_DEF ) < LINE_OFFSET_TOL )
+				cal.line_offset = offset;
+		break;
+
+		case MODE_LIGHT:
+			Photo_init( pSensors );
+			// Fall through -- light homing avoids with the sonar too.
+
+		case MODE_WALL:
+			if ( cal.pings_good < CAL_SONAR_GOOD )
+			{
+
+				LCD_fb_clear();
+				LCD_fb_puts( 0, 0, "Sonar self-test" );
+				LCD_fb_puts( 1, 0, "failed" );
+				LCD_fb_puts( 3, 0, "S4 to go anyway" );
+				LCD_fb_sync();
+				wait_button( SNSR_SW4_STATE );
+				LCD_fb_clear();
+
+			} // end if()
+		break;
+
+		default:
+		break;
+
+	} // end switch()
+
+} // end Calibrate_apply()
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+void pixy_start( void )
+{
+
+	// Initialize the Pixy subsystem.
+	if ( PIXY_open() == SUBSYS_OPEN )
+	{
+
+		// Register the callback and its landing structure.  Behaviors
+		// only ever see frames through 'pixy_read()'.
+		PIXY_register_callback( pixy_callback, &pixy_rx );
+
+		// Start tracking.
+		PIXY_track_start();
+
+	} // end if()
+	else
+	{
+
+		// If the PIXY doesn't open, we can't continue.  This is a FATAL error.
+		LCD_fb_clear();
+		LCD_fb_puts( 0, 0, "FATAL: Pixy failed!" );
+		LCD_fb_sync();
+
+		// Get stuck here forever.
+		while( 1 );
+
+	} // end else.
+
+} // end pixy_start()
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+BOOL event_post( EVENT event )
+{
+
+	// Safe to call from an interrupt.  Returns FALSE (and counts it) if
+	// the queue is full.
+	unsigned char next = ( evt_tail + 1 ) % EVT_QUEUE_LEN;
+
+	if ( next == evt_head )
+	{
+
+		pixy_stats.lost_events++;
+		return FALSE;
+
+	} // end if()
+
+	evt_queue[ evt_tail ] = event;
+	evt_tail = next;
+
+	return TRUE;
+
+} // end event_post()
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+EVENT event_get( void )
+{
+
+	EVENT event;
+
+	if ( evt_head == evt_tail )
+		return EVT_NONE;
+
+	event = evt_queue[ evt_head ];
+	evt_head = ( evt_head + 1 ) % EVT_QUEUE_LEN;
+
+	return event;
+
+} // end event_get()
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+void events_dispatch( void )
+{
+
+	// Handles everything the interrupts have posted since last time.
+	EVENT event;
+
+	while( ( event = event_get() ) != EVT_NONE )
+	{
+
+		switch( event )
+		{
+
+			case EVT_PIXY_BLOCK:
+				// Give the rest of the frame's blocks time to come in.
+				if ( pixy_window_ms == 0 )
+					pixy_window_ms = PIXY_WINDOW_MS;
+			break;
+
+			default:
+			break;
+
+		} // end switch()
+
+	} // end while()
+
+} // end events_dispatch()
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+void pixy_callback( PIXY_DATA *pData )
+{
+
+	// NOTE: Runs in the Pixy driver's interrupt -- keep it short.
+	volatile PIXY_FRAME *pFrame = &pixy_buf[ pixy_collect ];
+	unsigned char i;
+	unsigned char smallest;
+
+	if ( pFrame->n_blocks < PIXY_MAX_BLOCKS )
+	{
+
+		// First block of a frame -- let the main loop know one's started.
+		if ( pFrame->n_blocks == 0 )
+			event_post( EVT_PIXY_BLOCK );
+
+		pFrame->block[ pFrame->n_blocks++ ] = *pData;
+		return;
+
+	} // end if()
+
+	pixy_stats.overflow++;
+
+	// Table's full -- this block only gets in if it's bigger than the
+	// smallest one there.
+	smallest = 0;
+	for ( i = 1; i < PIXY_MAX_BLOCKS; i++ )
+	{
+
+		if ( PIXY_AREA( pFrame->block[ i ] ) < PIXY_AREA( pFrame->block[ smallest ] ) )
+			smallest = i;
+
+	} // end for()
+
+	if ( PIXY_AREA( *pData ) > PIXY_AREA( pFrame->block[ smallest ] ) )
+		pFrame->block[ smallest ] = *pData;
+
+} // end pixy_callback()
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+void pixy_tick( void )
+{
+
+	// Timer callback -- runs in the timer interrupt, so frame timing keeps
+	// up however long a trip around the loop takes.
+	pixy_ticks++;
+
+} // end pixy_tick()
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+void pixy_frame_close( TIMER16 interval_ms )
+{
+
+	// Counts off the ticks since the last call: closes the open frame once
+	// its window runs out, and keeps the frame rate and age counters.
+	static BOOL timer_started = FALSE;
+	static TIMEROBJ frame_timer;
+	static unsigned short int second_ms = 0;
+	static unsigned short int second_frames = 0;
+	unsigned char closing;
+	unsigned char sreg;
+	unsigned short int elapsed;
+
+	if ( timer_started == FALSE )
+	{
+
+		TMRSRVC_REGISTER_CBFUNC( frame_timer, pixy_tick );
+		TMRSRVC_new( &frame_timer, TMRFLG_NOTIFY_FUNC, TMRTCM_RESTART,
+			interval_ms );
+
+		timer_started = TRUE;
+		return;
+
+	} // end if()
+
+	sreg = SREG;
+	cli();
+	elapsed = pixy_ticks * interval_ms;
+	pixy_ticks = 0;
+	SREG = sreg;
+
+	if ( elapsed == 0 )
+		return;
+
+	pixy_clock_ms += elapsed;
+
+	if ( pixy_stats.age_ms < 0xFFFF - elapsed )
+		pixy_stats.age_ms += elapsed;
+	else
+		pixy_stats.age_ms = 0xFFFF;
+
+	// Frames over however long it's been, so a late call doesn't skew it.
+	second_ms += elapsed;
+	if ( second_ms >= 1000 )
+	{
+
+		pixy_stats.fps = ( unsigned long )( pixy_stats.frames - second_frames ) * 1000 / second_ms;
+		second_frames = pixy_stats.frames;
+		second_ms = 0;
+
+	} // end if()
+
+	if ( pixy_window_ms == 0 )
+		return;
+
+	if ( pixy_window_ms > elapsed )
+	{
+
+		pixy_window_ms -= elapsed;
+		return;
+
+	} // end if()
+
+	// It closed when the window ran out, which may have been a tick or two ago.
+	pixy_stats.age_ms = elapsed - pixy_window_ms;
+	pixy_window_ms = 0;
+	closing = pixy_collect;
+
+	// Empty the other table, then point the interrupt at it.
+	pixy_buf[ closing ^ 1 ].n_blocks = 0;
+	pixy_collect = closing ^ 1;
+
+	pixy_buf[ closing ].frame = ++pixy_stats.frames;
+	pixy_buf[ closing ].time_ms = pixy_clock_ms - pixy_stats.age_ms;
+	pixy_front = closing;
+	pixy_seq++;
+
+} // end pixy_frame_close()
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+unsigned char pixy_select( volatile PIXY_FRAME *pFrame, PIXY_SELECT policy,
+						   unsigned char sig_mask, volatile PIXY_DATA *pLast )
+{
+
+	// Picks one block out of 'pFrame' by 'policy', only looking at blocks
+	// whose signature bit is set in 'sig_mask'.  Returns its index, or
+	// PIXY_NO_BLOCK.
+	unsigned char i;
+	unsigned char best = PIXY_NO_BLOCK;
+	unsigned long score;
+	unsigned long best_score = 0;
+	volatile PIXY_DATA *pBlock;
+
+	for ( i = 0; i < pFrame->n_blocks; i++ )
+	{
+
+		pBlock = &pFrame->block[ i ];
+
+		if ( ( pBlock->signum > 7 ) || !( sig_mask & ( 1 << pBlock->signum ) ) )
+			continue;
+
+		switch( policy )
+		{
+
+			case SELECT_NEAREST:
+				// Closer scores higher.  Anything with another signature
+				// only wins if there's nothing with this one.
+				score = 0xFFFF - ( abs( pBlock->pos.x - pLast->pos.x ) +
+								   abs( pBlock->pos.y - pLast->pos.y ) );
+				if ( pBlock->signum == pLast->signum )
+					score += 0x10000UL;
+			break;
+
+			case SELECT_PRIORITY:
+				// Signature first, area to break ties.
+				score = ( ( unsigned long )( 8 - pBlock->signum ) << 17 ) +
+						PIXY_AREA( *pBlock );
+			break;
+
+			default:
+				score = PIXY_AREA( *pBlock );
+
+		} // end switch()
+
+		if ( ( best == PIXY_NO_BLOCK ) || ( score > best_score ) )
+		{
+
+			best = i;
+			best_score = score;
+
+		} // end if()
+
+	} // end for()
+
+	return best;
+
+} // end pixy_select()
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+BOOL pixy_read( volatile SENSOR_DATA *pSensors, PIXY_SELECT policy,
+				unsigned char sig_mask )
+{
+
+	// If a frame has closed since the last read, picks a block out of it
+	// into 'pSensors->pixy_data' and returns TRUE.  Frames are closed from
+	// the main loop too, so the one in front stays put while we read it.
+	volatile PIXY_FRAME *pFrame = &pixy_buf[ pixy_front ];
+	unsigned char pick;
+
+	if ( pSensors->pixy_seq == pixy_seq )
+		return FALSE;
+
+	// Count any frames that came and went without being read.
+	if ( ( pSensors->pixy_frame != 0 ) &&
+		 ( pFrame->frame - pSensors->pixy_frame > 1 ) )
+		pixy_stats.dropped += pFrame->frame - pSensors->pixy_frame - 1;
+
+	pSensors->pixy_seq = pixy_seq;
+	pSensors->pixy_frame = pFrame->frame;
+	pSensors->pixy_ms = pFrame->time_ms;
+	pSensors->pixy_blocks = pFrame->n_blocks;
+
+	pick = pixy_select( pFrame, policy, sig_mask, &pSensors->pixy_data );
+
+	if ( pick == PIXY_NO_BLOCK )
+		return FALSE;
+
+	pSensors->pixy_data = pFrame->block[ pick ];
+
+	return TRUE;
+
+} // end pixy_read()
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+void track_update( AB_AXIS *pAxis, float measured, unsigned short int dt_ms )
+{
+
+	// Predict where the target should be 'dt_ms' later, then correct
+	// position and velocity by a share of the miss.
+	float predicted;
+	float residual;
+
+	if ( dt_ms == 0 )
+		dt_ms = 1;
+
+	predicted = pAxis->pos + pAxis->vel * dt_ms;
+	residual = measured - predicted;
+
+	pAxis->pos = predicted + TRACK_ALPHA * residual;
+	pAxis->vel += TRACK_BETA * residual / dt_ms;
+
+} // end track_update()
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+float track_predict( AB_AXIS *pAxis, unsigned short int latency_ms )
+{
+
+	// The frame being processed is already 'latency_ms' old -- carry it
+	// forward to where the target is now.
+	return pAxis->pos + pAxis->vel * latency_ms;
+
+} // end track_predict()
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+unsigned short int blob_size( volatile PIXY_DATA *pData )
+{
+
+	// Use the larger side.  Unlike the centroid's 'y', this doesn't
+	// change with camera tilt, and it holds up better than the smaller
+	// side when the blob is clipped.
+	return ( pData->size.width > pData->size.height ) ?
+			 pData->size.width : pData->size.height;
+
+} // end blob_size()
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+float range_from_size( unsigned short int size )
+{
+
+	// Apparent size goes as 1/range, so interpolate between table points
+	// in 1/size, which is close to linear in range.  Outside the table,
+	// clamp to the nearest end.
+	unsigned char i;
+	float inv;
+	float inv_near;
+	float inv_far;
+
+	if ( size >= range_cal.size[ 0 ] )
+		return RANGE_CAL_FIRST_CM;
+
+	if ( size <= range_cal.size[ RANGE_CAL_POINTS - 1 ] )
+		return RANGE_CAL_FIRST_CM + ( RANGE_CAL_POINTS - 1 ) * RANGE_CAL_STEP_CM;
+
+	for ( i = 0; size < range_cal.size[ i + 1 ]; i++ );
+
+	inv      = 1.0 / size;
+	inv_near = 1.0 / range_cal.size[ i ];
+	inv_far  = 1.0 / range_cal.size[ i + 1 ];
+
+	return RANGE_CAL_FIRST_CM + RANGE_CAL_STEP_CM *
+		   ( i + ( inv - inv_near ) / ( inv_far - inv_near ) );
+
+} // end range_from_size()
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+void range_cal_load( void )
+{
+
+	RANGE_CAL saved;
+
+	// Keep the defaults unless there's a good calibration saved.
+	eeprom_read_block( &saved, &range_cal_store, sizeof( RANGE_CAL ) );
+
+	if ( saved.magic == RANGE_CAL_MAGIC )
+		range_cal = saved;
+
+} // end range_cal_load()
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+void range_calibrate( volatile SENSOR_DATA *pSensors )
+{
+
+	// Walks the user through putting the target at each range in the
+	// table and averages the blob size the Pixy sees there.  Only runs
+	// before the arbitration loop, so it's fine for it to block -- but not
+	// forever: S5 or a point with no target in view ends it, and the
+	// table in use isn't touched unless every point came out.
+	RANGE_CAL cal;
+	unsigned char i;
+	unsigned char n;
+	unsigned long total;
+	unsigned short int start_ms;
+	unsigned char buttons;
+	char buf[ 12 ];
+
+	cal.magic = RANGE_CAL_MAGIC;
+
+	for ( i = 0; i < RANGE_CAL_POINTS; i++ )
+	{
+
+		LCD_fb_clear();
+		LCD_fb_puts( 0, 0, "Target at    cm" );
+		LCD_fb_puts( 0, 10, fmt_uint( buf, RANGE_CAL_FIRST_CM + i * RANGE_CAL_STEP_CM ) );
+		LCD_fb_puts( 1, 0, "then press S3" );
+		LCD_fb_puts( 2, 0, "S5 cancels" );
+		LCD_fb_sync();
+
+		while ( !( ( buttons = ATTINY_get_sensors() ) & ( SNSR_SW3_STATE | SNSR_SW5_STATE ) ) );
+		if ( buttons & SNSR_SW5_STATE )
+		{
+
+			range_cal_fail( "cancelled" );
+			return;
+
+		} // end if()
+		while( ATTINY_get_sensors() & SNSR_SW3_STATE );
+
+		total = 0;
+		start_ms = pixy_clock_ms;
+		for ( n = 0; n < RANGE_CAL_SAMPLES; )
+		{
+
+			events_dispatch();
+			pixy_frame_close( PIXY_TICK_MS );
+
+			if ( pixy_read( pSensors, SELECT_LARGEST, PIXY_ALL_SIGS ) == TRUE )
+			{
+
+				total += blob_size( &pSensors->pixy_data );
+				n++;
+
+			} // end if()
+
+			// No target in view, or the user has had enough.
+			if ( ATTINY_get_sensors() & SNSR_SW5_STATE )
+			{
+
+				range_cal_fail( "cancelled" );
+				return;
+
+			} // end if()
+
+			if ( ( unsigned short int )( pixy_clock_ms - start_ms ) >= RANGE_CAL_TIMEOUT_MS )
+			{
+
+				range_cal_fail( "no target" );
+				return;
+
+			} // end if()
+
+		} // end for()
+
+		cal.size[ i ] = total / RANGE_CAL_SAMPLES;
+
+		// Each point must be smaller than the one before it, or the
+		// table can't be searched.
+		if ( ( i > 0 ) && ( cal.size[ i ] >= cal.size[ i - 1 ] ) )
+		{
+
+			range_cal_fail( "size didn't shrink" );
+			return;
+
+		} // end if()
+
+	} // end for()
+
+	range_cal = cal;
+	eeprom_update_block( &cal, &range_cal_store, sizeof( RANGE_CAL ) );
+
+	LCD_fb_clear();
+	LCD_fb_puts( 0, 0, "Cal saved" );
+	LCD_fb_sync();
+	TMRSRVC_delay( TMR_SECS( 1 ) );
+
+} // end range_calibrate()
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+void range_cal_fail( const char *why )
+{
+
+	// Nothing was saved and 'range_cal' wasn't touched, so the table in
+	// use before the calibration stays in use.
+	LCD_fb_clear();
+	LCD_fb_puts( 0, 0, "Cal not saved:" );
+	LCD_fb_puts( 1, 0, why );
+	LCD_fb_puts( 2, 0, "old table kept" );
+	LCD_fb_sync();
+	TMRSRVC_delay( TMR_SECS( 2 ) );
+
+} // end range_cal_fail()
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+void speaker_start_note( void )
+{
+
+	unsigned short int word =
+		pgm_read_word( &speaker.measure_info.notes[ speaker.note ] );
+	unsigned short int dur_ms = SEQ_NOTE_LEN( word ) * NOTE_SIXTEENTH;
+
+	// Rests are silent for their whole length.  Notes sound for most of
+	// it and go quiet for the rest, so repeated notes don't run together.
+	if ( SEQ_NOTE_NOTE( word ) == SPKR_NOTE_NONE )
+	{
+
+		speaker.on_ms = 0;
+		SPKR_tone( 0 );
+
+	} // end if()
+	else
+	{
+
+		speaker.on_ms = ( unsigned short int )
+						( ( ( unsigned long ) dur_ms * NOTE_ARTIC_PCT ) / 100 );
+		SPKR_note( SEQ_NOTE_NOTE( word ), SEQ_NOTE_OCTAVE( word ), 0 );
+
+	} // end else.
+
+	speaker.off_ms = dur_ms - speaker.on_ms;
+
+} // end speaker_start_note()
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+void speaker_start_song( const SEQ_SONG *song )
+{
+
+	speaker.song = song;
+	memcpy_P( &speaker.song_info, song, sizeof( SEQ_SONG ) );
+	memcpy_P( &speaker.measure_info, &speaker.song_info.measures[ 0 ],
+			  sizeof( SEQ_MEASURE ) );
+	speaker.song_pass = 0;
+	speaker.measure = 0;
+	speaker.measure_pass = 0;
+	speaker.note = 0;
+
+	speaker_start_note();
+
+} // end speaker_start_song()
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+BOOL speaker_next_note( void )
+{
+
+	// Step note -> measure repeat -> measure -> song repeat.  Returns FALSE
+	// once the song is over.  Moving to another measure copies it out
+	// of flash.
+	if ( ++speaker.note < speaker.measure_info.n_notes )
+		return TRUE;
+
+	speaker.note = 0;
+	if ( ++speaker.measure_pass < speaker.measure_info.repeat )
+		return TRUE;
+
+	speaker.measure_pass = 0;
+	if ( ++speaker.measure >= speaker.song_info.n_measures )
+	{
+
+		speaker.measure = 0;
+		if ( ++speaker.song_pass >= speaker.song_info.repeat )
+			return FALSE;
+
+	} // end if()
+
+	memcpy_P( &speaker.measure_info,
+			  &speaker.song_info.measures[ speaker.measure ],
+			  sizeof( SEQ_MEASURE ) );
+
+	return TRUE;
+
+} // end speaker_next_note()
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+void speaker_play( const SEQ_SONG *song )
+{
+
+	// Drop whatever is playing or queued and start this one right away.
+	speaker.q_count = 0;
+	speaker_start_song( song );
+
+} // end speaker_play()
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+BOOL speaker_queue( const SEQ_SONG *song )
+{
+
+	// Nothing playing -- just start it.
+	if ( speaker.song == NULL )
+	{
+
+		speaker_start_song( song );
+		return TRUE;
+
+	} // end if()
+
+	if ( speaker.q_count >= SPKR_QUEUE_LEN )
+		return FALSE;
+
+	speaker.queue[ ( speaker.q_head + speaker.q_count ) % SPKR_QUEUE_LEN ] = song;
+	speaker.q_count++;
+
+	return TRUE;
+
+} // end speaker_queue()
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+void speaker_stop( void )
+{
+
+	speaker.q_count = 0;
+	speaker.song = NULL;
+	SPKR_tone( 0 );
+
+} // end speaker_stop()
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+BOOL speaker_busy( void )
+{
+
+	return ( speaker.song != NULL ) ? TRUE : FALSE;
+
+} // end speaker_busy()
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+void speaker_tick( void )
+{
+
+	// Timer callback -- runs in the timer interrupt, so ticks are never
+	// missed however long a trip around the loop takes.
+	speaker.ticks++;
+
+} // end speaker_tick()
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+void speaker_service( TIMER16 interval_ms )
+{
+
+	// Counts off however much time has gone by since the last call, so the
+	// tempo holds even when the loop is slow.  Only does anything once a
+	// tick has come in, so it never holds up the rest of the loop.
+	static BOOL timer_started = FALSE;
+	static TIMEROBJ speaker_timer;
+	unsigned char sreg;
+	unsigned short int elapsed;
+
+	if ( timer_started == FALSE )
+	{
+
+		TMRSRVC_REGISTER_CBFUNC( speaker_timer, speaker_tick );
+		TMRSRVC_new( &speaker_timer, TMRFLG_NOTIFY_FUNC, TMRTCM_RESTART,
+			interval_ms );
+
+		timer_started = TRUE;
+		return;
+
+	} // end if()
+
+	sreg = SREG;
+	cli();
+	elapsed = speaker.ticks * interval_ms;
+	speaker.ticks = 0;
+	SREG = sreg;
+
+	while ( ( elapsed > 0 ) && ( speaker.song != NULL ) )
+	{
+
+		// Still sounding the note?
+		if ( speaker.on_ms > elapsed )
+		{
+
+			speaker.on_ms -= elapsed;
+			return;
+
+		} // end if()
+
+		// Note is done -- go quiet for the rest of its length.
+		if ( speaker.on_ms > 0 )
+		{
+
+			elapsed -= speaker.on_ms;
+			speaker.on_ms = 0;
+			SPKR_tone( 0 );
+
+		} // end if()
+
+		if ( speaker.off_ms > elapsed )
+		{
+
+			speaker.off_ms -= elapsed;
+			return;
+
+		} // end if()
+
+		elapsed -= speaker.off_ms;
+		speaker.off_ms = 0;
+
+		// On to the next note, or the next song in the queue.
+		if ( speaker_next_note() == TRUE )
+			speaker_start_note();
+		else if ( speaker.q_count > 0 )
+		{
+
+			const SEQ_SONG *next = speaker.queue[ speaker.q_head ];
+
+			speaker.q_head = ( speaker.q_head + 1 ) % SPKR_QUEUE_LEN;
+			speaker.q_count--;
+			speaker_start_song( next );
+
+		} // end else if()
+		else
+			speaker_stop();
+
+	} // end while()
+
+} // end speaker_service()
+
+
+// ---------------------- Top-Level Behaviorals: ----------------------------------------------------------------------------------------------------- //
+// --------------------------------------------------------------------------------------------------------------------------------------------------- //
+void IR_sense( volatile SENSOR_DATA *pSensors, TIMER16 interval_ms )
+{
+
+	// Sense must know if it's already sensing.
+	//
+	// NOTE: 'BOOL' is a custom data type offered by the CEENBoT API.
+	//
+	static BOOL timer_started = FALSE;
+			
+	// The 'sense' timer is used to control how often gathering sensor
+	// data takes place.  The pace at which this happens needs to be
+	// controlled.  So we're forced to use TIMER OBJECTS along with the
+	// TIMER SERVICE.  It must be 'static' because the timer object must remain
+	// 'alive' even when it is out of scope -- otherwise the program will crash.
+	static TIMEROBJ sense_timer;
+	unsigned char buttons;
+			
+	// If this is the FIRST time that sense() is running, we need to start the
+	// sense timer.  We do this ONLY ONCE!
+	if ( timer_started == FALSE )
+	{
+				
+		// Start the 'sense timer' to tick on every 'interval_ms'.
+		//
+		// NOTE:  You can adjust the delay value to suit your needs.
+		//
+		TMRSRVC_new( &sense_timer, TMRFLG_NOTIFY_FLAG, TMRTCM_RESTART,
+		interval_ms );
+				
+		// Mark that the timer has already been started.
+		timer_started = TRUE;
+				
+	} // end if()
+			
+	// Otherwise, just do the usual thing and just 'sense'.
+	else
+	{
+
+		// Only read the sensors when it is time to do so (e.g., every
+		// 125ms).  Otherwise, do nothing.
+		if ( TIMER_ALARM( sense_timer ) )
+		{
+
+			// NOTE: Just as a 'debugging' feature, let's also toggle the green LED
+			//       to know that this is working for sure.  The LED will only
+			//       toggle when 'it's time'.
+			LED_toggle( LED_Green );
+
+
+			// Read the left and right sensors, and store this
+			// data in the 'SENSOR_DATA' structure.
+			pSensors->left_IR  = ATTINY_get_IR_state( ATTINY_IR_LEFT  );
+			pSensors->right_IR = ATTINY_get_IR_state( ATTINY_IR_RIGHT );
+
+			buttons = ATTINY_get_sensors();
+			pSensors->sw3 = ( buttons & SNSR_SW3_STATE ) ? 1 : 0;
+			pSensors->sw4 = ( buttons & SNSR_SW4_STATE ) ? 1 : 0;
+			pSensors->sw5 = ( buttons & SNSR_SW5_STATE ) ? 1 : 0;
+			pSensors->ir_ms = SENSE_STAMP();
+					
+
+			// NOTE: You can add more stuff to 'sense' here.
+					
+			// Snooze the alarm so it can trigger again.
+			TIMER_SNOOZE( sense_timer );
+					
+		} // end if()
+
+	} // end else.
+
+} // end sense()
+
+// ----------------------------------------------------------------------------------------------------------------------------------------- //
+void Photo_sense( volatile SENSOR_DATA *pSensors, TIMER16 interval_ms )
+{
+	static BOOL timer_started = FALSE;   //  Check if photo-sense is already running
+
+	static TIMEROBJ sense_timer;         // Used to control the pace at which sensor data is gathered
+
+	if( timer_started == FALSE )		// If this is first time sense() runs, start the photo-sense timer.  This happens only once!!!
+	{
+		TMRSRVC_new( &sense_timer, TMRFLG_NOTIFY_FLAG, TMRTCM_RESTART, interval_ms);	// Start the photo-sense timer, adjusted to tick every 'interval_ms'
+
+		timer_started = TRUE;			// Mark that timer is started
+	}
+	else
+	{
+		if( TIMER_ALARM( sense_timer ) )
+		{
+			LED_toggle( LED_Red );		// for debugging, to make sure photo-sensing is occurring
+			ADC_SAMPLE sample;
+
+			ADC_set_channel(ADC_CHAN6);
+			sample = ADC_sample();
+			pSensors->left_photo_mv = ADC_TO_MV( sample );
+
+			ADC_set_channel(ADC_CHAN4);
+			sample = ADC_sample();
+			pSensors->right_photo_mv = ADC_TO_MV( sample );
+			pSensors->photo_ms = SENSE_STAMP();
+
+			// Snooze the alarm so it can trigger again.
+			TIMER_SNOOZE( sense_timer );
+		}
+	}
+}  // end Photo_sense()
+
+// ----------------------------------------------------------------------------------------------------------------------------------------- //
+
+void Sonar_sense( volatile SENSOR_DATA *pSensors, TIMER16 interval_ms )
+{
+	static BOOL timer_started = FALSE;
+
+	static TIMER16 period;
+
+	static TIMEROBJ sense_timer;
+
+	// SONAR_SENSE_MS can be SET over the link -- re-arm at the new period.
+	if( timer_started == TRUE && interval_ms != period )
+	{
+		TMRSRVC_stop_timer( &sense_timer );
+		timer_started = FALSE;
+	}
+
+	if(timer_started == FALSE)
+	{
+		TMRSRVC_new( &sense_timer, TMRFLG_NOTIFY_FLAG, TMRTCM_RESTART, interval_ms);
+		period = interval_ms;
+		timer_started = TRUE;
+	}
+	else
+	{
+		if( TIMER_ALARM( sense_timer ) )
+		{					
+			float distance_cm;
+			char text[ FMT_BUF_LEN ];
+
+			distance_cm = USONIC_DIST_CM( USONIC_ping() );
+
+			pSensors->sonar_mm = ( distance_cm < 6553.5 ) ? ( unsigned short )( distance_cm * 10 ) : 0xFFFF;
+			pSensors->sonar_seq++;
+			pSensors->sonar_ms = SENSE_STAMP();
+
+			// Keep the behavior on row 0 and show the distance underneath.
+			LCD_fb_clear_row( 1 );
+			LCD_fb_puts( 1, 0, "Dist = " );
+			fmt_q( text, ( signed long )( distance_cm * ( 1 << SONAR_FRAC_BITS ) ), SONAR_FRAC_BITS, 2 );
+			LCD_fb_puts( 1, 7, text );
+					
+			// Snooze the alarm so it can trigger again.
+			TIMER_SNOOZE(sense_timer);
+		}
+	}
+} // end Sonar_Sense()
+
+// ----------------------------------------------------------------------------------------------------------------------------------------- //
+void Line_sense( volatile SENSOR_DATA *pSensors, TIMER16 interval_ms )
+{
+	static BOOL timer_started = FALSE;   //  Check if photo-sense is already running
+
+	static TIMER16 period;               // Period the timer was started with
+
+	static TIMEROBJ sense_timer;         // Used to control the pace at which sensor data is gathered
+
+	// LINE_SENSE_MS can be SET over the link -- re-arm at the new period.
+	if( timer_started == TRUE && interval_ms != period )
+	{
+		TMRSRVC_stop_timer( &sense_timer );
+		timer_started = FALSE;
+	}
+
+	if( timer_started == FALSE )		// If this is first time sense() runs, start the photo-sense timer.  This happens only once!!!
+	{
+		TMRSRVC_new( &sense_timer, TMRFLG_NOTIFY_FLAG, TMRTCM_RESTART, interval_ms);	// Start the photo-sense timer, adjusted to tick every 'interval_ms'
+
+		period = interval_ms;
+		timer_started = TRUE;			// Mark that timer is started
+	}
+	else
+	{
+		if( TIMER_ALARM( sense_timer ) )
+		{
+			LED_toggle( LED_Red );		// for debugging, to make sure photo-sensing is occurring
+			ADC_SAMPLE sample;
+			
+			ADC_set_channel(ADC_CHAN6);		// Left sensor on J3 pin 4
+			sample = ADC_sample();
+			pSensors->left_line_mv = ADC_TO_MV( sample );
+
+			ADC_set_channel(ADC_CHAN4);		// Right sensor on J3 pin 2
+			sample = ADC_sample();
+			pSensors->right_line_mv = ADC_TO_MV( sample );
+			pSensors->line_ms = SENSE_STAMP();
+
+			// Snooze the alarm so it can trigger again.
+			TIMER_SNOOZE( sense_timer );
+		}
+	}
+}  // end Line_sense()
+
+// ----------------------------------------------------------------------------------------------------------------------------------------- //
+void Photo_init( volatile SENSOR_DATA *pSensors )
+{
+	// Ambient is the average of everything boot calibration sampled while
+	// the menu was up, rather than a single reading.
+	pSensors->left_photo_ambient_mv = ADC_TO_MV( cal.left_sum / cal.samples );
+	pSensors->right_photo_ambient_mv = ADC_TO_MV( cal.right_sum / cal.samples );
+} // end Photo_init()
+
+// ----------------------------------------------------------------------------------------------------------------------------------------- //
+void Odometry_sense( TIMER16 interval_ms )
+{
+	static BOOL timer_started = FALSE;
+
+	static TIMEROBJ sense_timer;
+
+	if( timer_started == FALSE )
+	{
+		odometry.tick_ms = interval_ms;
+		TMRSRVC_REGISTER_CBFUNC( sense_timer, odometry_tick );
+		TMRSRVC_new( &sense_timer, TMRFLG_NOTIFY_FUNC, TMRTCM_RESTART, interval_ms );
+		timer_started = TRUE;
+	}
+	else
+	{
+		odometry_update();
+	}
+} // end Odometry_sense()
+
+// ----------------------------------------------------------------------------------------------------------------------------------------- //
+void odometry_tick( void )
+{
+	// Timer callback -- runs in the timer interrupt, so no tick is lost
+	// however long a trip around the loop (or a blocking move) takes.
+	odometry.ticks++;
+} // end odometry_tick()
+
+// ----------------------------------------------------------------------------------------------------------------------------------------- //
+signed long odometry_ramp( signed long rate, signed short target, unsigned short accel, unsigned char tick_ms )
+{
+	// One tick of the stepper driver's ramp: 'accel' steps/sec^2 for
+	// 'tick_ms' is accel * tick_ms milli-steps/sec.  No ramp means no wait.
+	signed long goal = (signed long) target * 1000;
+	signed long step = (signed long) accel * tick_ms;
+
+	if( ( accel == 0 ) || ( labs( goal - rate ) <= step ) )
+		return goal;
+
+	return ( goal > rate ) ? rate + step : rate - step;
+} // end odometry_ramp()
+
+// ----------------------------------------------------------------------------------------------------------------------------------------- //
+void odometry_update( void )
+{
+	// Integrates every tick that has come in since the last call.  Travel
+	// over a tick is the area under the ramped speed (a trapezoid).
+	unsigned char sreg;
+	unsigned short ticks;
+	signed long old_L;
+	signed long old_R;
+
+	sreg = SREG;
+	cli();
+	ticks = odometry.ticks;
+	odometry.ticks = 0;
+	SREG = sreg;
+
+	while( ticks-- > 0 )
+	{
+		old_L = odometry.rate_L;
+		old_R = odometry.rate_R;
+		odometry.rate_L = odometry_ramp( old_L, odometry.target_L, odometry.accel_L, odometry.tick_ms );
+		odometry.rate_R = odometry_ramp( old_R, odometry.target_R, odometry.accel_R, odometry.tick_ms );
+
+		odometry.left_msteps  += ( old_L + odometry.rate_L ) * odometry.tick_ms / 2000;
+		odometry.right_msteps += ( old_R + odometry.rate_R ) * odometry.tick_ms / 2000;
+		odometry.time_ms += odometry.tick_ms;
+	}
+} // end odometry_update()
+
+// ----------------------------------------------------------------------------------------------------------------------------------------- //
+void odometry_drive( signed short speed_L, signed short speed_R, unsigned short accel_L, unsigned short accel_R )
+{
+	// The wheels were just told to free-run at these speeds.  Whatever
+	// time has gone by so far was at the old ones.
+	odometry_update();
+
+	odometry.target_L = speed_L;
+	odometry.target_R = speed_R;
+	odometry.accel_L = accel_L;
+	odometry.accel_R = accel_R;
+} // end odometry_drive()
+
+// ----------------------------------------------------------------------------------------------------------------------------------------- //
+void odometry_steps( signed short steps_L, signed short steps_R )
+{
+	// The wheels were stopped and then moved exactly these steps (0, 0
+	// for a plain stop).  Call it before a step move starts and again
+	// once it's done.
+	odometry_update();
+
+	odometry.rate_L = 0;
+	odometry.rate_R = 0;
+	odometry.target_L = 0;
+	odometry.target_R = 0;
+
+	odometry.left_msteps  += (signed long) steps_L * 1000;
+	odometry.right_msteps += (signed long) steps_R * 1000;
+} // end odometry_steps()
+
+// ----------------------------------------------------------------------------------------------------------------------------------------- //
+void Cruise( volatile MOTOR_ACTION *pAction )
+{
+	// Nothing to do, but set the parameters to explore.  'act()' will do
+	// the rest down the line.
+	action_state( pAction, CRUISING );
+	action_speed( pAction, CRUISE_SPEED, CRUISE_SPEED );
+	action_accel( pAction, 400, 400 );
+			
+	// That's it -- let 'act()' do the rest.
+			
+} // end Cruise()
+
+// --------------------------------------------------------------------------------------------------------------------------- //
+void Pixy_Follow( volatile MOTOR_ACTION *pAction, volatile SENSOR_DATA *pSensors )
+{
+
+	// Only process this behavior -if- there is NEW data from the pixy.
+	// Stick with the object we're already tracking, if there is one.
+	if( pixy_read( pSensors, ( target.valid == TRUE ) ? SELECT_NEAREST : SELECT_LARGEST,
+				   PIXY_ALL_SIGS ) == TRUE )
+	{
+		float measX = pSensors->pixy_data.pos.x - PIXY_CENTER_X;  // Right of center is positive
+		float measRange = range_from_size( blob_size( &pSensors->pixy_data ) );
+
+		// Time since the last frame filtered -- frames that were dropped or
+		// didn't have the target in them are part of it -- and the time since
+		// this one closed, on top of the pipeline latency.
+		unsigned short int dt_ms = pSensors->pixy_ms - target.time_ms;
+		unsigned short int lead_ms = TRACK_LATENCY_MS + pixy_stats.age_ms;
+
+		// Filter the centroid, or start over if we'd lost it.
+		if ( target.valid == FALSE )
+		{
+			target.x.pos = measX;
+			target.x.vel = 0;
+			target.range.pos = measRange;
+			target.range.vel = 0;
+			target.valid = TRUE;
+		}
+		else
+		{
+			track_update( &target.x, measX, dt_ms );
+			track_update( &target.range, measRange, dt_ms );
+		}
+		target.time_ms = pSensors->pixy_ms;
+
+		// Steer toward where the target is now, not where it was when
+		// the frame was taken.
+		int coordX = track_predict( &target.x, lead_ms );
+		int rangeErr = track_predict( &target.range, lead_ms ) - params.follow_standoff;
+
+		// Speed
+		int base_speed = 0;  // Bot is not moving by default
+		//int base_speed = 100;
+
+		// Turn
+		int kpx = 1;
+		int turn = 0; // Bot goes straight by default
+
+		// Dead zone logic
+		int zoneX = params.pixy_zone_x;
+
+		if ( abs(coordX) > zoneX ) {
+			// CEENBoT needs to turn left or right
+			turn = kpx * coordX;
+		}
+
+		if ( abs(rangeErr) > FOLLOW_ZONE_CM ) {
+			// CEENBoT needs to close in or back off to hold the standoff
+			base_speed = FOLLOW_KP_RANGE * rangeErr;
+			if ( base_speed > FOLLOW_MAX_SPEED )
+				base_speed = FOLLOW_MAX_SPEED;
+			else if ( base_speed < -FOLLOW_MAX_SPEED )
+				base_speed = -FOLLOW_MAX_SPEED;
+		}
+
+		target.speed_L = base_speed + turn;
+		target.speed_R = base_speed - turn;
+
+	} // end if()
+
+	// Haven't seen it for a while -- don't trust the old velocity.
+	else if ( ( target.valid == TRUE ) && ( pixy_stats.age_ms >= TRACK_LOST_MS ) )
+	{
+
+		target.valid = FALSE;
+
+	} // end else if()
+
+	// Pixy_Follow() runs every trip around the loop but frames only come
+	// in every 20 ms -- keep following in between.
+	if ( target.valid == TRUE )
+	{
+
+		action_state( pAction, FOLLOWING );
+		action_speed( pAction, target.speed_L, target.speed_R );
+
+	} // end if()
+
+} // end Pixy_Follow()
+
+// --------------------------------------------------------------------------------------------------------------------------- //
+void Pixy_Trigger( volatile MOTOR_ACTION *pAction, volatile SENSOR_DATA *pSensors )
+{
+
+	unsigned char signum;
+	unsigned char ready = 0;
+
+	// Only look at signatures that have a reaction and aren't cooling
+	// down, and of those take the lowest numbered one in view.
+	for ( signum = 1; signum < PIXY_SIGNATURES; signum++ )
+	{
+		if ( ( pgm_read_word( &reactions[ signum ].cooldown_ms ) > 0 ) &&
+			 ( reaction.cooldown_ms[ signum ] == 0 ) )
+			ready |= ( 1 << signum );
+	}
+
+	// Only process this behavior -if- there is NEW data from the pixy.
+	if( pixy_read( pSensors, SELECT_PRIORITY, ready ) == TRUE )
+	{
+		// Look the signature up and start its reaction, unless it went
+		// off recently or another reaction is still moving the robot.
+		signum = pSensors->pixy_data.signum;
+
+		if ( ( signum > 0 ) && ( signum < PIXY_SIGNATURES ) &&
+			 ( reaction.cooldown_ms[ signum ] == 0 ) && ( reaction.moving == FALSE ) )
+		{
+
+			memcpy_P( &reaction.current, &reactions[ signum ], sizeof( REACTION ) );
+
+			if ( reaction.current.cooldown_ms > 0 )
+			{
+
+				reaction.signum = signum;
+				reaction.moving = ( reaction.current.motion.steps > 0 ) ? TRUE : FALSE;
+				reaction.started = FALSE;
+				reaction.cooldown_ms[ signum ] = reaction.current.cooldown_ms;
+
+				if ( reaction.current.song != NULL )
+					speaker_play( reaction.current.song );
+
+			} // end if()
+
+		} // end if()
+
+	} // end if()
+
+	// Frames only come in every 20 ms, but this runs every trip around
+	// the loop -- stay 'following' as long as the camera has seen
+	// something lately, rather than flickering back to cruising.
+	if ( ( pixy_stats.frames > 0 ) && ( pixy_stats.age_ms < PIXY_HOLD_MS ) )
+		action_state( pAction, FOLLOWING );
+
+} // end Pixy_Trigger()
+// --------------------------------------------------------------------------------------------------------------------------- //
+void react_tick( void )
+{
+
+	// Timer callback -- runs in the timer interrupt, so cooldowns keep
+	// counting even through a slow trip around the loop.
+	reaction.ticks++;
+
+} // end react_tick()
+// --------------------------------------------------------------------------------------------------------------------------- //
+void React( volatile MOTOR_ACTION *pAction, TIMER16 interval_ms )
+{
+
+	// Carries out the motion 'Pixy_Trigger()' started and counts the signature
+	// cooldowns down.  The motion is a non-blocking step move with the
+	// same 400 steps/sec^2 ramp as the turn in 'IR_avoid()', so it turns
+	// the full angle however long the ramps take.  Never blocks, so
+	// sensing, the song and 'IR_avoid()' all keep running meanwhile.
+	static BOOL timer_started = FALSE;
+	static TIMEROBJ react_timer;
+	unsigned char i;
+	unsigned char sreg;
+	unsigned short int elapsed;
+	STEPPER_NSTEPS steps_left;
+
+	if ( timer_started == FALSE )
+	{
+
+		TMRSRVC_REGISTER_CBFUNC( react_timer, react_tick );
+		TMRSRVC_new( &react_timer, TMRFLG_NOTIFY_FUNC, TMRTCM_RESTART,
+			interval_ms );
+
+		timer_started = TRUE;
+
+	} // end if()
+
+	// Take off however much time has gone by since the last call.
+	sreg = SREG;
+	cli();
+	elapsed = reaction.ticks * interval_ms;
+	reaction.ticks = 0;
+	SREG = sreg;
+
+	for ( i = 0; i < PIXY_SIGNATURES; i++ )
+	{
+
+		if ( reaction.cooldown_ms[ i ] > elapsed )
+			reaction.cooldown_ms[ i ] -= elapsed;
+		else
+			reaction.cooldown_ms[ i ] = 0;
+
+	} // end for()
+
+	if ( reaction.moving == FALSE )
+		return;
+
+	// Start the move the first time through, then wait for both wheels
+	// to finish their steps.
+	if ( reaction.started == FALSE )
+	{
+
+		odometry_steps( 0, 0 );
+		STEPPER_move_stnb( STEPPER_BOTH,
+			( reaction.current.motion.speed_L < 0 ) ? STEPPER_REV : STEPPER_FWD,
+			reaction.current.motion.steps, abs( reaction.current.motion.speed_L ),
+			400, STEPPER_BRK_OFF,
+			( reaction.current.motion.speed_R < 0 ) ? STEPPER_REV : STEPPER_FWD,
+			reaction.current.motion.steps, abs( reaction.current.motion.speed_R ),
+			400, STEPPER_BRK_OFF );
+
+		reaction.started = TRUE;
+
+	} // end if()
+	else
+	{
+
+		steps_left = STEPPER_get_nSteps();
+
+		if ( ( steps_left.left == 0 ) && ( steps_left.right == 0 ) )
+		{
+
+			odometry_steps(
+				( reaction.current.motion.speed_L < 0 ) ? -reaction.current.motion.steps : reaction.current.motion.steps,
+				( reaction.current.motion.speed_R < 0 ) ? -reaction.current.motion.steps : reaction.current.motion.steps );
+			reaction.moving = FALSE;
+			return;
+
+		} // end if()
+
+	} // end else.
+
+	// REACTING tells 'act()' the step move has the wheels.
+	action_state( pAction, REACTING );
+	action_speed( pAction, reaction.current.motion.speed_L, reaction.current.motion.speed_R );
+	action_accel( pAction, 400, 400 );
+
+} // end React()
+
+// ------------------------------------------------------------------------------------------------------------------------------------------ //
+void IR_avoid( volatile MOTOR_ACTION *pAction, volatile SENSOR_DATA *pSensors )
+{
+
+	// NOTE: Here we have NO CHOICE, but to do this 'ballistically'.
+	//       **NOTHING** else can happen while we're 'avoiding'.
+			
+	if( pSensors->right_IR == TRUE && pSensors->left_IR == TRUE)
+	{
+		action_state( pAction, IR_AVOIDING );
+		LCD_fb_clear();
+		LCD_fb_puts( 0, 0, "AVOIDING..." );
+		LCD_fb_sync();
+
+		STEPPER_stop(STEPPER_BOTH, STEPPER_BRK_OFF);
+		odometry_steps( 0, 0 );
+
+		// Back up...
+		STEPPER_move_stwt( STEPPER_BOTH,
+		STEPPER_REV, 250, 200, 400, STEPPER_BRK_OFF,
+		STEPPER_REV, 250, 200, 400, STEPPER_BRK_OFF );
+		odometry_steps( -250, -250 );
+				
+		// ... and turn LEFT ~90-deg
+		STEPPER_move_stwt( STEPPER_BOTH,
+		STEPPER_REV, DEG_90, 200, 400, STEPPER_BRK_OFF,
+		STEPPER_FWD, DEG_90, 200, 400, STEPPER_BRK_OFF);
+		odometry_steps( -DEG_90, DEG_90 );
+
+		// ... and set the motor action structure with variables to move forward.
+		action_state( pAction, IR_AVOIDING );
+		action_speed( pAction, 200, 200 );
+		action_accel( pAction, 400, 400 );
+	}
+	// If the LEFT sensor tripped...
+	else if( pSensors->left_IR == TRUE )
+	{
+		action_state( pAction, IR_AVOIDING );
+		LCD_fb_clear();
+		LCD_fb_puts( 0, 0, "AVOIDING..." );
+		LCD_fb_sync();
+
+		STEPPER_stop(STEPPER_BOTH, STEPPER_BRK_OFF);
+		odometry_steps( 0, 0 );
+
+		// Back up...
+		STEPPER_move_stwt( STEPPER_BOTH,
+		STEPPER_REV, 250, 200, 400, STEPPER_BRK_OFF,
+		STEPPER_REV, 250, 200, 400, STEPPER_BRK_OFF );
+		odometry_steps( -250, -250 );
+				
+		// ... and turn LEFT ~90-deg
+		STEPPER_move_stwt( STEPPER_BOTH,
+		STEPPER_REV, DEG_90, 200, 400, STEPPER_BRK_OFF,
+		STEPPER_FWD, DEG_90, 200, 400, STEPPER_BRK_OFF);
+		odometry_steps( -DEG_90, DEG_90 );
+
+		// ... and set the motor action structure with variables to move forward.
+		action_state( pAction, IR_AVOIDING );
+		action_speed( pAction, 200, 200 );
+		action_accel( pAction, 400, 400 );
+				
+	}
+	else if( pSensors->right_IR == TRUE)
+	{
+		action_state( pAction, IR_AVOIDING );
+		LCD_fb_clear();
+		LCD_fb_puts( 0, 0, "AVOIDING..." );
+		LCD_fb_sync();
+
+		STEPPER_stop(STEPPER_BOTH, STEPPER_BRK_OFF);
+		odometry_steps( 0, 0 );
+
+		// Back up...
+		STEPPER_move_stwt( STEPPER_BOTH,
+		STEPPER_REV, 250, 200, 400, STEPPER_BRK_OFF,
+		STEPPER_REV, 250, 200, 400, STEPPER_BRK_OFF );
+		odometry_steps( -250, -250 );
+				
+		// ... and turn LEFT ~90-deg
+		STEPPER_move_stwt( STEPPER_BOTH,
+		STEPPER_REV, DEG_90, 200, 400, STEPPER_BRK_OFF,
+		STEPPER_FWD, DEG_90, 200, 400, STEPPER_BRK_OFF);
+		odometry_steps( -DEG_90, DEG_90 );
+
+		// ... and set the motor action structure with variables to move forward.
+		action_state( pAction, IR_AVOIDING );
+		action_speed( pAction, 200, 200 );
+		action_accel( pAction, 400, 400 );
+	}
+} // end avoid()
+
+// --------------------------------------------------------------------------------------------------------------------------- //
+void Light_Follow(volatile MOTOR_ACTION *pAction, volatile SENSOR_DATA *pSensors)
+{
+	float left_voltage = MV_TO_V( pSensors->left_photo_mv );
+	float right_voltage = MV_TO_V( pSensors->right_photo_mv );
+	float left_ambient = MV_TO_V( pSensors->left_photo_ambient_mv );
+	float right_ambient = MV_TO_V( pSensors->right_photo_ambient_mv );
+
+	float light_min = (( 5 - (left_ambient + right_ambient)/2 ) * 0.2 )  
+						+ ((left_ambient + right_ambient)/2);
+	float base_speed = 200;
+
+	float adjusted_left = left_voltage - left_ambient;
+	float adjusted_right = right_voltage - right_ambient;
+			
+	// minimum adjusted value is 0
+	if ( adjusted_right < 0 ) {
+		adjusted_right = 0;
+	}
+	if ( adjusted_left < 0 ) {
+		adjusted_left = 0;
+	}
+			
+	float percentage_left = adjusted_left / ( 5 - left_ambient);
+	float percentage_right = adjusted_right / ( 5 - right_ambient);
+			
+	float right_minus_left = percentage_right - percentage_left;
+			
+	if ( (left_voltage + right_voltage)/2 > light_min)
+	{
+		action_state( pAction, HOMING );
+
+		action_speed( pAction, base_speed*( 1 + right_minus_left ),
+					  base_speed*( 1 - right_minus_left ) );
+	}
+}  // end Light_Follow()
+
+// --------------------------------------------------------------------------------------------------------------------------- //
+void Sonar_Avoid( volatile MOTOR_ACTION *pAction, volatile SENSOR_DATA *pSensors)
+{
+	float base_speed = 200;
+	int trigger_distance = params.sonar_trigger;
+	float sonar_dist = MM_TO_CM( pSensors->sonar_mm );
+			
+	if ( sonar_dist > 0 && sonar_dist < trigger_distance ) {
+				
+		action_state( pAction, SONAR_AVOIDING );				
+				
+		action_speed( pAction, base_speed + ( trigger_distance - sonar_dist ),
+					  base_speed - ( trigger_distance - sonar_dist ) );
+	}
+} // end Sonar_Avoid()
+
+// --------------------------------------------------------------------------------------------------------------------------- //	
+void Wall_estimate( volatile SENSOR_DATA *pSensors ) {
+	
+	// Two sonar hits on the wall, taken a known distance apart (odometry),
+	// give the direction of the wall.  With the wall on the right and the
+	// beam at -45 degrees (unit vector u), in the frame of the first reading:
+	//
+	//		P1 = r1 * u
+	//		P2 = ( dx, dy ) + R( dtheta ) * r2 * u
+	//
+	// The wall runs along P2 - P1; its angle, less the turn made since the
+	// first reading, is our heading relative to the wall.  The perpendicular
+	// distance is then r2 * sin( 45 deg + angle ).
+	float r = MM_TO_CM( pSensors->sonar_mm );
+	float ds;
+	float dtheta;
+	float ux = cos( SONAR_ANGLE );
+	float uy = -sin( SONAR_ANGLE );
+	float wx;
+	float wy;
+	float angle;
+	signed long dl;
+	signed long dr;
+	
+	if ( pSensors->sonar_seq == wall_state.last_seq ) {
+		return;
+	}
+	wall_state.last_seq = pSensors->sonar_seq;
+	
+	// No echo and no wall yet -- nothing to estimate from.
+	if ( ( r <= 0 ) && !wall_state.valid ) {
+		return;
+	}
+	
+	if ( !wall_state.valid ) {
+		wall_state.valid = true;
+		wall_state.angle = 0;
+	}
+	else if ( ( r <= 0 ) || ( ( r - wall_state.last_range ) > CORNER_JUMP_CM ) ) {
+		
+		// Missed echoes are routine, so one reading isn't enough.  Note where
+		// the wall seemed to end and keep steering on the last estimate until
+		// CORNER_GONE_READS in a row agree.
+		if ( wall_state.gone++ == 0 ) {
+			wall_state.gone_left = odometry.left_msteps;
+			wall_state.gone_right = odometry.right_msteps;
+			wall_state.gone_ms = odometry.time_ms;
+		}
+		if ( wall_state.gone < CORNER_GONE_READS ) {
+			return;
+		}
+		wall_state.gone = 0;
+		
+		// The wall ended at the first of those readings.  The beam hit it
+		// about one perpendicular distance ahead of us there, so that's how
+		// far to run on before turning.
+		corner.phase = CORNER_STRAIGHT;
+		corner.lead_cm = wall_state.dist;
+		corner.start_left = wall_state.gone_left;
+		corner.start_right = wall_state.gone_right;
+		corner.start_ms = wall_state.gone_ms;
+		corner.max_dev = 0;
+		corner.found = false;
+		corner.settled = 0;
+		corner.last_seq = pSensors->sonar_seq;
+		wall_state.valid = false;
+		return;
+	}
+	else {
+		wall_state.gone = 0;
+		
+		dl = odometry.left_msteps - wall_state.last_left;
+		dr = odometry.right_msteps - wall_state.last_right;
+		ds = ( ( dl + dr ) / 2000.0 ) * CM_PER_STEP;
+		
+		// Too short a baseline and the sonar noise swamps the angle -- keep
+		// the old start point and wait until we've moved far enough.
+		if ( ds < WALL_BASELINE_CM ) {
+			wall_state.dist = r * sin( SONAR_ANGLE + wall_state.angle );
+			return;
+		}
+		
+		dtheta = ( ( dr - dl ) / 1000.0 ) * CM_PER_STEP / WHEEL_BASE_CM;
+		
+		wx = ds * cos( dtheta / 2 ) + r * ( ux * cos( dtheta ) - uy * sin( dtheta ) ) - wall_state.last_range * ux;
+		wy = ds * sin( dtheta / 2 ) + r * ( ux * sin( dtheta ) + uy * cos( dtheta ) ) - wall_state.last_range * uy;
+		
+		angle = atan2( wy, wx ) - dtheta;
+		wall_state.angle += WALL_ANGLE_FILTER * ( angle - wall_state.angle );
+	}
+	
+	wall_state.dist = r * sin( SONAR_ANGLE + wall_state.angle );
+	wall_state.last_range = r;
+	wall_state.last_left = odometry.left_msteps;
+	wall_state.last_right = odometry.right_msteps;
+	
+} // end Wall_estimate()
+
+// --------------------------------------------------------------------------------------------------------------------------- //	
+void Wall_Follow( volatile MOTOR_ACTION *pAction, volatile SENSOR_DATA *pSensors ) {
+	
+	// State feedback on distance and angle to the wall:
+	//
+	//		turn = k_dist * ( goal - dist ) + k_angle * angle
+	//
+	// Small-angle, the bot drifts toward the wall at v * angle and turns at
+	// 2 * turn / W, so the closed loop is a 2nd-order system with
+	//
+	//		wn^2 = 2 * v * k_dist / W,   k_angle = zeta * wn * W
+	//
+	// (speeds in cm/s here, hence the CM_PER_STEP conversions below).
+	// k_dist comes from the scheduled kp -- which was
+	// tuned against the 45-degree range, hence the 1.41 -- and k_angle is
+	// picked for WALL_ZETA damping.  The old derivative-of-range term only
+	// saw the heading through sonar noise; the angle estimate sees it directly.
+	float base_speed = WALL_BASE_SPEED;
+	float v = base_speed * CM_PER_STEP;
+	float k_dist;
+	float k_angle;
+	float wn;
+	int turn = 0;
+	
+	PD_GAINS gains;
+	gain_schedule( wall_schedule, base_speed, &params.wall_gains, &gains );
+	
+	// Wall_Corner() has the wheel while going round a corner.
+	if ( corner.phase != CORNER_NONE ) {
+		return;
+	}
+	
+	Wall_estimate( pSensors );
+	
+	if ( !wall_state.valid ) {
+		return;
+	}
+	
+	k_dist = gains.kp * 1.41;
+	wn = sqrt( 2 * v * ( k_dist * CM_PER_STEP ) / WHEEL_BASE_CM );
+	k_angle = WALL_ZETA * wn * WHEEL_BASE_CM / CM_PER_STEP;
+	
+	action_state( pAction, WALL_FOLLOWING );
+	
+	turn = k_dist * ( WALL_GOAL_PERP - wall_state.dist ) + k_angle * wall_state.angle;
+	
+	action_speed( pAction, base_speed - turn, base_speed + turn );
+	
+} // end Wall_Follow()
+
+// --------------------------------------------------------------------------------------------------------------------------- //	
+void Wall_Corner( volatile MOTOR_ACTION *pAction, volatile SENSOR_DATA *pSensors ) {
+	
+	// When the wall ends the range jumps and the PD terms would spin the bot
+	// in place.  Instead, run on until we're level with the end of the wall,
+	// then arc around it at the goal distance:
+	//
+	//		speed_L / speed_R = ( R + W/2 ) / ( R - W/2 )
+	//
+	// Progress is measured off odometry every pass, so nothing blocks.  Once
+	// the sonar sees the new face at about the goal range for a couple of
+	// readings, hand the wheel back to Wall_Follow().
+	float base_speed = WALL_BASE_SPEED;
+	float radius = WALL_GOAL_PERP;
+	float travel_cm;
+	float r = MM_TO_CM( pSensors->sonar_mm );
+	float dev;
+	
+	if ( corner.phase == CORNER_NONE ) {
+		return;
+	}
+	
+	action_state( pAction, WALL_FOLLOWING );
+	
+	travel_cm = ( ( odometry.left_msteps - corner.start_left ) +
+				  ( odometry.right_msteps - corner.start_right ) ) / 2000.0 * CM_PER_STEP;
+	
+	// Until the arc picks up the new face, the beam is looking into the
+	// open corner and the range says nothing about how far we've strayed.
+	// From the first settled reading on, every fresh reading counts toward
+	// the worst deviation.
+	if ( pSensors->sonar_seq != corner.last_seq ) {
+		
+		corner.last_seq = pSensors->sonar_seq;
+		dev = CORNER_SETTLE_CM;
+		
+		if ( r > 0 ) {
+			dev = ( r - WALL_GOAL_DIST ) / 1.41;
+			if ( dev < 0 ) {
+				dev = -dev;
+			}
+		}
+		
+		if ( ( corner.phase == CORNER_ARC ) && ( dev < CORNER_SETTLE_CM ) ) {
+			corner.found = true;
+		}
+		
+		if ( corner.found && ( r > 0 ) && ( dev > corner.max_dev ) ) {
+			corner.max_dev = dev;
+		}
+		
+		if ( corner.found && ( dev < CORNER_SETTLE_CM ) ) {
+			corner.settled++;
+		}
+		else {
+			corner.settled = 0;
+		}
+	}
+	
+	if ( corner.phase == CORNER_STRAIGHT ) {
+		
+		action_speed( pAction, base_speed, base_speed );
+		
+		if ( travel_cm >= corner.lead_cm ) {
+			corner.phase = CORNER_ARC;
+			corner.start_left = odometry.left_msteps;
+			corner.start_right = odometry.right_msteps;
+		}
+		return;
+	}
+	
+	// Settled, or gone round far enough that the wall isn't coming back.
+	if ( ( corner.settled >= CORNER_SETTLE_READS ) || ( travel_cm >= CORNER_MAX_ARC * radius ) ) {
+		corner.phase = CORNER_NONE;
+		corner.last_ms = odometry.time_ms - corner.start_ms;
+		return;
+	}
+	
+	// Wall is on the right, so turn right: left wheel on the outside.
+	action_speed( pAction, base_speed * ( radius + WHEEL_BASE_CM / 2 ) / radius,
+				  base_speed * ( radius - WHEEL_BASE_CM / 2 ) / radius );
+	
+} // end Wall_Corner()
+		
+// --------------------------------------------------------------------------------------------------------------------------- //
+void Line_Follow( volatile MOTOR_ACTION *pAction, volatile SENSOR_DATA *pSensors ) {
+	
+	// Voltages near VCC indicate low reflectance.
+	// Voltages near GND indicate high reflectance.
+	float leftVoltage = MV_TO_V( pSensors->left_line_mv );
+	float rightVoltage = MV_TO_V( pSensors->right_line_mv );
+	
+	float base_speed = course.base_speed;
+	
+	float line_threshold = params.line_threshold;
+	float exit_threshold = params.exit_threshold;
+		
+	int turn = 0;
+	
+	PD_GAINS gains;
+	gain_schedule( line_schedule, base_speed, &params.line_gains, &gains );
+	
+	float kp = gains.kp;
+	float kd = gains.kd;
+
+	if ( ( leftVoltage > exit_threshold ) && ( rightVoltage > exit_threshold ) ) {
+		// Line just dropped out from under us -- let Line_Search() go look for it.
+		if ( line_track.following ) {
+			line_track.lost = true;
+		}
+		line_track.following = false;
+	}
+	if ( ( leftVoltage < line_threshold ) && ( rightVoltage - cal.line_offset < line_threshold ) ) {
+		line_track.following = true;
+	}
+	
+	if ( line_track.following ) {
+		
+		action_state( pAction, LINE_FOLLOWING );
+		
+		rightVoltage -= cal.line_offset;		
+		float error = leftVoltage - rightVoltage;
+		
+		float derivative = 0;
+		static float lastError = 0;
+		
+		derivative = error - lastError;
+		
+		// Use difference between two sensor to determine turning speed and direction
+		turn = kp * error + kd * derivative;
+		
+		action_speed( pAction, base_speed + turn, base_speed - turn );
+		
+		// Remember which side the line was on in case we lose it.
+		if ( error > 0 ) {
+			line_track.last_dir = 1;
+		}
+		else if ( error < 0 ) {
+			line_track.last_dir = -1;
+		}
+		
+		// Hand the error size to the course learner.
+		float err_mag = ( ( error < 0 ) ? -error : error ) * COURSE_ERR_SCALE;
+		line_track.err_mag = ( err_mag > 255 ) ? 255 : (unsigned char) err_mag;
+		
+		lastError = error;
+	}
+	
+} // end Line_Follow
+
+// --------------------------------------------------------------------------------------------------------------------------- //
+void Line_Search( volatile MOTOR_ACTION *pAction ) {
+	
+	// Sweeps an arc toward the side the line was last seen on.  The arc starts
+	// tight and opens up every SEARCH_TICK_MS, so the bot spirals outward until
+	// Line_Follow() picks the line back up or SEARCH_TIMEOUT_MS runs out.  The
+	// timer paces the arc -- nothing in here blocks.
+	static BOOL timer_started = FALSE;
+	static TIMEROBJ search_timer;
+	
+	signed short inner;
+	
+	if ( timer_started == FALSE ) {
+		TMRSRVC_new( &search_timer, TMRFLG_NOTIFY_FLAG, TMRTCM_RESTART, SEARCH_TICK_MS );
+		timer_started = TRUE;
+	}
+	
+	// Line_Follow() has the line again -- hand control straight back.
+	if ( line_track.following ) {
+		if ( line_track.lost ) {
+			line_track.reacquire_ms = line_track.search_ticks * SEARCH_TICK_MS;
+		}
+		line_track.lost = false;
+		line_track.search_ticks = 0;
+		return;
+	}
+	
+	if ( !line_track.lost ) {
+		return;
+	}
+	
+	if ( TIMER_ALARM( search_timer ) ) {
+		line_track.search_ticks++;
+		TIMER_SNOOZE( search_timer );
+	}
+	
+	// Time's up -- give up and let Cruise() drive.
+	if ( line_track.search_ticks >= ( SEARCH_TIMEOUT_MS / SEARCH_TICK_MS ) ) {
+		line_track.lost = false;
+		line_track.search_ticks = 0;
+		return;
+	}
+	
+	inner = SEARCH_INNER_START + SEARCH_INNER_STEP * line_track.search_ticks;
+	if ( inner > SEARCH_SPEED ) {
+		inner = SEARCH_SPEED;
+	}
+	
+	action_state( pAction, LINE_SEARCHING );
+	
+	// Line was to the right -- left wheel on the outside of the arc.
+	if ( line_track.last_dir > 0 ) {
+		action_speed( pAction, SEARCH_SPEED, inner );
+	}
+	else {
+		action_speed( pAction, inner, SEARCH_SPEED );
+	}
+	
+} // end Line_Search
+
+// --------------------------------------------------------------------------------------------------------------------------- //
+void Course_Learn( void ) {
+	
+	// First lap: record the peak line error for every COURSE_BIN_STEPS of
+	// track.  A lap is over once the heading has wound through a full turn,
+	// which holds for any simple closed course no matter its length.  After
+	// that: look a couple of bins ahead and speed up on straights, slow down
+	// before the curves we know are coming.
+	signed long dist = ODOM_DIST( odometry );
+	signed long heading = ODOM_HEADING( odometry );
+	signed long turned;
+	unsigned short bin;
+	unsigned char peak;
+	unsigned char i;
+	
+	switch ( course.mode ) {
+		
+		case COURSE_OFF:
+		break;
+		
+		case COURSE_WAITING:
+		if ( line_track.following ) {
+			for ( i = 0; i < COURSE_BINS; i++ ) {
+				course.profile[ i ] = 0;
+			}
+			course.lap_start = dist;
+			course.lap_heading = heading;
+			course.lap_start_ms = odometry.time_ms;
+			course.mode = COURSE_LEARNING;
+		}
+		break;
+		
+		case COURSE_LEARNING:
+		case COURSE_RACING:
+		
+		bin = ( dist - course.lap_start ) / COURSE_BIN_STEPS;
+		if ( bin >= COURSE_BINS ) {
+			bin = COURSE_BINS - 1;
+		}
+		
+		turned = heading - course.lap_heading;
+		if ( labs( turned ) >= COURSE_LAP_TURN ) {
+			
+			// Lap complete.
+			if ( course.mode == COURSE_LEARNING ) {
+				course.n_bins = bin + 1;
+				course.mode = COURSE_RACING;
+			}
+			course.lap_start = dist;
+			course.lap_heading += ( turned > 0 ) ? COURSE_LAP_TURN : -COURSE_LAP_TURN;
+			course.last_lap_ms = odometry.time_ms - course.lap_start_ms;
+			course.lap_start_ms = odometry.time_ms;
+			course.laps++;
+			bin = 0;
+		}
+		
+		if ( course.mode == COURSE_LEARNING ) {
+			if ( line_track.following && ( line_track.err_mag > course.profile[ bin ] ) ) {
+				course.profile[ bin ] = line_track.err_mag;
+			}
+			break;
+		}
+		
+		// Odometry drifts a little every lap -- don't run off the profile.
+		if ( bin >= course.n_bins ) {
+			bin = course.n_bins - 1;
+		}
+		
+		peak = 0;
+		for ( i = 0; i <= COURSE_LOOKAHEAD; i++ ) {
+			if ( course.profile[ ( bin + i ) % course.n_bins ] > peak ) {
+				peak = course.profile[ ( bin + i ) % course.n_bins ];
+			}
+		}
+		
+		if ( peak <= COURSE_STRAIGHT_ERR ) {
+			course.base_speed = COURSE_FAST_SPEED;
+		}
+		else if ( peak >= COURSE_CURVE_ERR ) {
+			course.base_speed = COURSE_SLOW_SPEED;
+		}
+		else {
+			course.base_speed = COURSE_FAST_SPEED - ( COURSE_FAST_SPEED - COURSE_SLOW_SPEED ) *
+								( peak - COURSE_STRAIGHT_ERR ) / ( COURSE_CURVE_ERR - COURSE_STRAIGHT_ERR );
+		}
+		break;
+	}
+	
+} // end Course_Learn
+
+// --------------------------------------------------------------------------------------------------------------------------- //
+void Auto_Tune( volatile MOTOR_ACTION *pAction, volatile SENSOR_DATA *pSensors ) {
+	
+	// Relay feedback: instead of PD, turn a fixed amount toward the line (or
+	// away from the wall) and flip direction whenever the error crosses zero.
+	// That holds the loop in a steady oscillation at its ultimate period Tu,
+	// and the oscillation amplitude 'a' gives the ultimate gain:
+	//
+	//		Ku = 4 * d / ( pi * sqrt( a^2 - eps^2 ) )
+	//
+	// for a relay of amplitude d with hysteresis eps.  The PD gains then
+	// follow Ziegler-Nichols: kp = 0.8 * Ku, Td = Tu / 8.  This runs as a
+	// behavior like any other, so sensing never stops.  Periods are timed
+	// on the odometry clock, which counts every tick in the timer interrupt,
+	// so a slow pass only shifts a flip to the next pass -- it can't lose
+	// time from a period.
+	float error;
+	float relay_d;
+	float hyst;
+	float amp;
+	float ku;
+	unsigned long now = odometry.time_ms;
+	unsigned long tu;
+	unsigned short sample_ms;
+	PD_GAINS *pGains;
+	
+	if ( tuner.phase != TUNE_RUNNING ) {
+		return;
+	}
+	
+	if ( tuner.target == TUNE_LINE ) {
+		
+		// Only while we're actually on the line.
+		if ( !line_track.following ) {
+			return;
+		}
+		error = MV_TO_V( pSensors->left_line_mv ) - ( MV_TO_V( pSensors->right_line_mv ) - cal.line_offset );
+		relay_d = TUNE_RELAY_LINE;
+		hyst = TUNE_HYST_LINE;
+		sample_ms = LINE_SENSE_MS;
+		pGains = &params.line_gains;
+	}
+	else {
+		error = WALL_GOAL_DIST - MM_TO_CM( pSensors->sonar_mm );
+		relay_d = TUNE_RELAY_WALL;
+		hyst = TUNE_HYST_WALL;
+		sample_ms = SONAR_SENSE_MS;
+		pGains = &params.wall_gains;
+	}
+	
+	if ( !tuner.started ) {
+		tuner.started = true;
+		tuner.start_ms = now;
+		tuner.cycle_start_ms = now;
+		tuner.relay = ( error >= 0 ) ? 1 : -1;
+		tuner.err_max = error;
+		tuner.err_min = error;
+	}
+	
+	if ( ( now - tuner.start_ms ) > TUNE_TIMEOUT_MS ) {
+		tuner.phase = TUNE_FAILED;
+		return;
+	}
+	
+	if ( error > tuner.err_max ) {
+		tuner.err_max = error;
+	}
+	if ( error < tuner.err_min ) {
+		tuner.err_min = error;
+	}
+	
+	// Relay with hysteresis.  Each flip to '+' closes one cycle.
+	if ( ( tuner.relay < 0 ) && ( error > hyst ) ) {
+		
+		tuner.relay = 1;
+		
+		if ( tuner.cycles >= TUNE_SKIP_CYCLES ) {
+			tuner.period_sum += now - tuner.cycle_start_ms;
+			tuner.amp_sum += ( tuner.err_max - tuner.err_min ) / 2;
+		}
+		tuner.cycles++;
+		tuner.cycle_start_ms = now;
+		tuner.err_max = error;
+		tuner.err_min = error;
+	}
+	else if ( ( tuner.relay > 0 ) && ( error < -hyst ) ) {
+		tuner.relay = -1;
+	}
+	
+	if ( tuner.cycles >= ( TUNE_SKIP_CYCLES + TUNE_CYCLES ) ) {
+		
+		amp = tuner.amp_sum / TUNE_CYCLES;
+		tu = tuner.period_sum / TUNE_CYCLES;
+		
+		if ( amp <= hyst ) {
+			tuner.phase = TUNE_FAILED;
+			return;
+		}
+		
+		ku = ( 4 * relay_d ) / ( M_PI * sqrt( amp * amp - hyst * hyst ) );
+		
+		// The PD loops take their derivative once per sensor update, so
+		// Td goes in as a number of samples.
+		pGains->kp = 0.8 * ku;
+		pGains->kd = pGains->kp * tu / ( 8.0 * sample_ms );
+		
+		params_save();
+		tuner.phase = TUNE_DONE;
+		return;
+	}
+	
+	action_state( pAction, AUTO_TUNING );
+	
+	if ( tuner.target == TUNE_LINE ) {
+		action_speed( pAction, LINE_BASE_SPEED + tuner.relay * relay_d,
+					  LINE_BASE_SPEED - tuner.relay * relay_d );
+	}
+	else {
+		action_speed( pAction, WALL_BASE_SPEED - tuner.relay * relay_d,
+					  WALL_BASE_SPEED + tuner.relay * relay_d );
+	}
+	
+} // end Auto_Tune
+
+// --------------------------------------------------------------------------------------------------------------------------- //		
+void act( volatile MOTOR_ACTION *pAction )
+{
+
+	// 'act()' keeps track of the command VERSION it last executed, and
+	// executes a command ONLY when the version has moved on -- that is,
+	// when a behavior set some parameter in the 'MOTOR_ACTION' structure
+	// to something new.  This
+	// is necessary to prevent motor 'jitter'.  Version 0 is the zeroed
+	// STARTUP command, which is where the motors already are.
+	static unsigned char acted_version = 0;
+	MOTOR_ACTION command;
+	unsigned long ms;
+
+	action_publish( pAction );
+
+	if( motor_cmd.version != acted_version )
+	{
+
+		// Perform the action.  Just call the 'free-running' version
+		// of stepper move function and feed these same parameters --
+		// unless a reaction's step move has the wheels.
+		acted_version = action_snapshot( &command );
+		if ( command.state != REACTING )
+		{
+
+			__MOTOR_ACTION( command );
+			odometry_drive( command.speed_L, command.speed_R, command.accel_L, command.accel_R );
+
+		} // end if()
+
+		// First motor command since power-on -- note how long that took,
+		// and the boot clock's done.  The telemetry field is 16 bits, so
+		// a boot that sat in the menu past 65.5 s reads 0xFFFF rather than
+		// wrapping; 0 is kept for "not yet".
+		if ( boot.first_output_ms == 0 )
+		{
+
+			ms = boot_clock();
+			boot_clock_stop();
+
+			if ( ms > 0xFFFF )
+				ms = 0xFFFF;
+			else if ( ms == 0 )
+				ms = 1;
+			boot.first_output_ms = ms;
+
+		} // end if()
+
+	} // end if()
+			
+} // end act()
+
+// ---------------------- CBOT Main ---------------------------------------------------------------------------------------------- //
+// ------------------------------------------------------------------------------------------------------------------------------- //
+void CBOT_main( void )
+{
+
+	volatile SENSOR_DATA sensor_data;
+	BOOL setup;
+
+	// Start the boot clock before anything else.
+	boot_clock();
+
+	// Nothing read from the Pixy yet.
+	sensor_data.pixy_frame = 0;
+	sensor_data.pixy_seq = 0;
+			
+	// ** Open the needed modules.
+	//STOPWATCH_open();
+	LED_open();     // Open the LED subsystem module.
+	LCD_open();     // Open the LCD subsystem module.
+	LCD_fb_init();
+	STEPPER_open(); // Open the STEPPER subsystem module.
+	ADC_open();
+	ADC_set_VREF(ADC_VREF_AVCC);	// set ADC reference to 5V
+	
+	Telemetry_init();
+
+	// Pick up the saved parameters, including any auto-tuned gains and
+	// the last mode run.
+	params_load();
+			
+	// Reset the current motor action.
+	__RESET_ACTION( action );
+			
+	// Pick a mode from the boot menu, calibrating while it's up.  This
+	// stands in for the old 3 second start delay and single-sample
+	// 'Photo_init()'.
+	mode = Mode_select( &setup );
+	Calibrate_apply( &sensor_data, mode );
+	course.base_speed = LINE_BASE_SPEED;
+
+	// Only open what the mode needs, and run its setup step if asked.
+	switch( mode )
+	{
+
+		case MODE_RACE:
+			course.mode = COURSE_WAITING;
+			// Fall through -- racing is line following plus course learning.
+
+		case MODE_LINE:
+			if ( setup == TRUE ) {
+				tuner.target = TUNE_LINE;
+				tuner.phase = TUNE_RUNNING;
+			}
+		break;
+
+		case MODE_WALL:
+			// (The sonar was opened for its self-test.)
+			if ( setup == TRUE ) {
+				tuner.target = TUNE_WALL;
+				tuner.phase = TUNE_RUNNING;
+			}
+		break;
+
+		case MODE_PIXY:
+			pixy_start();
+
+			// Pick up the saved size -> range calibration, if any.
+			range_cal_load();
+			if ( setup == TRUE ) {
+				range_calibrate( &sensor_data );
+			}
+		break;
+
+		case MODE_REACT:
+			SPKR_open( SPKR_TONE_MODE );
+			pixy_start();
+		break;
+
+		default:
+		break;
+
+	} // end switch()
+			
+	// Clear the screen and enter the arbitration loop.
+	LCD_fb_clear();
+			
+	// Enter the 'arbitration' while() loop -- it is important that NONE
+	// of the behavior functions listed in the arbitration loop BLOCK!
+	// Behaviors are listed in increasing order of priority, with the last
+	// behavior having the greatest priority (because it has the last 'say'
+	// regarding motor action (or any action)).
+	while( 1 )
+	{
+		// Apply any tuning command that came in during the last pass.
+		Tuning_service();
+
+		// Sensing.
+		// (IR sense happens every 125ms).
+		IR_sense( &sensor_data, 125 );
+		Odometry_sense( ODOM_INTERVAL_MS );
+
+		switch( mode )
+		{
+
+			case MODE_LINE:
+			case MODE_RACE:
+				Line_sense( &sensor_data, LINE_SENSE_MS );
+				Course_Learn();
+			break;
+
+			case MODE_WALL:
+				Sonar_sense( &sensor_data, SONAR_SENSE_MS );
+			break;
+
+			case MODE_LIGHT:
+				Photo_sense( &sensor_data, PHOTO_SENSE_MS );
+				Sonar_sense( &sensor_data, SONAR_SENSE_MS );
+			break;
+
+			case MODE_REACT:
+				// Keep any song going.
+				speaker_service( SPKR_TICK_MS );
+				// Fall through -- both Pixy modes group blocks into frames.
+
+			case MODE_PIXY:
+				// Handle anything the interrupts posted, and group the
+				// Pixy's blocks into frames.
+				events_dispatch();
+				pixy_frame_close( PIXY_TICK_MS );
+			break;
+
+			default:
+			break;
+
+		} // end switch()
+				
+		// Behaviors.
+		Cruise( &action );
+
+		switch( mode )
+		{
+
+			case MODE_LINE:
+			case MODE_RACE:
+				Line_Search( &action );
+				Line_Follow( &action, &sensor_data );
+				Auto_Tune( &action, &sensor_data );
+			break;
+
+			case MODE_WALL:
+				Wall_Follow( &action, &sensor_data );
+				Wall_Corner( &action, &sensor_data );
+				Auto_Tune( &action, &sensor_data );
+			break;
+
+			case MODE_LIGHT:
+				Light_Follow( &action, &sensor_data );
+				Sonar_Avoid( &action, &sensor_data );
+			break;
+
+			case MODE_PIXY:
+				Pixy_Follow( &action, &sensor_data );
+			break;
+
+			case MODE_REACT:
+				Pixy_Trigger( &action, &sensor_data );
+
+				// Carry out any color signature reaction it started.
+				React( &action, REACT_TICK_MS );
+			break;
+
+			default:
+			break;
+
+		} // end switch()
+
+		// Lab 9 ran without IR avoidance -- following holds its own
+		// standoff and backs away from the target.
+		if ( mode != MODE_PIXY ) {
+			IR_avoid( &action, &sensor_data );
+		}
+				
+		// Perform the action of highest priority.
+		act( &action );
+
+		// Real-time display info, should happen last, if possible (
+		// except for 'ballistic' behaviors).  Technically this is sort of
+		// 'optional' as it does not constitute a 'behavior'.
+		info_display( &action );
+		
+		// Send whatever changed on the display, a few characters at a time.
+		LCD_flush( LCD_FLUSH_MS );
+
+		// Queue a telemetry frame for the UART to send in the background.
+		Telemetry_send( &action, &sensor_data, TLM_PERIOD_MS );
+				
+	} // end while()
+			
+} // end CBOT_main()
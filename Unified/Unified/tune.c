@@ -0,0 +1,192 @@
+/* Auth: Megan Bird & Gary Miller
+ * File: tune.c
+ * Course: CEEN-3450  Mobile Robotics I  University of Nebraska-Lincoln
+ * Lab: Unified image (Labs 6 - 9)
+ * Date: 4/27/2017
+ * Desc: Live tuning, see tune.h.  Plain C plus avr-libc's pgmspace and
+ *       crc16 helpers, which Host/mock/ stands in for on a PC.
+ */
+
+#include "config.h"
+#include "tune.h"
+#include <stddef.h>
+#include <string.h>
+#include <avr/pgmspace.h>
+#include <util/crc16.h>
+
+// ---------------------- Globals:
+PARAMS params;					// RAM copy of the parameter block.
+
+// Indexed by PARAM_ID.
+const PARAM_DESC param_table[ PARAM_COUNT ] PROGMEM = {
+
+	{ offsetof( PARAMS, deg_90 ),			PARAM_S16,		50,		300 },
+	{ offsetof( PARAMS, line_base_speed ),	PARAM_S16,		0,		400 },
+	{ offsetof( PARAMS, wall_base_speed ),	PARAM_S16,		0,		400 },
+	{ offsetof( PARAMS, sonar_trigger ),	PARAM_S16,		0,		300 },
+	{ offsetof( PARAMS, wall_goal_perp ),	PARAM_FLOAT,	10,		100 },
+	{ offsetof( PARAMS, line_threshold ),	PARAM_FLOAT,	0,		5 },
+	{ offsetof( PARAMS, exit_threshold ),	PARAM_FLOAT,	0,		5 },
+	{ offsetof( PARAMS, line_gains.kp ),	PARAM_FLOAT,	0,		1000 },
+	{ offsetof( PARAMS, line_gains.kd ),	PARAM_FLOAT,	0,		1000 },
+	{ offsetof( PARAMS, wall_gains.kp ),	PARAM_FLOAT,	0,		100 },
+	{ offsetof( PARAMS, wall_gains.kd ),	PARAM_FLOAT,	0,		100 },
+	{ offsetof( PARAMS, line_sense_ms ),	PARAM_S16,		5,		1000 },
+	{ offsetof( PARAMS, sonar_sense_ms ),	PARAM_S16,		50,		1000 },
+	{ offsetof( PARAMS, mode ),				PARAM_S16,		0,		MODE_COUNT - 1 },
+	{ offsetof( PARAMS, pixy_zone_x ),		PARAM_S16,		0,		160 },
+	{ offsetof( PARAMS, follow_standoff ),	PARAM_S16,		RANGE_CAL_FIRST_CM,	RANGE_CAL_FIRST_CM + ( RANGE_CAL_POINTS - 1 ) * RANGE_CAL_STEP_CM },
+	{ offsetof( PARAMS, menu_ms ),			PARAM_S16,		0,		10000 }
+
+};
+
+// ---------------------- Functions:
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+unsigned char cobs_decode( const unsigned char *pSrc, unsigned char len, unsigned char *pDst )
+{
+
+	// Undoes the COBS encoding (delimiter already stripped).  Returns the
+	// decoded length, or 0 if the frame is malformed.
+	unsigned char in = 0;
+	unsigned char out = 0;
+	unsigned char code;
+	unsigned char i;
+
+	while ( in < len ) {
+
+		code = pSrc[ in++ ];
+		if ( code == 0 || in + code - 1 > len ) {
+			return 0;
+		}
+
+		for ( i = 1; i < code; i++ ) {
+			pDst[ out++ ] = pSrc[ in++ ];
+		}
+
+		// A code below 0xFF stands for a zero, except at the very end.
+		if ( code < 0xFF && in < len ) {
+			pDst[ out++ ] = 0;
+		}
+
+	}
+
+	return out;
+
+} // end cobs_decode()
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+void tune_handle( const unsigned char *pFrame, unsigned char len, TUNE_REPLY *pReply )
+{
+
+	// Decodes one command frame (COBS, delimiter already stripped), applies
+	// it, and fills in the reply.  A frame that doesn't decode to exactly a
+	// TUNE_CMD and its CRC is answered with TUNE_BAD_FRAME.
+	unsigned char data[ TUNE_RX_LEN ];
+	unsigned char n = 0;
+	unsigned short crc = 0xFFFF;
+	unsigned char i;
+	TUNE_CMD cmd;
+
+	if ( len <= TUNE_RX_LEN ) {
+		n = cobs_decode( pFrame, len, data );
+	}
+
+	pReply->tag = TUNE_REPLY_TAG;
+	pReply->op = 0;
+	pReply->id = 0;
+	pReply->value = 0;
+	pReply->status = TUNE_BAD_FRAME;
+
+	// Running the CRC over the data and its own CRC leaves 0.
+	for ( i = 0; i < n; i++ ) {
+		crc = _crc_ccitt_update( crc, data[ i ] );
+	}
+
+	if ( n != sizeof( TUNE_CMD ) + 2 || crc != 0 ) {
+		return;
+	}
+
+	memcpy( &cmd, data, sizeof( TUNE_CMD ) );
+	pReply->op = cmd.op;
+	pReply->id = cmd.id;
+	pReply->status = TUNE_OK;
+
+	switch( cmd.op ) {
+
+		case TUNE_GET: break;
+
+		case TUNE_SET:
+			if ( cmd.id < PARAM_COUNT && param_set( cmd.id, cmd.value ) == 0 ) {
+				pReply->status = TUNE_RANGE;
+			}
+			break;
+
+		case TUNE_SAVE: params_save(); break;
+
+		case TUNE_LOAD: params_load(); break;
+
+		default: pReply->status = TUNE_BAD_OP; break;
+
+	} // end switch()
+
+	if ( ( cmd.op == TUNE_GET || cmd.op == TUNE_SET ) && cmd.id >= PARAM_COUNT ) {
+		pReply->status = TUNE_BAD_ID;
+	}
+	pReply->value = param_get( cmd.id );
+
+} // end tune_handle()
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+float param_get( PARAM_ID id )
+{
+
+	PARAM_DESC desc;
+	unsigned char *p;
+
+	if ( id >= PARAM_COUNT ) {
+		return 0;
+	}
+
+	memcpy_P( &desc, &param_table[ id ], sizeof( PARAM_DESC ) );
+	p = ( unsigned char * ) &params + desc.offset;
+
+	if ( desc.kind == PARAM_S16 ) {
+		return *( signed short * ) p;
+	}
+
+	return *( float * ) p;
+
+} // end param_get()
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------ //
+unsigned char param_set( PARAM_ID id, float value )
+{
+
+	// Changes the RAM copy only -- params_save() makes it stick.  Values
+	// outside the parameter's range are refused, and so is NaN, which every
+	// comparison calls false -- hence the range test written as 'inside'.
+	PARAM_DESC desc;
+	unsigned char *p;
+
+	if ( id >= PARAM_COUNT ) {
+		return 0;
+	}
+
+	memcpy_P( &desc, &param_table[ id ], sizeof( PARAM_DESC ) );
+
+	if ( !( value >= desc.min && value <= desc.max ) ) {
+		return 0;
+	}
+
+	p = ( unsigned char * ) &params + desc.offset;
+
+	if ( desc.kind == PARAM_S16 ) {
+		*( signed short * ) p = ( value < 0 ) ? value - 0.5 : value + 0.5;
+	}
+	else {
+		*( float * ) p = value;
+	}
+
+	return 1;
+
+} // end param_set()
@@ -0,0 +1,170 @@
+/* Auth: Megan Bird & Gary Miller
+ * File: tune.h
+ * Course: CEEN-3450  Mobile Robotics I  University of Nebraska-Lincoln
+ * Lab: Unified image (Labs 6 - 9)
+ * Date: 4/27/2017
+ * Desc: Live tuning: the parameter block, its table, and the command
+ *       parser.  Nothing here touches the hardware -- the UART and the
+ *       EEPROM (params_load()/params_save()) stay in main.c -- so the host
+ *       tests in Host/ build tune.c as is and drive it with real frames.
+ */
+
+#ifndef TUNE_H
+#define TUNE_H
+
+// ---------------------- Defines:
+#define TUNE_REPLY_TAG		0xA5	/* First byte of a command reply (telemetry starts with TLM_VERSION). */
+
+// The range table's span bounds the Pixy_Follow() standoff parameter.
+#define RANGE_CAL_POINTS	6		/* Points in the blob size -> range table. */
+#define RANGE_CAL_FIRST_CM	20		/* Range of the first point... */
+#define RANGE_CAL_STEP_CM	15		/* ...and the spacing of the rest (20, 35, ... 95 cm). */
+
+// ---------------------- Type Declarations:
+
+// Desc: Which set of behaviors the arbitration loop runs.  Picked at boot.
+typedef enum MODE_TYPE {
+
+	MODE_LINE = 0,	// Line following with line search (Lab 8).
+	MODE_RACE,		// Line following, learning the course on the first lap (Lab 8).
+	MODE_WALL,		// Wall following around outside corners (Labs 7/8).
+	MODE_LIGHT,		// Light homing with sonar and IR avoidance (Lab 6).
+	MODE_PIXY,		// Follow a Pixy target at a standoff distance (Lab 9).
+	MODE_REACT,		// Play a song and turn for Pixy color signatures (Lab 9 bonus).
+	MODE_COUNT
+
+} MODE;
+
+// Desc: A pair of PD gains.
+typedef struct PD_GAINS_TYPE {
+
+	float kp;
+	float kd;
+
+} PD_GAINS;
+
+// Desc: Everything that can be tuned without a rebuild.  Behaviors read the
+//       RAM copy ('params') directly; param_get()/param_set() go through
+//       'param_table' for anything that only has a PARAM_ID.
+typedef struct PARAMS_TYPE {
+
+	signed short deg_90;			// Steps for a 90-degree in-place turn.
+	signed short line_base_speed;	// Line following speed, steps/sec.
+	signed short wall_base_speed;	// Wall following speed, steps/sec.
+	signed short sonar_trigger;		// Sonar_Avoid() trigger distance, cm.
+	float wall_goal_perp;			// Distance to hold from the wall, cm.
+	float line_threshold;			// On-the-line voltage.
+	float exit_threshold;			// Off-the-course voltage.
+	PD_GAINS line_gains;			// Line following gains at LINE_BASE_SPEED.
+	PD_GAINS wall_gains;			// Wall following gains at WALL_BASE_SPEED.
+	signed short line_sense_ms;		// Line sensor period, ms.
+	signed short sonar_sense_ms;	// Sonar period, ms.
+	signed short mode;				// MODE the boot menu starts on.
+	signed short pixy_zone_x;		// Pixy_Follow() steering dead zone, pixels.
+	signed short follow_standoff;	// Pixy_Follow() distance to hold, cm.
+	signed short menu_ms;			// Boot menu timeout, 0 for instant start.
+
+} PARAMS;
+
+// Desc: Parameter identifiers, for param_get()/param_set().
+typedef enum PARAM_ID_TYPE {
+
+	PARAM_DEG_90,
+	PARAM_LINE_SPEED,
+	PARAM_WALL_SPEED,
+	PARAM_SONAR_TRIGGER,
+	PARAM_WALL_GOAL,
+	PARAM_LINE_THRESH,
+	PARAM_EXIT_THRESH,
+	PARAM_LINE_KP,
+	PARAM_LINE_KD,
+	PARAM_WALL_KP,
+	PARAM_WALL_KD,
+	PARAM_LINE_MS,
+	PARAM_SONAR_MS,
+	PARAM_MODE,
+	PARAM_PIXY_ZONE,
+	PARAM_STANDOFF,
+	PARAM_MENU_MS,
+	PARAM_COUNT
+
+} PARAM_ID;
+
+// Desc: How a parameter is stored inside PARAMS.
+typedef enum PARAM_KIND_TYPE {
+
+	PARAM_S16,
+	PARAM_FLOAT
+
+} PARAM_KIND;
+
+// Desc: Where a parameter lives in PARAMS, its type, and the range
+//       param_set() will accept.
+typedef struct PARAM_DESC_TYPE {
+
+	unsigned char offset;			// offsetof() into PARAMS.
+	unsigned char kind;				// PARAM_KIND.
+	float min;
+	float max;
+
+} PARAM_DESC;
+
+// Desc: Live tuning commands.  The host sends a TUNE_CMD framed exactly like
+//       telemetry (CRC-16/CCITT, COBS, 0x00) on the same UART, and gets a
+//       TUNE_REPLY back in the telemetry stream.  TUNE_SET only changes the
+//       RAM copy; TUNE_SAVE writes it to EEPROM, TUNE_LOAD throws the
+//       changes away.
+typedef enum TUNE_OP_TYPE {
+
+	TUNE_GET = 1,	// Reply with the value of 'id'.
+	TUNE_SET,		// Set 'id' to 'value', reply with the value now in effect.
+	TUNE_SAVE,		// Save every parameter to EEPROM.
+	TUNE_LOAD		// Reload every parameter from EEPROM (or the defaults).
+
+} TUNE_OP;
+
+// Desc: Reply status codes.
+typedef enum TUNE_STATUS_TYPE {
+
+	TUNE_OK,
+	TUNE_BAD_FRAME,	// Bad COBS, length, or CRC -- 'cmd' and 'id' are 0.
+	TUNE_BAD_OP,
+	TUNE_BAD_ID,
+	TUNE_RANGE		// Value outside the parameter's range, nothing changed.
+
+} TUNE_STATUS;
+
+// Desc: A command, as sent by the host (packed, little-endian).
+typedef struct TUNE_CMD_TYPE {
+
+	unsigned char op;				// TUNE_OP.
+	unsigned char id;				// PARAM_ID (GET/SET only).
+	float value;					// New value (SET only).
+
+} __attribute__(( packed )) TUNE_CMD;
+
+// Desc: The reply to every command.
+typedef struct TUNE_REPLY_TYPE {
+
+	unsigned char tag;				// TUNE_REPLY_TAG.
+	unsigned char op;				// The command being answered.
+	unsigned char id;
+	unsigned char status;			// TUNE_STATUS.
+	float value;					// Value of 'id' after the command.
+
+} __attribute__(( packed )) TUNE_REPLY;
+
+// ---------------------- Globals:
+extern PARAMS params;			// RAM copy of the parameter block.
+
+// ---------------------- Prototypes:
+unsigned char cobs_decode( const unsigned char *pSrc, unsigned char len, unsigned char *pDst );
+void tune_handle( const unsigned char *pFrame, unsigned char len, TUNE_REPLY *pReply );
+float param_get( PARAM_ID id );
+unsigned char param_set( PARAM_ID id, float value );
+
+// Supplied by main.c (EEPROM) -- or by the host test.
+void params_load( void );
+void params_save( void );
+
+#endif /* TUNE_H */